@@ -1,8 +1,27 @@
 #include <windows.h>
 #include <gdiplus.h>
+#include <mmsystem.h>
+#include <dwmapi.h>
 #include <string>
-#include <sstream>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_KERNELS_X86
+#endif
 
 using namespace Gdiplus;
 
@@ -30,6 +49,9 @@ int pauseMenuSelection = 0; // 0: resume, 1: exit
 float countdownTimer = 0.0f; // 3 second countdown before resuming
 bool isCountingDown = false;
 float pauseAnimTime = 0.0f;
+const int PAUSE_FRAME_WIDTH = 600;
+const int PAUSE_FRAME_HEIGHT = 500;
+const int PAUSE_DIM_ALPHA = 155;  // black over the captured game, leaves 100/255 of it
 
 // Game variables
 const int PADDLE_WIDTH = 10;
@@ -38,22 +60,62 @@ const int PADDLE_SPEED = 8;
 int currentPaddleSpeed = PADDLE_SPEED;
 float currentSpeedFactor = 1.25f;
 
-float leftPaddleY = (WINDOW_HEIGHT - PADDLE_HEIGHT) / 2.0f;
-float rightPaddleY = (WINDOW_HEIGHT - PADDLE_HEIGHT) / 2.0f;
-
 // Ball variables
 const int BALL_RADIUS = 6;
 const float SPEED_INCREASE_FACTOR = 1.25f;
 const int MAX_HITS_FOR_SPEED_INCREASE = 6;
-int hitCount = 0;
-float ballX = WINDOW_WIDTH / 2.0f;
-float ballY = WINDOW_HEIGHT / 2.0f;
-float ballVelocityX = -5.0f;
-float ballVelocityY = 3.0f;
 
-// Score variables
-int leftScore = 0;
-int rightScore = 0;
+// Match state - everything the ball/paddle simulation reads and writes.
+// Kept in one struct so a match can be stepped without a window
+// (see StepMatch and the headless tournament host).
+struct MatchState {
+    float leftPaddleY;
+    float rightPaddleY;
+    float ballX;
+    float ballY;
+    float ballVelocityX;
+    float ballVelocityY;
+    int hitCount;
+    int leftScore;
+    int rightScore;
+};
+
+// Paddle controls for one simulation step
+struct MatchInput {
+    bool leftUp;
+    bool leftDown;
+    bool rightUp;
+    bool rightDown;
+};
+
+void ResetMatch(MatchState& m, int fieldWidth, int fieldHeight) {
+    m.leftPaddleY = (fieldHeight - PADDLE_HEIGHT) / 2.0f;
+    m.rightPaddleY = (fieldHeight - PADDLE_HEIGHT) / 2.0f;
+    m.ballX = fieldWidth / 2.0f;
+    m.ballY = fieldHeight / 2.0f;
+    m.ballVelocityX = -5.0f;
+    m.ballVelocityY = 3.0f;
+    m.hitCount = 0;
+    m.leftScore = 0;
+    m.rightScore = 0;
+}
+
+MatchState match = {
+    (WINDOW_HEIGHT - PADDLE_HEIGHT) / 2.0f, (WINDOW_HEIGHT - PADDLE_HEIGHT) / 2.0f,
+    WINDOW_WIDTH / 2.0f, WINDOW_HEIGHT / 2.0f, -5.0f, 3.0f,
+    0, 0, 0
+};
+
+// Fixed-rate simulation. Frames may come faster or slower than ticks; each
+// frame draws the match between its last two ticks (see AdvanceSimulation)
+const int SIMULATION_TICK_RATE = 60;
+const float SIMULATION_TICK_SECONDS = 1.0f / SIMULATION_TICK_RATE;
+const int MAX_TICKS_PER_FRAME = 6;    // after a stall, drop time instead of catching up
+MatchState previousMatch = match;     // state one tick before `match`
+MatchState drawnMatch = match;        // what the latest frame shows
+float simulationAccumulator = 0.0f;   // real time not simulated yet
+float renderAlpha = 1.0f;             // 0..1 from previousMatch to match
+bool mainBallScored = false;          // the last tick's goal put the match ball back in the centre
 
 // Key state tracking
 bool wKeyPressed = false;
@@ -65,899 +127,6728 @@ bool downKeyPressed = false;
 float menuAnimTime = 0.0f;
 float selectionAnimTime = 0.0f;
 
-// Helper function to convert int to wstring
-std::wstring IntToWString(int value) {
-    std::wstringstream ss;
-    ss << value;
-    return ss.str();
-}
+// Frame scheduling - the message loop sleeps until input arrives or the
+// current state next needs a frame, and stops drawing while hidden
+const DWORD FRAME_INTERVAL_MS = 16;          // ~60 FPS while something moves
+const DWORD AMBIENT_FRAME_INTERVAL_MS = 33;  // slow ambient animation only
+const DWORD HIDDEN_POLL_MS = 250;            // re-check visibility while cloaked
+bool windowMinimized = false;
+bool redrawRequested = true;                 // input or resize changed the picture
+float frameDeltaSeconds = 1.0f / 60.0f;      // real time since the previous frame
+LARGE_INTEGER lastFrameCounter = {};
+bool paintScheduled = false;                 // WM_PAINT was requested by our own loop
+DWORD playingFrameIntervalMs = FRAME_INTERVAL_MS;  // follows the display refresh rate
 
-LRESULT CALLBACK WindowProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam) {
-    switch (msg) {
-        case WM_DESTROY:
-            PostQuitMessage(0);
-            return 0;
-        case WM_KEYDOWN:
-            if (wparam == 'W' || wparam == 'w') {
-                wKeyPressed = true;
-            } else if (wparam == 'S' || wparam == 's') {
-                sKeyPressed = true;
-            } else if (wparam == VK_UP) {
-                upKeyPressed = true;
-            } else if (wparam == VK_DOWN) {
-                downKeyPressed = true;
-            } else if (wparam == VK_ESCAPE) {
-                PostQuitMessage(0);
-            } else if (wparam == VK_LEFT && gameState == DIFFICULTY_SELECT) {
-                if (selectedDifficulty > 0) {
-                    selectedDifficulty--;
-                    selectionAnimTime = 0.0f;
-                }
-            } else if (wparam == VK_RIGHT && gameState == DIFFICULTY_SELECT) {
-                if (selectedDifficulty < 2) {
-                    selectedDifficulty++;
-                    selectionAnimTime = 0.0f;
-                }
-            } else if (wparam == 'P' || wparam == 'p') {
-                if (gameState == PLAYING) {
-                    gameState = PAUSED;
-                    pauseMenuSelection = 0; // Default to resume
-                    isCountingDown = false;
-                    countdownTimer = 0.0f;
-                    pauseAnimTime = 0.0f;
-                }
-            } else if (wparam == VK_LEFT && gameState == PAUSED && !isCountingDown) {
-                if (pauseMenuSelection > 0) {
-                    pauseMenuSelection--;
-                }
-            } else if (wparam == VK_RIGHT && gameState == PAUSED && !isCountingDown) {
-                if (pauseMenuSelection < 1) {
-                    pauseMenuSelection++;
-                }
-            } else if (wparam == VK_RETURN && gameState == PAUSED && !isCountingDown) {
-                if (pauseMenuSelection == 0) { // Resume
-                    isCountingDown = true;
-                    countdownTimer = 2.0f;
-                } else if (pauseMenuSelection == 1) { // Exit to menu
-                    gameState = MENU;
-                    selectedDifficulty = -1;
-                    leftScore = 0;
-                    rightScore = 0;
-                    hitCount = 0;
-                    ballX = WINDOW_WIDTH / 2.0f;
-                    ballY = WINDOW_HEIGHT / 2.0f;
-                    ballVelocityX = -5.0f;
-                    ballVelocityY = 3.0f;
-                }
-            } else if (wparam == VK_RETURN && gameState == DIFFICULTY_SELECT) {
-                // Start game with selected difficulty
-                gameState = PLAYING;
-                // Reset game state
-                leftPaddleY = (WINDOW_HEIGHT - PADDLE_HEIGHT) / 2.0f;
-                rightPaddleY = (WINDOW_HEIGHT - PADDLE_HEIGHT) / 2.0f;
-                ballX = WINDOW_WIDTH / 2.0f;
-                ballY = WINDOW_HEIGHT / 2.0f;
-                ballVelocityX = -5.0f;
-                ballVelocityY = 3.0f;
-                hitCount = 0;
-                leftScore = 0;
-                rightScore = 0;
-                
-                // Set difficulty parameters
-                if (selectedDifficulty == 0) { // Easy
-                    currentSpeedFactor = 1.25f;
-                    currentPaddleSpeed = PADDLE_SPEED;
-                } else if (selectedDifficulty == 1) { // Medium
-                    currentSpeedFactor = 1.45f;
-                    currentPaddleSpeed = PADDLE_SPEED + 3;
-                } else if (selectedDifficulty == 2) { // Hard
-                    currentSpeedFactor = 1.70f;
-                    currentPaddleSpeed = PADDLE_SPEED + 6;
-                }
-            }
-            
-            if (gameState == MENU) {
-                gameState = DIFFICULTY_SELECT;
-                selectedDifficulty = 0; // Default to easy
-                selectionAnimTime = 0.0f;
-            }
-            return 0;
-        case WM_KEYUP:
-            if (wparam == 'W' || wparam == 'w') {
-                wKeyPressed = false;
-            } else if (wparam == 'S' || wparam == 's') {
-                sKeyPressed = false;
-            } else if (wparam == VK_UP) {
-                upKeyPressed = false;
-            } else if (wparam == VK_DOWN) {
-                downKeyPressed = false;
-            }
-            return 0;
-        case WM_PAINT: {
-            PAINTSTRUCT ps;
-            HDC hdc = BeginPaint(hwnd, &ps);
-            
-            // Create memory DC for double buffering (prevents flickering)
-            HDC memDC = CreateCompatibleDC(hdc);
-            RECT rect;
-            GetClientRect(hwnd, &rect);
-            int clientWidth = rect.right - rect.left;
-            int clientHeight = rect.bottom - rect.top;
-            
-            HBITMAP memBitmap = CreateCompatibleBitmap(hdc, clientWidth, clientHeight);
-            HBITMAP oldBitmap = (HBITMAP)SelectObject(memDC, memBitmap);
-            
-            Graphics graphics(memDC);
-            graphics.SetSmoothingMode(SmoothingModeAntiAlias);
+// Back buffer kept between frames so PLAYING can redraw only what moved
+HDC backBufferDC = NULL;
+HBITMAP backBufferBitmap = NULL;
+HBITMAP backBufferOldBitmap = NULL;
+uint32_t* backBufferPixels = nullptr;        // DIB section bits, top-down 32bpp
+Graphics* backBufferGraphics = nullptr;      // kept with the DC; making one per frame allocates
+int backBufferWidth = 0;
+int backBufferHeight = 0;
 
-            // Create shared font objects
-            FontFamily fontFamily(L"Arial");
-            StringFormat stringFormat;
-            stringFormat.SetAlignment(StringAlignmentCenter);
-            stringFormat.SetLineAlignment(StringAlignmentCenter);
+// Dirty-rectangle tracking for PLAYING
+const int MAX_DIRTY_RECTS = 8;
+struct PlayfieldBounds {
+    RECT leftPaddle;
+    RECT rightPaddle;
+    RECT ball;
+    int leftScore;
+    int rightScore;
+};
+PlayfieldBounds lastPlayfield;
+bool playfieldValid = false;       // back buffer holds the previous PLAYING frame
+bool fullPresentRequired = true;   // screen may not match the back buffer
+RECT dirtyRects[MAX_DIRTY_RECTS];
+int dirtyRectCount = -1;           // -1: redraw and present the whole frame
 
-            if (gameState == MENU) {
-                // Update animation time
-                menuAnimTime += 0.03f;
-                
-                // Draw background image
-                if (backgroundImage) {
-                    graphics.DrawImage(backgroundImage, 0, 0, clientWidth, clientHeight);
-                } else {
-                    // Fallback to animated gradient background
-                    float colorShift = sin(menuAnimTime * 0.5f) * 20;
-                    LinearGradientBrush gradientBrush(
-                        Point(0, 0),
-                        Point(0, clientHeight),
-                        Color(255, (int)(15 + colorShift), (int)(10 + colorShift), (int)(40 + colorShift)),
-                        Color(255, (int)(40 + colorShift), (int)(10 + colorShift), (int)(60 + colorShift))
-                    );
-                    graphics.FillRectangle(&gradientBrush, 0, 0, clientWidth, clientHeight);
-                }
+// Text objects shared by every frame, created once after GDI+ starts
+// instead of on every WM_PAINT
+struct GameFonts {
+    FontFamily* family;
+    StringFormat* centered;
+    Font* score;        // 48px bold, PLAYING and PAUSED
+    Font* pauseTitle;   // 80px bold
+    Font* countdown;    // 180px bold
+    Font* resuming;     // 28px italic
+    Font* pauseOption;  // 40px bold
+    Font* pauseHint;    // 20px regular
+    Font* pauseTip;     // 16px italic
+};
+GameFonts gameFonts = {};
 
-                // Draw animated background particles
-                SolidBrush particleBrush(Color(60, 255, 255, 255));
-                for (int i = 0; i < 30; i++) {
-                    float angle = menuAnimTime * 0.3f + (i * 3.14159f * 2.0f / 30.0f);
-                    float radius = 200 + sin(menuAnimTime * 0.5f + i) * 50;
-                    float x = clientWidth / 2 + cos(angle) * radius;
-                    float y = clientHeight / 2 + sin(angle) * radius;
-                    int size = 2 + (int)(sin(menuAnimTime + i) * 2);
-                    graphics.FillEllipse(&particleBrush, (int)x - size, (int)y - size, size * 2, size * 2);
-                }
+void CreateGameFonts() {
+    gameFonts.family = new FontFamily(L"Arial");
+    gameFonts.centered = new StringFormat();
+    gameFonts.centered->SetAlignment(StringAlignmentCenter);
+    gameFonts.centered->SetLineAlignment(StringAlignmentCenter);
+    gameFonts.score = new Font(gameFonts.family, 48, FontStyleBold, UnitPixel);
+    gameFonts.pauseTitle = new Font(gameFonts.family, 80, FontStyleBold, UnitPixel);
+    gameFonts.countdown = new Font(gameFonts.family, 180, FontStyleBold, UnitPixel);
+    gameFonts.resuming = new Font(gameFonts.family, 28, FontStyleItalic, UnitPixel);
+    gameFonts.pauseOption = new Font(gameFonts.family, 40, FontStyleBold, UnitPixel);
+    gameFonts.pauseHint = new Font(gameFonts.family, 20, FontStyleRegular, UnitPixel);
+    gameFonts.pauseTip = new Font(gameFonts.family, 16, FontStyleItalic, UnitPixel);
+}
 
-                // Draw decorative corner elements
-                Pen decorPen(Color(200, 100, 200, 255), 4);
-                int cornerSize = 60;
-                int cornerMargin = 40;
-                
-                // Animated corner brackets with glow
-                for (int offset = 0; offset < 3; offset++) {
-                    int alpha = 100 - offset * 30;
-                    Pen glowPen(Color(alpha, 100, 200, 255), 4 - offset);
-                    
-                    // Top-left
-                    graphics.DrawLine(&glowPen, cornerMargin - offset, cornerMargin - offset, 
-                                     cornerMargin + cornerSize + offset, cornerMargin - offset);
-                    graphics.DrawLine(&glowPen, cornerMargin - offset, cornerMargin - offset, 
-                                     cornerMargin - offset, cornerMargin + cornerSize + offset);
-                    
-                    // Top-right
-                    graphics.DrawLine(&glowPen, clientWidth - cornerMargin + offset, cornerMargin - offset, 
-                                     clientWidth - cornerMargin - cornerSize - offset, cornerMargin - offset);
-                    graphics.DrawLine(&glowPen, clientWidth - cornerMargin + offset, cornerMargin - offset, 
-                                     clientWidth - cornerMargin + offset, cornerMargin + cornerSize + offset);
-                    
-                    // Bottom-left
-                    graphics.DrawLine(&glowPen, cornerMargin - offset, clientHeight - cornerMargin + offset, 
-                                     cornerMargin + cornerSize + offset, clientHeight - cornerMargin + offset);
-                    graphics.DrawLine(&glowPen, cornerMargin - offset, clientHeight - cornerMargin + offset, 
-                                     cornerMargin - offset, clientHeight - cornerMargin - cornerSize - offset);
-                    
-                    // Bottom-right
-                    graphics.DrawLine(&glowPen, clientWidth - cornerMargin + offset, clientHeight - cornerMargin + offset, 
-                                     clientWidth - cornerMargin - cornerSize - offset, clientHeight - cornerMargin + offset);
-                    graphics.DrawLine(&glowPen, clientWidth - cornerMargin + offset, clientHeight - cornerMargin + offset, 
-                                     clientWidth - cornerMargin + offset, clientHeight - cornerMargin - cornerSize - offset);
-                }
+void DeleteGameFonts() {
+    delete gameFonts.pauseTip;
+    delete gameFonts.pauseHint;
+    delete gameFonts.pauseOption;
+    delete gameFonts.resuming;
+    delete gameFonts.countdown;
+    delete gameFonts.pauseTitle;
+    delete gameFonts.score;
+    delete gameFonts.centered;
+    delete gameFonts.family;
+    gameFonts = GameFonts();
+}
 
-                // Draw game title with glow effect
-                Font titleFont(&fontFamily, 96, FontStyleBold, UnitPixel);
+// Brushes and pens for PLAYING and PAUSED frames. Constructing GDI+
+// objects allocates on GDI+'s own heap, which the operator new counter
+// below never sees, so these are made once after GDI+ starts and recoloured
+// for each use instead. The pause screen's gradients depend on where the
+// frame is, so they are made again when it moves (after a resize).
+struct GameBrushes {
+    SolidBrush* fill;                  // recoloured for each use
+    Pen* line;                         // recoloured and resized for each use
+    LinearGradientBrush* pauseTitle;
+    LinearGradientBrush* countdown;
+    int pauseFrameX;                   // where the gradients were made for
+    int pauseFrameY;
+};
+GameBrushes gameBrushes = {};
 
-                // Title glow layers
-                for (int i = 3; i > 0; i--) {
-                    int alpha = 60 - i * 15;
-                    SolidBrush glowBrush(Color(alpha, 100, 200, 255));
-                    RectF glowRect(0, clientHeight / 2 - 150 - i * 2, clientWidth, 120);
-                    graphics.DrawString(L"PONG", -1, &titleFont, glowRect, &stringFormat, &glowBrush);
-                }
+void CreateGameBrushes() {
+    gameBrushes.fill = new SolidBrush(Color(255, 255, 255, 255));
+    gameBrushes.line = new Pen(Color(255, 255, 255, 255), 1);
+}
 
-                // Main title with gradient
-                RectF titleRect(0, clientHeight / 2 - 150, clientWidth, 120);
-                LinearGradientBrush titleGradient(
-                    Point(clientWidth / 2, (int)(clientHeight / 2 - 150)),
-                    Point(clientWidth / 2, (int)(clientHeight / 2 - 30)),
-                    Color(255, 255, 255, 255),
-                    Color(255, 100, 200, 255)
-                );
-                graphics.DrawString(L"PONG", -1, &titleFont, titleRect, &stringFormat, &titleGradient);
-
-                // Draw subtitle with pulse effect
-                Font subtitleFont(&fontFamily, 28, FontStyleRegular, UnitPixel);
-                int subtitleAlpha = (int)(180 + sin(menuAnimTime * 2.0f) * 75);
-                SolidBrush subtitleBrush(Color(subtitleAlpha, 200, 200, 200));
-                RectF subtitleRect(0, clientHeight / 2 - 20, clientWidth, 50);
-                graphics.DrawString(L"Classic Arcade Experience", -1, &subtitleFont, subtitleRect, &stringFormat, &subtitleBrush);
-
-                // Draw animated "Press Any Key" text with bounce effect
-                Font promptFont(&fontFamily, 36, FontStyleBold, UnitPixel);
-                float bounce = sin(menuAnimTime * 3.0f) * 10;
-                int promptAlpha = (int)(200 + sin(menuAnimTime * 4.0f) * 55);
-                
-                // Glow effect for prompt
-                SolidBrush promptGlowBrush(Color(promptAlpha / 2, 255, 255, 100));
-                RectF promptGlowRect(0, clientHeight / 2 + 80 + bounce - 2, clientWidth, 60);
-                graphics.DrawString(L"Press Any Key to Start", -1, &promptFont, promptGlowRect, &stringFormat, &promptGlowBrush);
-                
-                // Main prompt text
-                SolidBrush promptBrush(Color(promptAlpha, 255, 255, 255));
-                RectF promptRect(0, clientHeight / 2 + 80 + bounce, clientWidth, 60);
-                graphics.DrawString(L"Press Any Key to Start", -1, &promptFont, promptRect, &stringFormat, &promptBrush);
-
-                // Draw decorative lines
-                Pen linePen(Color(150, 100, 200, 255), 2);
-                int lineY = clientHeight / 2 + 160;
-                for (int i = 0; i < 5; i++) {
-                    int lineWidth = 50 + i * 30;
-                    int lineX = clientWidth / 2 - lineWidth / 2;
-                    int alpha = 150 - i * 20;
-                    Pen currentLinePen(Color(alpha, 100, 200, 255), 2);
-                    graphics.DrawLine(&currentLinePen, lineX, lineY + i * 8, lineX + lineWidth, lineY + i * 8);
-                }
+void DeletePauseGradients() {
+    delete gameBrushes.pauseTitle;
+    delete gameBrushes.countdown;
+    gameBrushes.pauseTitle = nullptr;
+    gameBrushes.countdown = nullptr;
+}
 
-                // Draw version/credits at bottom
-                Font creditFont(&fontFamily, 16, FontStyleRegular, UnitPixel);
-                SolidBrush creditBrush(Color(120, 150, 150, 150));
-                RectF creditRect(0, clientHeight - 50, clientWidth, 30);
-                graphics.DrawString(L"© 2024 Classic Games Revival", -1, &creditFont, creditRect, &stringFormat, &creditBrush);
+void DeleteGameBrushes() {
+    DeletePauseGradients();
+    delete gameBrushes.line;
+    delete gameBrushes.fill;
+    gameBrushes = GameBrushes();
+}
 
-            } else if (gameState == DIFFICULTY_SELECT) {
-                // Draw background image for difficulty selection
-                if (backgroundImage) {
-                    graphics.DrawImage(backgroundImage, 0, 0, clientWidth, clientHeight);
-                } else {
-                    // Fallback to gradient background
-                    LinearGradientBrush gradientBrush(
-                        Point(0, 0),
-                        Point(0, clientHeight),
-                        Color(255, 10, 10, 30),
-                        Color(255, 30, 10, 50)
-                    );
-                    graphics.FillRectangle(&gradientBrush, 0, 0, clientWidth, clientHeight);
-                }
+// The pause title and countdown gradients for a frame at (frameX, frameY)
+void PreparePauseGradients(int frameX, int frameY, int frameWidth) {
+    if (gameBrushes.pauseTitle && gameBrushes.pauseFrameX == frameX && gameBrushes.pauseFrameY == frameY) {
+        return;
+    }
+    DeletePauseGradients();
+    gameBrushes.pauseTitle = new LinearGradientBrush(Point(frameX + frameWidth / 2, frameY + 40),
+                                                     Point(frameX + frameWidth / 2, frameY + 140),
+                                                     Color(255, 255, 150, 150), Color(255, 255, 100, 100));
+    gameBrushes.countdown = new LinearGradientBrush(Point(frameX + frameWidth / 2, frameY + 200),
+                                                    Point(frameX + frameWidth / 2, frameY + 400),
+                                                    Color(255, 100, 255, 255), Color(255, 100, 255, 100));
+    gameBrushes.pauseFrameX = frameX;
+    gameBrushes.pauseFrameY = frameY;
+}
 
-                // Update animation time
-                selectionAnimTime += 0.05f;
+// The shared solid brush, set to `color`
+SolidBrush* FillBrush(const Color& color) {
+    gameBrushes.fill->SetColor(color);
+    return gameBrushes.fill;
+}
 
-                // Draw decorative elements - animated corner brackets
-                Pen decorPen(Color(255, 100, 200, 255), 3);
-                int bracketSize = 40;
-                int margin = 30;
-                
-                // Top-left bracket
-                graphics.DrawLine(&decorPen, margin, margin, margin + bracketSize, margin);
-                graphics.DrawLine(&decorPen, margin, margin, margin, margin + bracketSize);
-                
-                // Top-right bracket
-                graphics.DrawLine(&decorPen, clientWidth - margin, margin, clientWidth - margin - bracketSize, margin);
-                graphics.DrawLine(&decorPen, clientWidth - margin, margin, clientWidth - margin, margin + bracketSize);
-                
-                // Bottom-left bracket
-                graphics.DrawLine(&decorPen, margin, clientHeight - margin, margin + bracketSize, clientHeight - margin);
-                graphics.DrawLine(&decorPen, margin, clientHeight - margin, margin, clientHeight - margin - bracketSize);
-                
-                // Bottom-right bracket
-                graphics.DrawLine(&decorPen, clientWidth - margin, clientHeight - margin, clientWidth - margin - bracketSize, clientHeight - margin);
-                graphics.DrawLine(&decorPen, clientWidth - margin, clientHeight - margin, clientWidth - margin, clientHeight - margin - bracketSize);
+// The shared pen, set to `color` and `width`
+Pen* LinePen(const Color& color, float width) {
+    gameBrushes.line->SetColor(color);
+    gameBrushes.line->SetWidth(width);
+    return gameBrushes.line;
+}
 
-                // Draw animated particles/dots around the screen
-                SolidBrush particleBrush(Color(100, 255, 255, 255));
-                for (int i = 0; i < 15; i++) {
-                    float angle = selectionAnimTime + (i * 3.14159f * 2.0f / 15.0f);
-                    float x = clientWidth / 2 + cos(angle) * 350;
-                    float y = clientHeight / 2 + sin(angle) * 250;
-                    graphics.FillEllipse(&particleBrush, (int)x - 3, (int)y - 3, 6, 6);
-                }
+// Bump allocator for data that only lives until the end of the current
+// frame. Reset after every WM_PAINT.
+const size_t FRAME_ARENA_SIZE = 64 * 1024;
+struct FrameArena {
+    alignas(16) unsigned char buffer[FRAME_ARENA_SIZE];
+    size_t used;
+    size_t highWater;
+};
+FrameArena frameArena = {};
 
-                // Draw difficulty selection menu with enhanced styling
-                Font titleFont(&fontFamily, 64, FontStyleBold, UnitPixel);
-                Font optionFont(&fontFamily, 44, FontStyleBold, UnitPixel);
-                Font descFont(&fontFamily, 18, FontStyleRegular, UnitPixel);
-                SolidBrush titleBrush(Color(255, 255, 255, 255)); // White text
+void* FrameAlloc(size_t bytes, size_t alignment) {
+    size_t start = (frameArena.used + alignment - 1) & ~(alignment - 1);
+    if (start + bytes > FRAME_ARENA_SIZE) {
+        return nullptr;
+    }
+    frameArena.used = start + bytes;
+    if (frameArena.used > frameArena.highWater) {
+        frameArena.highWater = frameArena.used;
+    }
+    return frameArena.buffer + start;
+}
 
-                // Draw glowing title with shadow
-                SolidBrush shadowBrush(Color(150, 0, 0, 0));
-                RectF titleShadowRect(3, 73, clientWidth, 80);
-                graphics.DrawString(L"SELECT DIFFICULTY", -1, &titleFont, titleShadowRect, &stringFormat, &shadowBrush);
-                
-                RectF titleRect(0, 70, clientWidth, 80);
-                LinearGradientBrush titleGradient(
-                    Point(clientWidth / 2, 70),
-                    Point(clientWidth / 2, 150),
-                    Color(255, 255, 200, 100),
-                    Color(255, 255, 255, 255)
-                );
-                graphics.DrawString(L"SELECT DIFFICULTY", -1, &titleFont, titleRect, &stringFormat, &titleGradient);
+void ResetFrameArena() {
+    frameArena.used = 0;
+}
 
-                // Draw decorative line under title
-                Pen linePen(Color(255, 100, 200, 255), 2);
-                graphics.DrawLine(&linePen, clientWidth / 2 - 200, 170, clientWidth / 2 + 200, 170);
+// Helper function to convert int to wstring. The text lives in the frame
+// arena, so it is only valid until the end of the current frame.
+const wchar_t* IntToWString(int value) {
+    wchar_t* text = (wchar_t*)FrameAlloc(12 * sizeof(wchar_t), alignof(wchar_t));
+    if (!text) {
+        return L"";
+    }
 
-                // Draw difficulty options with cards
-                int cardWidth = 280;
-                int cardHeight = 220;
-                int optionY = 280;
-                int totalWidth = cardWidth * 3 + 100; // 3 cards with 50px spacing
-                int startX = (clientWidth - totalWidth) / 2;
+    wchar_t digits[12];
+    int count = 0;
+    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+    do {
+        digits[count++] = (wchar_t)(L'0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
 
-                const wchar_t* difficultyNames[] = {L"EASY", L"MEDIUM", L"HARD"};
-                const wchar_t* difficultyDescs[] = {
-                    L"Relaxed pace\nPerfect for beginners",
-                    L"Balanced challenge\nFor experienced players",
-                    L"Lightning fast\nUltimate test of skill"
-                };
-                Color cardColors[] = {
-                    Color(255, 50, 200, 100),   // Cyan for Easy
-                    Color(255, 255, 200, 50),   // Yellow for Medium
-                    Color(255, 255, 50, 50)     // Red for Hard
-                };
+    int length = 0;
+    if (value < 0) {
+        text[length++] = L'-';
+    }
+    while (count > 0) {
+        text[length++] = digits[--count];
+    }
+    text[length] = L'\0';
+    return text;
+}
 
-                for (int i = 0; i < 3; i++) {
-                    int cardX = startX + i * (cardWidth + 50);
-                    
-                    // Calculate pulse effect for selected card
-                    float pulse = 0.0f;
-                    float scale = 1.0f;
-                    if (i == selectedDifficulty) {
-                        pulse = sin(selectionAnimTime * 5.0f) * 0.15f + 0.85f;
-                        scale = 1.05f + sin(selectionAnimTime * 3.0f) * 0.02f;
-                    } else {
-                        pulse = 0.5f;
-                        scale = 0.95f;
-                    }
+// Allocation counting hook: every global operator new bumps a per-thread
+// counter so a frame can check it did no heap allocation
+thread_local long long threadHeapAllocations = 0;
+long long frameAllocationViolations = 0;
+GameState lastPaintedState = MENU;
 
-                    // Draw card background with glow effect
-                    if (i == selectedDifficulty) {
-                        // Outer glow
-                        SolidBrush glowBrush(Color((int)(100 * pulse), cardColors[i].GetR(), cardColors[i].GetG(), cardColors[i].GetB()));
-                        graphics.FillRectangle(&glowBrush, 
-                            cardX - 10, 
-                            optionY - 10, 
-                            cardWidth + 20, 
-                            cardHeight + 20);
-                    }
+void* operator new(size_t size) {
+    threadHeapAllocations++;
+    void* block = malloc(size ? size : 1);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    return block;
+}
 
-                    // Card background
-                    SolidBrush cardBrush(Color((int)(150 * pulse), 20, 20, 40));
-                    graphics.FillRectangle(&cardBrush, cardX, optionY, cardWidth, cardHeight);
+void* operator new[](size_t size) {
+    return operator new(size);
+}
 
-                    // Card border
-                    Pen borderPen(Color((int)(255 * pulse), cardColors[i].GetR(), cardColors[i].GetG(), cardColors[i].GetB()), 
-                                  i == selectedDifficulty ? 4 : 2);
-                    graphics.DrawRectangle(&borderPen, cardX, optionY, cardWidth, cardHeight);
+void operator delete(void* block) noexcept {
+    free(block);
+}
 
-                    // Draw difficulty icon/symbol
-                    SolidBrush iconBrush(Color((int)(200 * pulse), cardColors[i].GetR(), cardColors[i].GetG(), cardColors[i].GetB()));
-                    int iconY = optionY + 30;
-                    
-                    if (i == 0) { // Easy - single bar
-                        graphics.FillRectangle(&iconBrush, cardX + cardWidth / 2 - 10, iconY, 20, 40);
-                    } else if (i == 1) { // Medium - two bars
-                        graphics.FillRectangle(&iconBrush, cardX + cardWidth / 2 - 25, iconY + 10, 20, 40);
-                        graphics.FillRectangle(&iconBrush, cardX + cardWidth / 2 + 5, iconY, 20, 50);
-                    } else { // Hard - three bars
-                        graphics.FillRectangle(&iconBrush, cardX + cardWidth / 2 - 35, iconY + 20, 20, 30);
-                        graphics.FillRectangle(&iconBrush, cardX + cardWidth / 2 - 10, iconY + 10, 20, 40);
-                        graphics.FillRectangle(&iconBrush, cardX + cardWidth / 2 + 15, iconY, 20, 50);
-                    }
+void operator delete[](void* block) noexcept {
+    free(block);
+}
 
-                    // Draw difficulty name
-                    Font cardTitleFont(&fontFamily, 36, FontStyleBold, UnitPixel);
-                    SolidBrush textBrush(Color((int)(255 * pulse), 255, 255, 255));
-                    RectF nameRect(cardX, optionY + 90, cardWidth, 50);
-                    graphics.DrawString(difficultyNames[i], -1, &cardTitleFont, nameRect, &stringFormat, &textBrush);
+void operator delete(void* block, size_t) noexcept {
+    free(block);
+}
 
-                    // Draw difficulty description
-                    SolidBrush descBrush(Color((int)(200 * pulse), 200, 200, 200));
-                    RectF descRect(cardX + 10, optionY + 145, cardWidth - 20, 60);
-                    graphics.DrawString(difficultyDescs[i], -1, &descFont, descRect, &stringFormat, &descBrush);
+void operator delete[](void* block, size_t) noexcept {
+    free(block);
+}
 
-                    // Draw selection arrow above selected card
-                    if (i == selectedDifficulty) {
-                        SolidBrush arrowBrush(Color(255, 255, 255, 100));
-                        Point arrowPoints[3];
-                        int arrowX = cardX + cardWidth / 2;
-                        int arrowY = optionY - 30;
-                        arrowPoints[0] = Point(arrowX, arrowY + (int)(sin(selectionAnimTime * 4.0f) * 5.0f));
-                        arrowPoints[1] = Point(arrowX - 15, arrowY - 20 + (int)(sin(selectionAnimTime * 4.0f) * 5.0f));
-                        arrowPoints[2] = Point(arrowX + 15, arrowY - 20 + (int)(sin(selectionAnimTime * 4.0f) * 5.0f));
-                        graphics.FillPolygon(&arrowBrush, arrowPoints, 3);
-                    }
-                }
+// Measure real time since the previous frame so animations run at the same
+// speed whatever rate frames are drawn at
+void UpdateFrameDelta() {
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    if (lastFrameCounter.QuadPart != 0) {
+        frameDeltaSeconds = (float)(now.QuadPart - lastFrameCounter.QuadPart) / frequency.QuadPart;
+        // Don't jump animations forward after being minimized or hidden
+        if (frameDeltaSeconds > 0.1f) frameDeltaSeconds = 0.1f;
+    }
+    lastFrameCounter = now;
+}
 
-                // Draw instructions at bottom with icon hints
-                Font instructionFont(&fontFamily, 22, FontStyleBold, UnitPixel);
-                SolidBrush instructionBrush(Color(255, 200, 200, 200));
+// How long the current state can go without a new frame
+DWORD FrameWakeIntervalMs() {
+    if (gameState == PAUSED && !isCountingDown) {
+        // Only the slow pulse and orbiting particles move
+        return AMBIENT_FRAME_INTERVAL_MS;
+    }
+    if (gameState == PLAYING) {
+        return playingFrameIntervalMs;
+    }
+    // Countdown running or menu animations active
+    return FRAME_INTERVAL_MS;
+}
+
+// How long the message loop may block before the next frame: forever while
+// minimized (restoring sends WM_SIZE), a slow poll while hidden, otherwise
+// until the current state's next frame is due. 0 means draw one now.
+DWORD NextFrameWaitMs(bool minimized, bool hidden, double sinceFrameMs, bool inputFrame) {
+    if (minimized) {
+        return INFINITE;
+    }
+    if (hidden) {
+        return HIDDEN_POLL_MS;
+    }
+    DWORD interval = FrameWakeIntervalMs();
+    if (inputFrame || sinceFrameMs >= interval) {
+        return 0;
+    }
+    // Round up: a wait cut short would wake early and spin
+    return (DWORD)ceil(interval - sinceFrameMs);
+}
+
+// Draw PLAYING frames at least as often as the monitor refreshes, so the
+// interpolated motion stays smooth on 120/144/240 Hz displays
+void UpdateDisplayRefresh(HWND hwnd) {
+    HDC hdc = GetDC(hwnd);
+    int refresh = GetDeviceCaps(hdc, VREFRESH);
+    ReleaseDC(hwnd, hdc);
+    if (refresh <= 1) {
+        refresh = 60;  // 0 and 1 mean "hardware default"
+    }
+    playingFrameIntervalMs = (DWORD)std::max(1, 1000 / refresh);
+}
+
+// ---------------------------------------------------------------------------
+// Effects quality
+//
+// Glow layers, anti-aliasing, particles and gradients are cosmetic but make
+// up much of a frame's cost. A governor keeps an average of how long recent
+// frames took to paint (not the time between frames, which includes
+// waiting) and steps between quality tiers: down once the average has
+// stayed near the 60 FPS budget for EFFECTS_STEP_DOWN_SECONDS, up only
+// after it has stayed well under it for longer. The gap between the two
+// lines and the hold times keep it from flipping between tiers. A step up
+// that has to be undone soon after doubles the wait before the next try, and
+// the next try from that tier also waits for the average to fall well below
+// what it was when the last one failed, so a machine that can't hold the
+// higher tier settles instead of retrying it every couple of minutes.
+//
+// --effects low|medium|high pins a tier; --effects-test runs the governor
+// against simulated slow machines.
+// ---------------------------------------------------------------------------
+
+enum EffectsTier {
+    EFFECTS_LOW,
+    EFFECTS_MEDIUM,
+    EFFECTS_HIGH,
+    EFFECTS_TIER_COUNT
+};
+
+struct EffectsTierSettings {
+    const char* name;
+    int glowPercent;      // of each glow effect's layers, rounded up
+    int particleStride;   // draw every n-th particle
+    bool antiAlias;
+    bool gradients;       // false: flat fills in their place
+};
+
+const EffectsTierSettings EFFECTS_TIERS[EFFECTS_TIER_COUNT] = {
+    {"low", 0, 4, false, false},
+    {"medium", 50, 2, true, true},
+    {"high", 100, 1, true, true},
+};
+
+const float EFFECTS_FRAME_BUDGET_MS = 1000.0f / 60.0f;
+const float EFFECTS_STEP_DOWN_FRACTION = 0.9f;   // average paint time above this part of the budget is too slow
+const float EFFECTS_STEP_UP_FRACTION = 0.6f;     // and below this leaves room for more
+const float EFFECTS_AVERAGE_WEIGHT = 0.1f;       // of each new frame in the average
+const float EFFECTS_STEP_DOWN_SECONDS = 0.5f;
+const float EFFECTS_STEP_UP_SECONDS = 3.0f;
+const float EFFECTS_MAX_STEP_UP_SECONDS = 48.0f;
+const float EFFECTS_FAILED_STEP_UP_SECONDS = 5.0f;  // stepping back down this soon doubles the wait
+const float EFFECTS_RETRY_FRACTION = 0.8f;          // of the average a failed step up was taken at
+
+struct EffectsGovernor {
+    int tier;
+    float averageMs;           // < 0: take the next frame as the average
+    float overSeconds;         // how long the average has been too slow
+    float underSeconds;        // or had room to spare
+    float sinceStepUp;
+    float stepUpSeconds;       // current wait before stepping up
+    float changeAverageMs;     // the average that caused the last change
+    int tierChanges;
+    float retryBelowMs[EFFECTS_TIER_COUNT];  // step up from a tier only below this; 0: no failed step up yet
+};
+
+EffectsGovernor effects = {EFFECTS_HIGH, -1.0f, 0.0f, 0.0f, EFFECTS_FAILED_STEP_UP_SECONDS, EFFECTS_STEP_UP_SECONDS, 0.0f, 0};
+bool effectsAdaptive = true;   // false when --effects pins the tier
+float slowRenderMs = 0.0f;     // --slow-render: extra paint time at the high tier
+
+void ResetEffectsGovernor(EffectsGovernor& g, int tier) {
+    g.tier = tier;
+    g.averageMs = -1.0f;
+    g.overSeconds = 0.0f;
+    g.underSeconds = 0.0f;
+    g.sinceStepUp = EFFECTS_FAILED_STEP_UP_SECONDS;
+    g.stepUpSeconds = EFFECTS_STEP_UP_SECONDS;
+    g.changeAverageMs = 0.0f;
+    g.tierChanges = 0;
+    for (float& retryBelowMs : g.retryBelowMs) {
+        retryBelowMs = 0.0f;
+    }
+}
+
+// Feed one frame's paint time. Returns true if the tier changed.
+bool UpdateEffectsGovernor(EffectsGovernor& g, float paintMs, float frameSeconds) {
+    // One long frame (a resize, the menu atlas being baked) shouldn't
+    // dominate the average
+    paintMs = std::min(paintMs, EFFECTS_FRAME_BUDGET_MS * 2.0f);
+    g.averageMs = g.averageMs < 0.0f ? paintMs : g.averageMs + (paintMs - g.averageMs) * EFFECTS_AVERAGE_WEIGHT;
+    g.sinceStepUp += frameSeconds;
+
+    if (g.averageMs > EFFECTS_FRAME_BUDGET_MS * EFFECTS_STEP_DOWN_FRACTION) {
+        g.overSeconds += frameSeconds;
+        g.underSeconds = 0.0f;
+    } else if (g.averageMs < EFFECTS_FRAME_BUDGET_MS * EFFECTS_STEP_UP_FRACTION) {
+        g.underSeconds += frameSeconds;
+        g.overSeconds = 0.0f;
+    } else {
+        g.overSeconds = 0.0f;
+        g.underSeconds = 0.0f;
+    }
+
+    int tier = g.tier;
+    if (g.overSeconds >= EFFECTS_STEP_DOWN_SECONDS && g.tier > EFFECTS_LOW) {
+        if (g.sinceStepUp < EFFECTS_FAILED_STEP_UP_SECONDS) {
+            g.stepUpSeconds = std::min(g.stepUpSeconds * 2.0f, EFFECTS_MAX_STEP_UP_SECONDS);
+            // changeAverageMs is still the lower tier's average from the step up
+            g.retryBelowMs[g.tier - 1] = g.changeAverageMs * EFFECTS_RETRY_FRACTION;
+        }
+        g.tier--;
+    } else if (g.underSeconds >= g.stepUpSeconds && g.tier < EFFECTS_HIGH &&
+               (g.retryBelowMs[g.tier] <= 0.0f || g.averageMs < g.retryBelowMs[g.tier])) {
+        g.tier++;
+        g.sinceStepUp = 0.0f;
+    }
+    if (g.tier == tier) {
+        return false;
+    }
+    // The average so far was measured at the old tier
+    g.changeAverageMs = g.averageMs;
+    g.averageMs = -1.0f;
+    g.overSeconds = 0.0f;
+    g.underSeconds = 0.0f;
+    g.tierChanges++;
+    return true;
+}
+
+const EffectsTierSettings& CurrentEffects() {
+    return EFFECTS_TIERS[effects.tier];
+}
+
+// How many of a glow effect's `fullLayers` layers to draw
+int EffectsGlowLayers(int fullLayers) {
+    return (fullLayers * CurrentEffects().glowPercent + 99) / 100;
+}
+
+// True if the window can't be seen at all: hidden, minimized, or cloaked
+// by the compositor (e.g. on another virtual desktop). The compositor keeps
+// a surface for every window, so one that is merely covered by others still
+// counts as visible; Windows offers no cheap way to tell it apart.
+bool IsWindowHidden(HWND hwnd) {
+    if (!IsWindowVisible(hwnd) || IsIconic(hwnd)) {
+        return true;
+    }
+    DWORD cloaked = 0;
+    if (FAILED(DwmGetWindowAttribute(hwnd, DWMWA_CLOAKED, &cloaked, sizeof(cloaked)))) {
+        return false;
+    }
+    return cloaked != 0;
+}
+
+void ReleaseBackBuffer() {
+    if (backBufferDC) {
+        delete backBufferGraphics;
+        backBufferGraphics = nullptr;
+        SelectObject(backBufferDC, backBufferOldBitmap);
+        DeleteObject(backBufferBitmap);
+        DeleteDC(backBufferDC);
+        backBufferDC = NULL;
+        backBufferBitmap = NULL;
+        backBufferOldBitmap = NULL;
+        backBufferPixels = nullptr;
+    }
+}
+
+// Create the back buffer on first use, or again after a resize
+HDC AcquireBackBuffer(HDC hdc, int width, int height) {
+    if (backBufferDC && width == backBufferWidth && height == backBufferHeight) {
+        return backBufferDC;
+    }
+    ReleaseBackBuffer();
+    backBufferDC = CreateCompatibleDC(hdc);
+    // A DIB section so the tile rasterizer can write pixels directly
+    BITMAPINFO info = {};
+    info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    info.bmiHeader.biWidth = width;
+    info.bmiHeader.biHeight = -height;
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+    void* bits = nullptr;
+    backBufferBitmap = CreateDIBSection(hdc, &info, DIB_RGB_COLORS, &bits, NULL, 0);
+    backBufferPixels = (uint32_t*)bits;
+    backBufferOldBitmap = (HBITMAP)SelectObject(backBufferDC, backBufferBitmap);
+    backBufferGraphics = new Graphics(backBufferDC);
+    backBufferWidth = width;
+    backBufferHeight = height;
+    playfieldValid = false;
+    return backBufferDC;
+}
+
+// The frozen game under the pause overlay never changes while paused, so
+// it is captured once, on the first paused frame: the game as the last
+// gameplay frame showed it, redrawn then so the back buffer can't hold
+// another screen or size, dimmed, with the static parts of the overlay
+// already on top. Paused frames start from a copy of it. Released when play
+// resumes or the game exits to the menu.
+struct PauseBackdrop {
+    std::vector<uint32_t> pixels;
+    int width;
+    int height;
+};
+
+PauseBackdrop pauseBackdrop = {};
+
+bool PauseBackdropMatches(int width, int height) {
+    return !pauseBackdrop.pixels.empty() && pauseBackdrop.width == width && pauseBackdrop.height == height;
+}
+
+void ReleasePauseBackdrop() {
+    std::vector<uint32_t>().swap(pauseBackdrop.pixels);
+}
+
+// Screen bounds of everything that can move in PLAYING, padded to cover
+// anti-aliased edges
+PlayfieldBounds MeasurePlayfield(const MatchState& m, int clientWidth) {
+    PlayfieldBounds bounds;
+    int leftTop = (int)m.leftPaddleY;
+    int rightTop = (int)m.rightPaddleY;
+    SetRect(&bounds.leftPaddle, 15 - 1, leftTop - 1, 15 + PADDLE_WIDTH + 1, leftTop + PADDLE_HEIGHT + 1);
+    SetRect(&bounds.rightPaddle, clientWidth - 15 - PADDLE_WIDTH - 1, rightTop - 1,
+            clientWidth - 15 + 1, rightTop + PADDLE_HEIGHT + 1);
+
+    int glowLeft = (int)(m.ballX - BALL_RADIUS - 2);
+    int glowTop = (int)(m.ballY - BALL_RADIUS - 2);
+    int glowSize = (BALL_RADIUS + 2) * 2;
+    SetRect(&bounds.ball, glowLeft - 2, glowTop - 2, glowLeft + glowSize + 2, glowTop + glowSize + 2);
+
+    bounds.leftScore = m.leftScore;
+    bounds.rightScore = m.rightScore;
+    return bounds;
+}
+
+RECT ScoreArea(bool rightSide, int clientWidth) {
+    RECT area;
+    if (rightSide) {
+        SetRect(&area, clientWidth / 2 + 50, 30, clientWidth, 110);
+    } else {
+        SetRect(&area, 0, 30, clientWidth / 2 - 50, 110);
+    }
+    return area;
+}
+
+// Queue an area for redraw, merging it with any queued area it overlaps.
+// Falls back to a full frame once the list is full.
+void AddDirtyRect(const RECT& area, const RECT& clientArea) {
+    if (dirtyRectCount < 0) {
+        return;
+    }
+    RECT merged;
+    if (!IntersectRect(&merged, &area, &clientArea)) {
+        return;
+    }
+
+    // Merging can make the result overlap rects that were separate before,
+    // so keep absorbing until nothing else overlaps
+    bool absorbed = true;
+    while (absorbed) {
+        absorbed = false;
+        for (int i = 0; i < dirtyRectCount; i++) {
+            RECT overlap;
+            if (IntersectRect(&overlap, &merged, &dirtyRects[i])) {
+                UnionRect(&merged, &merged, &dirtyRects[i]);
+                dirtyRects[i] = dirtyRects[--dirtyRectCount];
+                absorbed = true;
+                break;
+            }
+        }
+    }
+
+    if (dirtyRectCount == MAX_DIRTY_RECTS) {
+        dirtyRectCount = -1;
+        return;
+    }
+    dirtyRects[dirtyRectCount++] = merged;
+}
+
+bool RectsTouch(const RECT& a, int left, int top, int right, int bottom) {
+    return a.left < right && left < a.right && a.top < bottom && top < a.bottom;
+}
+
+// What a ball touched during one step
+struct BallContact {
+    bool wall;
+    int paddleSide;  // -1: none, 0: left paddle, 1: right paddle
+    float hitPos;    // where it hit the paddle, 0 (top) .. 1 (bottom)
+};
+
+// What happened during one StepMatch call
+struct MatchEvents {
+    BallContact contact;
+    int goalSide;    // -1: none, 0: left player scored, 1: right player scored
+    int rallyHits;   // paddle hits in the rally that just ended on a goal
+};
+
+// Wall and paddle rules for one ball that just moved from (prevX, prevY)
+// to (x, y): bounce off the top and bottom, then test each paddle face
+// with continuous collision detection and reflect with the hit-position
+// spin. Shared by the match ball and the party-mode balls.
+BallContact CollideBallWithField(float prevX, float prevY, float& x, float& y, float& vx, float& vy, int& hitCount,
+                          float leftPaddleY, float rightPaddleY, float speedFactor, int fieldWidth, int fieldHeight) {
+    BallContact contact = { false, -1, 0.0f };
+
+    // Ball collision with top and bottom (screen boundaries)
+    if (y - BALL_RADIUS <= 0) {
+        vy = abs(vy);
+        y = BALL_RADIUS;
+        contact.wall = true;
+    } else if (y + BALL_RADIUS >= fieldHeight) {
+        vy = -abs(vy);
+        y = fieldHeight - BALL_RADIUS;
+        contact.wall = true;
+    }
+
+    // Continuous collision detection for left paddle
+    if (vx < 0) { // Ball moving left
+        float paddleX = 20;
+        float paddleTop = leftPaddleY;
+        float paddleBottom = leftPaddleY + PADDLE_HEIGHT;
+        
+        // Check if ball crosses paddle X position
+        if (prevX - BALL_RADIUS > paddleX && x - BALL_RADIUS <= paddleX) {
+            // Calculate Y position when ball reaches paddle X
+            float t = (paddleX - (prevX - BALL_RADIUS)) / (vx);
+            float intersectY = prevY + vy * t;
+            
+            // Check if intersection Y is within paddle bounds (with some tolerance)
+            if (intersectY >= paddleTop - BALL_RADIUS && intersectY <= paddleBottom + BALL_RADIUS) {
+                // Collision detected!
+                hitCount++;
                 
-                // Draw keyboard icons
-                SolidBrush keyBrush(Color(255, 60, 60, 80));
-                Pen keyPen(Color(255, 150, 150, 150), 2);
-                int keySize = 35;
-                int keyY = clientHeight - 100;
+                // Apply speed increase
+                if (hitCount <= MAX_HITS_FOR_SPEED_INCREASE) {
+                    vx = abs(vx) * speedFactor;
+                    vy *= speedFactor;
+                } else {
+                    vx = abs(vx);
+                }
                 
-                // Left arrow key
-                graphics.FillRectangle(&keyBrush, clientWidth / 2 - 150, keyY, keySize, keySize);
-                graphics.DrawRectangle(&keyPen, clientWidth / 2 - 150, keyY, keySize, keySize);
-                RectF leftArrowRect(clientWidth / 2 - 150, keyY, keySize, keySize);
-                Font arrowFont(&fontFamily, 20, FontStyleBold, UnitPixel);
-                graphics.DrawString(L"◄", -1, &arrowFont, leftArrowRect, &stringFormat, &instructionBrush);
+                // Position ball at paddle surface
+                x = paddleX + BALL_RADIUS;
+                y = intersectY;
                 
-                // Right arrow key
-                graphics.FillRectangle(&keyBrush, clientWidth / 2 + 115, keyY, keySize, keySize);
-                graphics.DrawRectangle(&keyPen, clientWidth / 2 + 115, keyY, keySize, keySize);
-                RectF rightArrowRect(clientWidth / 2 + 115, keyY, keySize, keySize);
-                graphics.DrawString(L"►", -1, &arrowFont, rightArrowRect, &stringFormat, &instructionBrush);
+                // Add trajectory variation based on hit position
+                float hitPos = (intersectY - paddleTop) / PADDLE_HEIGHT;
+                hitPos = (hitPos < 0) ? 0 : (hitPos > 1) ? 1 : hitPos;
+                vy += (hitPos - 0.5f) * 6.0f;
+
+                contact.paddleSide = 0;
+                contact.hitPos = hitPos;
+            }
+        }
+    }
+
+    // Continuous collision detection for right paddle
+    if (vx > 0) { // Ball moving right
+        float paddleX = fieldWidth - 20;
+        float paddleTop = rightPaddleY;
+        float paddleBottom = rightPaddleY + PADDLE_HEIGHT;
+        
+        // Check if ball crosses paddle X position
+        if (prevX + BALL_RADIUS < paddleX && x + BALL_RADIUS >= paddleX) {
+            // Calculate Y position when ball reaches paddle X
+            float t = (paddleX - (prevX + BALL_RADIUS)) / (vx);
+            float intersectY = prevY + vy * t;
+            
+            // Check if intersection Y is within paddle bounds (with some tolerance)
+            if (intersectY >= paddleTop - BALL_RADIUS && intersectY <= paddleBottom + BALL_RADIUS) {
+                // Collision detected!
+                hitCount++;
                 
-                // Enter key (wider)
-                graphics.FillRectangle(&keyBrush, clientWidth / 2 - 40, keyY, keySize * 2, keySize);
-                graphics.DrawRectangle(&keyPen, clientWidth / 2 - 40, keyY, keySize * 2, keySize);
-                RectF enterRect(clientWidth / 2 - 40, keyY, keySize * 2, keySize);
-                Font enterFont(&fontFamily, 14, FontStyleBold, UnitPixel);
-                graphics.DrawString(L"ENTER", -1, &enterFont, enterRect, &stringFormat, &instructionBrush);
+                // Apply speed increase
+                if (hitCount <= MAX_HITS_FOR_SPEED_INCREASE) {
+                    vx = -abs(vx) * speedFactor;
+                    vy *= speedFactor;
+                } else {
+                    vx = -abs(vx);
+                }
+                
+                // Position ball at paddle surface
+                x = paddleX - BALL_RADIUS;
+                y = intersectY;
+                
+                // Add trajectory variation based on hit position
+                float hitPos = (intersectY - paddleTop) / PADDLE_HEIGHT;
+                hitPos = (hitPos < 0) ? 0 : (hitPos > 1) ? 1 : hitPos;
+                vy += (hitPos - 0.5f) * 6.0f;
+
+                contact.paddleSide = 1;
+                contact.hitPos = hitPos;
+            }
+        }
+    }
+
+    return contact;
+}
+
+// Advance a match by one fixed step: move paddles, move the ball and
+// resolve wall/paddle collisions and goals
+MatchEvents StepMatch(MatchState& m, const MatchInput& input, int paddleSpeed, float speedFactor, int fieldWidth, int fieldHeight) {
+    MatchEvents events;
+    events.goalSide = -1;
+    events.rallyHits = 0;
+
+    // Update paddle positions
+    if (input.leftUp && m.leftPaddleY > 0) {
+        m.leftPaddleY -= paddleSpeed;
+        if (m.leftPaddleY < 0) m.leftPaddleY = 0;
+    }
+    if (input.leftDown && m.leftPaddleY < fieldHeight - PADDLE_HEIGHT) {
+        m.leftPaddleY += paddleSpeed;
+        if (m.leftPaddleY > fieldHeight - PADDLE_HEIGHT) m.leftPaddleY = fieldHeight - PADDLE_HEIGHT;
+    }
+    if (input.rightUp && m.rightPaddleY > 0) {
+        m.rightPaddleY -= paddleSpeed;
+        if (m.rightPaddleY < 0) m.rightPaddleY = 0;
+    }
+    if (input.rightDown && m.rightPaddleY < fieldHeight - PADDLE_HEIGHT) {
+        m.rightPaddleY += paddleSpeed;
+        if (m.rightPaddleY > fieldHeight - PADDLE_HEIGHT) m.rightPaddleY = fieldHeight - PADDLE_HEIGHT;
+    }
+
+    // Store previous position for continuous collision detection
+    float prevBallX = m.ballX;
+    float prevBallY = m.ballY;
+    
+    // Update ball position
+    m.ballX += m.ballVelocityX;
+    m.ballY += m.ballVelocityY;
+
+    events.contact = CollideBallWithField(prevBallX, prevBallY, m.ballX, m.ballY, m.ballVelocityX, m.ballVelocityY, m.hitCount,
+                                          m.leftPaddleY, m.rightPaddleY, speedFactor, fieldWidth, fieldHeight);
+
+    // Ball goes off the left side - right player scores
+    if (m.ballX + BALL_RADIUS < 0) {
+        m.rightScore++;
+        events.goalSide = 1;
+        events.rallyHits = m.hitCount;
+        // Reset ball to center
+        m.ballX = fieldWidth / 2.0f;
+        m.ballY = fieldHeight / 2.0f;
+        m.ballVelocityX = 5.0f; // Start towards right player
+        m.ballVelocityY = 3.0f;
+        m.hitCount = 0;
+    }
+
+    // Ball goes off the right side - left player scores
+    if (m.ballX - BALL_RADIUS > fieldWidth) {
+        m.leftScore++;
+        events.goalSide = 0;
+        events.rallyHits = m.hitCount;
+        // Reset ball to center
+        m.ballX = fieldWidth / 2.0f;
+        m.ballY = fieldHeight / 2.0f;
+        m.ballVelocityX = -5.0f; // Start towards left player
+        m.ballVelocityY = 3.0f;
+        m.hitCount = 0;
+    }
+
+    return events;
+}
+
+// Small deterministic random number generator (0..1)
+float NextRandom(unsigned& rng) {
+    rng = rng * 1664525u + 1013904223u;
+    return (rng >> 8) / 16777216.0f;
+}
+
+// ---------------------------------------------------------------------------
+// Party mode: many extra balls that also bounce off each other
+//
+// Balls live in a fixed pool of parallel arrays. Ball-ball contacts use a
+// uniform grid broadphase rebuilt every step with a counting sort, so each
+// ball is only tested against balls in its own and neighbouring cells. The
+// grid covers the field being played on; on fields too big for its fixed
+// cell storage the cells grow instead.
+// ---------------------------------------------------------------------------
+
+const int MAX_PARTY_BALLS = 5000;
+const int PARTY_BALL_COUNT = 150;               // balls spawned when a party game starts
+const int PARTY_CELL_SIZE = BALL_RADIUS * 2 + 4; // smallest cell; >= ball diameter, so contacts span at most one cell
+const int PARTY_GRID_MAX_CELLS = 16384;
+
+struct BallPool {
+    int count;
+    float x[MAX_PARTY_BALLS];
+    float y[MAX_PARTY_BALLS];
+    float velocityX[MAX_PARTY_BALLS];
+    float velocityY[MAX_PARTY_BALLS];
+    int hitCount[MAX_PARTY_BALLS];
+    float previousX[MAX_PARTY_BALLS];  // position one tick ago, for drawing between ticks
+    float previousY[MAX_PARTY_BALLS];
+    int goalCount;                     // goals scored in the last step, for telemetry
+    int goalSide[MAX_PARTY_BALLS];     // 0 left scored, 1 right scored
+    int goalHits[MAX_PARTY_BALLS];     // paddle hits of the ball that went out
+};
+
+struct BallGrid {
+    int fieldWidth;                          // field the layout below was sized for
+    int fieldHeight;
+    int cellSize;
+    int columns;
+    int rows;
+    int cellOf[MAX_PARTY_BALLS];             // cell index of each ball
+    int cellStart[PARTY_GRID_MAX_CELLS + 1]; // balls of cell c: order[cellStart[c] .. cellStart[c + 1])
+    int order[MAX_PARTY_BALLS];
+};
+
+bool partyMode = false;
+BallPool partyBalls = {};
+BallGrid partyGrid = {};
+unsigned partyRng = 0x2545F491u;
+
+// Put a ball back near the centre line heading towards `direction` (+1 right, -1 left)
+void ServePartyBall(BallPool& pool, int i, float direction, int fieldWidth, int fieldHeight) {
+    pool.x[i] = fieldWidth / 2.0f + (NextRandom(partyRng) - 0.5f) * fieldWidth * 0.2f;
+    pool.y[i] = BALL_RADIUS + NextRandom(partyRng) * (fieldHeight - BALL_RADIUS * 2);
+    pool.velocityX[i] = direction * (3.0f + NextRandom(partyRng) * 3.0f);
+    pool.velocityY[i] = (NextRandom(partyRng) - 0.5f) * 8.0f;
+    pool.hitCount[i] = 0;
+    // Appear at the serve position instead of sliding there
+    pool.previousX[i] = pool.x[i];
+    pool.previousY[i] = pool.y[i];
+}
+
+void SpawnPartyBalls(BallPool& pool, int count, int fieldWidth, int fieldHeight) {
+    if (count > MAX_PARTY_BALLS) count = MAX_PARTY_BALLS;
+    pool.count = count;
+    for (int i = 0; i < count; i++) {
+        ServePartyBall(pool, i, (i % 2 == 0) ? -1.0f : 1.0f, fieldWidth, fieldHeight);
+    }
+}
+
+// Lay the grid over a fieldWidth x fieldHeight field, using the smallest
+// cells that fit in its storage
+void SizeBallGrid(BallGrid& grid, int fieldWidth, int fieldHeight) {
+    if (grid.cellSize > 0 && grid.fieldWidth == fieldWidth && grid.fieldHeight == fieldHeight) {
+        return;
+    }
+    int width = fieldWidth > 1 ? fieldWidth : 1;
+    int height = fieldHeight > 1 ? fieldHeight : 1;
+    int cellSize = PARTY_CELL_SIZE;
+    while ((long long)((width + cellSize - 1) / cellSize) * ((height + cellSize - 1) / cellSize) > PARTY_GRID_MAX_CELLS) {
+        cellSize++;
+    }
+    grid.fieldWidth = fieldWidth;
+    grid.fieldHeight = fieldHeight;
+    grid.cellSize = cellSize;
+    grid.columns = (width + cellSize - 1) / cellSize;
+    grid.rows = (height + cellSize - 1) / cellSize;
+}
+
+// Bucket every ball into its grid cell (counting sort)
+void BuildBallGrid(const BallPool& pool, BallGrid& grid, int fieldWidth, int fieldHeight) {
+    SizeBallGrid(grid, fieldWidth, fieldHeight);
+    int cells = grid.columns * grid.rows;
+    for (int c = 0; c <= cells; c++) {
+        grid.cellStart[c] = 0;
+    }
+    for (int i = 0; i < pool.count; i++) {
+        int column = (int)(pool.x[i] / grid.cellSize);
+        int row = (int)(pool.y[i] / grid.cellSize);
+        column = column < 0 ? 0 : (column >= grid.columns ? grid.columns - 1 : column);
+        row = row < 0 ? 0 : (row >= grid.rows ? grid.rows - 1 : row);
+        grid.cellOf[i] = row * grid.columns + column;
+        grid.cellStart[grid.cellOf[i] + 1]++;
+    }
+    for (int c = 0; c < cells; c++) {
+        grid.cellStart[c + 1] += grid.cellStart[c];
+    }
+    // cellStart[c] doubles as the insert cursor, then gets shifted back
+    for (int i = 0; i < pool.count; i++) {
+        grid.order[grid.cellStart[grid.cellOf[i]]++] = i;
+    }
+    for (int c = cells; c > 0; c--) {
+        grid.cellStart[c] = grid.cellStart[c - 1];
+    }
+    grid.cellStart[0] = 0;
+}
+
+// Equal-mass elastic collision: separate the pair and swap the velocity
+// components along the contact normal
+void ResolveBallContact(BallPool& pool, int a, int b) {
+    float dx = pool.x[b] - pool.x[a];
+    float dy = pool.y[b] - pool.y[a];
+    float distanceSq = dx * dx + dy * dy;
+    const float minDistance = BALL_RADIUS * 2.0f;
+    if (distanceSq >= minDistance * minDistance) {
+        return;
+    }
+
+    // Balls on top of each other have no contact normal; push them apart
+    // horizontally so they cannot stay stuck together
+    float distance = 0.0f;
+    float nx = 1.0f;
+    float ny = 0.0f;
+    if (distanceSq > 0.0001f) {
+        distance = sqrtf(distanceSq);
+        nx = dx / distance;
+        ny = dy / distance;
+    }
+    float push = (minDistance - distance) * 0.5f;
+    pool.x[a] -= nx * push;
+    pool.y[a] -= ny * push;
+    pool.x[b] += nx * push;
+    pool.y[b] += ny * push;
+
+    float approach = (pool.velocityX[a] - pool.velocityX[b]) * nx + (pool.velocityY[a] - pool.velocityY[b]) * ny;
+    if (approach > 0) {
+        pool.velocityX[a] -= approach * nx;
+        pool.velocityY[a] -= approach * ny;
+        pool.velocityX[b] += approach * nx;
+        pool.velocityY[b] += approach * ny;
+    }
+}
+
+// Advance every party ball one step: move, apply the normal wall/paddle
+// rules, score goals, then resolve ball-ball contacts through the grid.
+// Goals count towards the match score and are listed in pool.goalSide/
+// goalHits until the next step.
+void StepPartyBalls(BallPool& pool, BallGrid& grid, MatchState& m, float speedFactor, int fieldWidth, int fieldHeight) {
+    pool.goalCount = 0;
+    for (int i = 0; i < pool.count; i++) {
+        float prevX = pool.x[i];
+        float prevY = pool.y[i];
+        pool.previousX[i] = prevX;
+        pool.previousY[i] = prevY;
+        pool.x[i] += pool.velocityX[i];
+        pool.y[i] += pool.velocityY[i];
+        CollideBallWithField(prevX, prevY, pool.x[i], pool.y[i], pool.velocityX[i], pool.velocityY[i], pool.hitCount[i],
+                             m.leftPaddleY, m.rightPaddleY, speedFactor, fieldWidth, fieldHeight);
+
+        if (pool.x[i] + BALL_RADIUS < 0) {
+            m.rightScore++;
+            pool.goalSide[pool.goalCount] = 1;
+            pool.goalHits[pool.goalCount++] = pool.hitCount[i];
+            ServePartyBall(pool, i, 1.0f, fieldWidth, fieldHeight);
+        } else if (pool.x[i] - BALL_RADIUS > fieldWidth) {
+            m.leftScore++;
+            pool.goalSide[pool.goalCount] = 0;
+            pool.goalHits[pool.goalCount++] = pool.hitCount[i];
+            ServePartyBall(pool, i, -1.0f, fieldWidth, fieldHeight);
+        }
+    }
+
+    BuildBallGrid(pool, grid, fieldWidth, fieldHeight);
+
+    // Each ball checks its own cell (later balls only) and the four
+    // neighbours ahead of it, so every pair is tested exactly once
+    static const int neighbourColumn[4] = {1, -1, 0, 1};
+    static const int neighbourRow[4] = {0, 1, 1, 1};
+    int cells = grid.columns * grid.rows;
+    for (int cell = 0; cell < cells; cell++) {
+        int column = cell % grid.columns;
+        int row = cell / grid.columns;
+        for (int p = grid.cellStart[cell]; p < grid.cellStart[cell + 1]; p++) {
+            int a = grid.order[p];
+            for (int q = p + 1; q < grid.cellStart[cell + 1]; q++) {
+                ResolveBallContact(pool, a, grid.order[q]);
+            }
+            for (int n = 0; n < 4; n++) {
+                int otherColumn = column + neighbourColumn[n];
+                int otherRow = row + neighbourRow[n];
+                if (otherColumn < 0 || otherColumn >= grid.columns || otherRow >= grid.rows) {
+                    continue;
+                }
+                int other = otherRow * grid.columns + otherColumn;
+                for (int q = grid.cellStart[other]; q < grid.cellStart[other + 1]; q++) {
+                    ResolveBallContact(pool, a, grid.order[q]);
+                }
+            }
+        }
+    }
+}
+
+// Where party ball i is drawn, between its last two ticks
+float PartyBallDrawnX(int i) {
+    return partyBalls.previousX[i] + (partyBalls.x[i] - partyBalls.previousX[i]) * renderAlpha;
+}
+
+float PartyBallDrawnY(int i) {
+    return partyBalls.previousY[i] + (partyBalls.y[i] - partyBalls.previousY[i]) * renderAlpha;
+}
+
+// The match `alpha` (0..1) of the way from the previous tick to the current
+// one. Positions are only ever interpolated, never extrapolated past the
+// current tick; a bounce already leaves the ball at the contact point, so
+// the straight line between ticks follows its path. A goal by the match
+// ball (`scored`) teleports it to the centre, so then the current tick is
+// drawn as is. Party ball goals change the score too but move nothing here.
+MatchState InterpolateMatch(const MatchState& previous, const MatchState& current, float alpha, bool scored) {
+    MatchState drawn = current;
+    if (scored) {
+        return drawn;
+    }
+    drawn.leftPaddleY = previous.leftPaddleY + (current.leftPaddleY - previous.leftPaddleY) * alpha;
+    drawn.rightPaddleY = previous.rightPaddleY + (current.rightPaddleY - previous.rightPaddleY) * alpha;
+    drawn.ballX = previous.ballX + (current.ballX - previous.ballX) * alpha;
+    drawn.ballY = previous.ballY + (current.ballY - previous.ballY) * alpha;
+    return drawn;
+}
+
+// Forget the previous tick, e.g. when a new game starts
+void SyncSimulation() {
+    previousMatch = match;
+    drawnMatch = match;
+    simulationAccumulator = 0.0f;
+    renderAlpha = 1.0f;
+    mainBallScored = false;
+    for (int i = 0; i < partyBalls.count; i++) {
+        partyBalls.previousX[i] = partyBalls.x[i];
+        partyBalls.previousY[i] = partyBalls.y[i];
+    }
+}
+
+// Draw every part of the PLAYING scene showing `m` that touches `area`,
+// clipped to it.
+// Full frames and dirty-rect frames both come through here, in the same
+// draw order, so a partial redraw gives exactly the pixels of a full one.
+void DrawPlayfieldArea(Graphics& graphics, const MatchState& m, const RECT& area, int clientWidth, int clientHeight,
+                       const Font* scoreFont, const StringFormat* stringFormat) {
+    graphics.SetClip(Rect(area.left, area.top, area.right - area.left, area.bottom - area.top));
+
+    // Black background
+    graphics.FillRectangle(FillBrush(Color(255, 0, 0, 0)), (int)area.left, (int)area.top,
+                           (int)(area.right - area.left), (int)(area.bottom - area.top));
+
+    // Center line (only the dashes inside the area)
+    int centerX = clientWidth / 2;
+    if (area.left < centerX + 2 && centerX - 2 < area.right) {
+        Pen* centerLinePen = LinePen(Color(100, 255, 255, 255), 2);
+        for (int y = 0; y < clientHeight; y += 20) {
+            if (y - 2 < area.bottom && area.top < y + 12) {
+                graphics.DrawLine(centerLinePen, centerX, y, centerX, y + 10);
+            }
+        }
+    }
+
+    // Paddles
+    SolidBrush* paddleBrush = FillBrush(Color(255, 255, 255, 255));
+    PlayfieldBounds bounds = MeasurePlayfield(m, clientWidth);
+    const RECT& leftPaddle = bounds.leftPaddle;
+    const RECT& rightPaddle = bounds.rightPaddle;
+    if (RectsTouch(area, leftPaddle.left, leftPaddle.top, leftPaddle.right, leftPaddle.bottom)) {
+        graphics.FillRectangle(paddleBrush, 15, (int)m.leftPaddleY, PADDLE_WIDTH, PADDLE_HEIGHT);
+    }
+    if (RectsTouch(area, rightPaddle.left, rightPaddle.top, rightPaddle.right, rightPaddle.bottom)) {
+        graphics.FillRectangle(paddleBrush, clientWidth - 15 - PADDLE_WIDTH, (int)m.rightPaddleY, PADDLE_WIDTH, PADDLE_HEIGHT);
+    }
+
+    // Ball with slight glow
+    const RECT& ball = bounds.ball;
+    if (RectsTouch(area, ball.left, ball.top, ball.right, ball.bottom)) {
+        graphics.FillEllipse(FillBrush(Color(100, 255, 255, 255)), (int)(m.ballX - BALL_RADIUS - 2), (int)(m.ballY - BALL_RADIUS - 2), (BALL_RADIUS + 2) * 2, (BALL_RADIUS + 2) * 2);
+
+        graphics.FillEllipse(FillBrush(Color(255, 255, 255, 255)), (int)(m.ballX - BALL_RADIUS), (int)(m.ballY - BALL_RADIUS), BALL_RADIUS * 2, BALL_RADIUS * 2);
+    }
+
+    // Party balls
+    if (partyBalls.count > 0) {
+        SolidBrush* partyBallBrush = FillBrush(Color(255, 255, 220, 100));
+        for (int i = 0; i < partyBalls.count; i++) {
+            int left = (int)(PartyBallDrawnX(i) - BALL_RADIUS);
+            int top = (int)(PartyBallDrawnY(i) - BALL_RADIUS);
+            if (RectsTouch(area, left - 1, top - 1, left + BALL_RADIUS * 2 + 1, top + BALL_RADIUS * 2 + 1)) {
+                graphics.FillEllipse(partyBallBrush, left, top, BALL_RADIUS * 2, BALL_RADIUS * 2);
+            }
+        }
+    }
+
+    // Scores
+    SolidBrush* scoreBrush = FillBrush(Color(255, 255, 255, 255));
+    RECT leftScoreArea = ScoreArea(false, clientWidth);
+    if (RectsTouch(area, leftScoreArea.left, leftScoreArea.top, leftScoreArea.right, leftScoreArea.bottom)) {
+        const wchar_t* leftScoreStr = IntToWString(m.leftScore);
+        RectF leftScoreRect(0, 30, clientWidth / 2 - 50, 80);
+        graphics.DrawString(leftScoreStr, -1, scoreFont, leftScoreRect, stringFormat, scoreBrush);
+    }
+    RECT rightScoreArea = ScoreArea(true, clientWidth);
+    if (RectsTouch(area, rightScoreArea.left, rightScoreArea.top, rightScoreArea.right, rightScoreArea.bottom)) {
+        const wchar_t* rightScoreStr = IntToWString(m.rightScore);
+        RectF rightScoreRect(clientWidth / 2 + 50, 30, clientWidth / 2 - 50, 80);
+        graphics.DrawString(rightScoreStr, -1, scoreFont, rightScoreRect, stringFormat, scoreBrush);
+    }
+
+    graphics.ResetClip();
+}
+
+// Work out which areas of a PLAYING frame showing `m` changed since the
+// last one: old and new bounds of the paddles and ball, plus a score box
+// when its score changed. Leaves a full frame (dirtyRectCount -1) when the
+// back buffer holds no earlier PLAYING frame.
+void CollectPlayfieldDirtyRects(const MatchState& m, int clientWidth, int clientHeight) {
+    PlayfieldBounds playfield = MeasurePlayfield(m, clientWidth);
+    RECT clientArea = {0, 0, clientWidth, clientHeight};
+    dirtyRectCount = -1;
+    if (playfieldValid) {
+        dirtyRectCount = 0;
+        AddDirtyRect(lastPlayfield.leftPaddle, clientArea);
+        AddDirtyRect(playfield.leftPaddle, clientArea);
+        AddDirtyRect(lastPlayfield.rightPaddle, clientArea);
+        AddDirtyRect(playfield.rightPaddle, clientArea);
+        AddDirtyRect(lastPlayfield.ball, clientArea);
+        AddDirtyRect(playfield.ball, clientArea);
+        if (playfield.leftScore != lastPlayfield.leftScore) {
+            AddDirtyRect(ScoreArea(false, clientWidth), clientArea);
+        }
+        if (playfield.rightScore != lastPlayfield.rightScore) {
+            AddDirtyRect(ScoreArea(true, clientWidth), clientArea);
+        }
+    }
+    lastPlayfield = playfield;
+    playfieldValid = true;
+}
+
+// Draw a PLAYING frame showing `m`: the whole client area, or only the
+// dirty rects when there are any
+void DrawPlayfield(Graphics& graphics, const MatchState& m, int clientWidth, int clientHeight,
+                   const Font* scoreFont, const StringFormat* stringFormat) {
+    if (dirtyRectCount < 0) {
+        RECT clientArea = {0, 0, clientWidth, clientHeight};
+        DrawPlayfieldArea(graphics, m, clientArea, clientWidth, clientHeight, scoreFont, stringFormat);
+        return;
+    }
+    for (int i = 0; i < dirtyRectCount; i++) {
+        DrawPlayfieldArea(graphics, m, dirtyRects[i], clientWidth, clientHeight, scoreFont, stringFormat);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Input-to-photon latency harness
+//
+// F8 during a game injects synthetic W/S key presses through the message
+// queue, timestamped when posted, and watches every present for the first
+// frame where the left paddle has moved. Each frame pacing mode is measured
+// in turn and the latency distributions are written to latency_report.txt.
+// --latency-test starts a game, runs the same measurement, prints the report
+// and exits with code 1 if it did not finish.
+//
+// Injected keys carry an lParam of 0, which the keyboard never sends (its
+// repeat count is at least 1). Any other key message during a run would move
+// the paddle under the measurement, so it aborts the run.
+// ---------------------------------------------------------------------------
+
+enum FramePacing {
+    PACING_ON_INPUT,       // input requests a frame straight away
+    PACING_FIXED_INTERVAL, // frames only on the fixed interval (old loop)
+    PACING_MODE_COUNT
+};
+const char* FRAME_PACING_NAMES[PACING_MODE_COUNT] = {"redraw-on-input", "fixed-interval"};
+FramePacing framePacing = PACING_ON_INPUT;
+
+const int LATENCY_SAMPLES_PER_PACING = 200;
+const int LATENCY_GAP_MIN_MS = 20;   // pause between release and the next press
+const int LATENCY_GAP_RANDOM_MS = 30;
+const int LATENCY_TIMEOUT_MS = 120000;  // whole run, all pacing modes
+const LPARAM LATENCY_INJECTED_LPARAM = 0;
+
+struct LatencyHarness {
+    bool running;
+    bool exitWhenDone;           // --latency-test: quit with the result
+    LONGLONG deadlineCounter;    // QPC when an unfinished run gives up
+    int pacing;                  // pacing mode being measured
+    int sampleCount;
+    float samplesMs[LATENCY_SAMPLES_PER_PACING];
+    int samplesFrames[LATENCY_SAMPLES_PER_PACING];
+
+    bool waiting;                // key posted, paddle move not presented yet
+    WPARAM heldKey;              // injected key still down (0 if none)
+    LONGLONG inputCounter;       // QPC when the key was posted
+    LONGLONG nextInjectCounter;  // QPC when the next key may be posted
+    float paddleY;               // left paddle position when the key was posted
+    int framesPresented;         // presents since the key was posted
+    unsigned rng;
+
+    char report[2048];
+    int reportLength;
+};
+LatencyHarness latencyHarness = {};
+
+LONGLONG QueryCounter() {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
+double CounterToMs(LONGLONG ticks) {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return ticks * 1000.0 / frequency.QuadPart;
+}
+
+LONGLONG MsToCounter(int ms) {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return frequency.QuadPart * ms / 1000;
+}
+
+void StartLatencyHarness(HWND hwnd, bool exitWhenDone) {
+    latencyHarness = LatencyHarness();
+    latencyHarness.running = true;
+    latencyHarness.exitWhenDone = exitWhenDone;
+    latencyHarness.rng = 0x1234567u;
+    latencyHarness.nextInjectCounter = QueryCounter() + MsToCounter(LATENCY_GAP_MIN_MS);
+    latencyHarness.deadlineCounter = QueryCounter() + MsToCounter(LATENCY_TIMEOUT_MS);
+    framePacing = (FramePacing)latencyHarness.pacing;
+    SetWindowTextA(hwnd, "Ping Pong - measuring input latency...");
+}
+
+// Summarise the samples for the current pacing mode into the report
+void AppendLatencyResults() {
+    LatencyHarness& h = latencyHarness;
+    float sorted[LATENCY_SAMPLES_PER_PACING];
+    double frameTotal = 0.0;
+    for (int i = 0; i < h.sampleCount; i++) {
+        sorted[i] = h.samplesMs[i];
+        frameTotal += h.samplesFrames[i];
+    }
+    std::sort(sorted, sorted + h.sampleCount);
+
+    int n = h.sampleCount;
+    if (n == 0) {
+        return;
+    }
+    h.reportLength += snprintf(h.report + h.reportLength, sizeof(h.report) - h.reportLength,
+        "%-16s samples %3d  p50 %6.2f ms  p95 %6.2f ms  p99 %6.2f ms  max %6.2f ms  mean frames %.2f\n",
+        FRAME_PACING_NAMES[h.pacing], n, sorted[n / 2], sorted[n * 95 / 100], sorted[n * 99 / 100],
+        sorted[n - 1], frameTotal / n);
+}
+
+// End the run, releasing any key it still holds. `abortReason` is null when
+// every pacing mode got its samples.
+void FinishLatencyHarness(HWND hwnd, const char* abortReason) {
+    LatencyHarness& h = latencyHarness;
+    h.running = false;
+    framePacing = PACING_ON_INPUT;
+    SetWindowTextA(hwnd, WINDOW_TITLE);
+    if (h.heldKey) {
+        PostMessageA(hwnd, WM_KEYUP, h.heldKey, LATENCY_INJECTED_LPARAM);
+        h.heldKey = 0;
+    }
+    if (abortReason) {
+        h.reportLength += snprintf(h.report + h.reportLength, sizeof(h.report) - h.reportLength,
+                                   "aborted during %s: %s\n", FRAME_PACING_NAMES[h.pacing], abortReason);
+    }
+
+    const char* title = "Input-to-photon latency (key posted -> first present with the paddle moved)\n";
+    FILE* file = fopen("latency_report.txt", "w");
+    if (file) {
+        fputs(title, file);
+        fputs(h.report, file);
+        fclose(file);
+    }
+    OutputDebugStringA(h.report);
+    if (h.exitWhenDone) {
+        fputs(title, stdout);
+        fputs(h.report, stdout);
+        fflush(stdout);
+        PostQuitMessage(abortReason ? 1 : 0);
+    }
+}
+
+// Called from the message loop: post the next synthetic key press or
+// release when it is due. Returns how long the loop may sleep.
+DWORD PumpLatencyHarness(HWND hwnd) {
+    LatencyHarness& h = latencyHarness;
+    if (!h.running) {
+        return INFINITE;
+    }
+    if (gameState != PLAYING) {
+        // Paused or left the game: stop measuring
+        FinishLatencyHarness(hwnd, "left the game");
+        return INFINITE;
+    }
+    LONGLONG now = QueryCounter();
+    if (now > h.deadlineCounter) {
+        // E.g. the window was minimized and stopped presenting
+        FinishLatencyHarness(hwnd, "timed out");
+        return INFINITE;
+    }
+    if (h.waiting) {
+        return 1;
+    }
+
+    if (now < h.nextInjectCounter) {
+        return (DWORD)CounterToMs(h.nextInjectCounter - now) + 1;
+    }
+
+    // Press whichever key has room to move the paddle
+    h.heldKey = match.leftPaddleY > (WINDOW_HEIGHT - PADDLE_HEIGHT) / 2.0f ? 'W' : 'S';
+    h.waiting = true;
+    h.paddleY = drawnMatch.leftPaddleY;
+    h.framesPresented = 0;
+    h.inputCounter = now;
+    PostMessageA(hwnd, WM_KEYDOWN, h.heldKey, LATENCY_INJECTED_LPARAM);
+    return 1;
+}
+
+// Present hook: called right after each frame is blitted to the window
+void OnFramePresented(HWND hwnd) {
+    LatencyHarness& h = latencyHarness;
+    if (!h.running || !h.waiting) {
+        return;
+    }
+    h.framesPresented++;
+    if (drawnMatch.leftPaddleY == h.paddleY) {
+        return;
+    }
+
+    // The move is on screen: record the sample and release the key
+    h.samplesMs[h.sampleCount] = (float)CounterToMs(QueryCounter() - h.inputCounter);
+    h.samplesFrames[h.sampleCount] = h.framesPresented;
+    h.sampleCount++;
+    h.waiting = false;
+    PostMessageA(hwnd, WM_KEYUP, h.heldKey, LATENCY_INJECTED_LPARAM);
+    h.heldKey = 0;
+    h.nextInjectCounter = QueryCounter() +
+        MsToCounter(LATENCY_GAP_MIN_MS + (int)(NextRandom(h.rng) * LATENCY_GAP_RANDOM_MS));
+
+    if (h.sampleCount == LATENCY_SAMPLES_PER_PACING) {
+        AppendLatencyResults();
+        h.sampleCount = 0;
+        h.pacing++;
+        if (h.pacing == PACING_MODE_COUNT) {
+            FinishLatencyHarness(hwnd, nullptr);
+            return;
+        }
+        framePacing = (FramePacing)h.pacing;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// State hashing
+//
+// Every simulation tick hashes the match state and folds it into a chain
+// hash, so two runs agree on a tick's chain hash exactly when they agreed on
+// every tick up to it. The last STATE_HASH_HISTORY ticks stay in a ring;
+// --hash-log <file> also appends them to a file in blocks:
+//
+//   header: "PONGHSH1" | uint32 version | uint32 record size
+//   record: StateHashRecord
+//
+// --desync-compare <a> <b> bisects two logs on the chain hash to find the
+// first tick (and the fields) where they diverge.
+// ---------------------------------------------------------------------------
+
+struct StateHashRecord {
+    uint32_t tick;
+    MatchState state;
+    uint64_t hash;   // this tick's state
+    uint64_t chain;  // this and every earlier tick
+};
+
+const uint32_t STATE_HASH_HISTORY = 4096;  // power of two
+const uint32_t STATE_HASH_LOG_BLOCK = 256; // records per file write, divides the history
+const char STATE_HASH_MAGIC[8] = {'P', 'O', 'N', 'G', 'H', 'S', 'H', '1'};
+const uint32_t STATE_HASH_VERSION = 1;
+
+struct StateHashHistory {
+    uint32_t ticks;  // ticks hashed so far
+    uint64_t chain;
+    StateHashRecord records[STATE_HASH_HISTORY];
+};
+
+StateHashHistory stateHashes = {};
+FILE* stateHashFile = nullptr;
+
+// Names for reporting which part of the state diverged
+struct StateField {
+    const char* name;
+    size_t offset;
+    bool isFloat;
+};
+
+const StateField STATE_FIELDS[] = {
+    {"leftPaddleY", offsetof(MatchState, leftPaddleY), true},
+    {"rightPaddleY", offsetof(MatchState, rightPaddleY), true},
+    {"ballX", offsetof(MatchState, ballX), true},
+    {"ballY", offsetof(MatchState, ballY), true},
+    {"ballVelocityX", offsetof(MatchState, ballVelocityX), true},
+    {"ballVelocityY", offsetof(MatchState, ballVelocityY), true},
+    {"hitCount", offsetof(MatchState, hitCount), false},
+    {"leftScore", offsetof(MatchState, leftScore), false},
+    {"rightScore", offsetof(MatchState, rightScore), false},
+};
+const int STATE_FIELD_COUNT = sizeof(STATE_FIELDS) / sizeof(STATE_FIELDS[0]);
+
+// MatchState is nine 4-byte fields with no padding; hash them as words
+static_assert(sizeof(MatchState) == STATE_FIELD_COUNT * sizeof(uint32_t), "MatchState must stay padding free");
+
+// Float bits with -0.0 turned into 0.0, since the two compare equal and
+// behave the same. Adding 0.0 does that without a branch and leaves every
+// other value alone.
+inline uint32_t CanonicalFloatBits(float value) {
+    value += 0.0f;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// The state as the words that are hashed
+void CanonicalStateWords(const MatchState& m, uint32_t words[STATE_FIELD_COUNT]) {
+    memcpy(words, &m, sizeof(MatchState));
+    for (int i = 0; i < STATE_FIELD_COUNT; i++) {
+        if (STATE_FIELDS[i].isFloat) {
+            float value;
+            memcpy(&value, &words[i], sizeof(value));
+            words[i] = CanonicalFloatBits(value);
+        }
+    }
+}
+
+inline uint64_t MixHashWord(uint64_t x) {
+    x ^= x >> 32;
+    x *= 0xD6E8FEB86659FD93ull;
+    x ^= x >> 32;
+    return x;
+}
+
+inline uint64_t RotateLeft(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+inline uint64_t FloatPair(float low, float high) {
+    return (uint64_t)CanonicalFloatBits(high) << 32 | CanonicalFloatBits(low);
+}
+
+// Non-cryptographic hash of the canonical state. The four word pairs are
+// mixed independently (no dependency between them, so they overlap in the
+// pipeline or vectorize) and then combined with different rotations so
+// swapping two fields changes the result.
+uint64_t HashMatchState(const MatchState& m) {
+    uint64_t h0 = MixHashWord(FloatPair(m.leftPaddleY, m.rightPaddleY) ^ 0x9E3779B97F4A7C15ull);
+    uint64_t h1 = MixHashWord(FloatPair(m.ballX, m.ballY) ^ 0xC2B2AE3D27D4EB4Full);
+    uint64_t h2 = MixHashWord(FloatPair(m.ballVelocityX, m.ballVelocityY) ^ 0x165667B19E3779F9ull);
+    uint64_t h3 = MixHashWord(((uint64_t)(uint32_t)m.leftScore << 32 | (uint32_t)m.hitCount) ^ 0x27D4EB2F165667C5ull);
+    uint64_t h = (h0 ^ RotateLeft(h1, 17)) + (RotateLeft(h2, 31) ^ RotateLeft(h3, 47));
+    return MixHashWord(h ^ ((uint64_t)(uint32_t)m.rightScore << 16) ^ sizeof(MatchState));
+}
+
+inline uint64_t ChainStateHash(uint64_t chain, uint64_t hash) {
+    return MixHashWord(chain * 0x9E3779B97F4A7C15ull + hash);
+}
+
+void FillStateHashRecord(StateHashRecord& record, uint32_t tick, const MatchState& m, uint64_t& chain) {
+    record.tick = tick;
+    record.state = m;
+    record.hash = HashMatchState(m);
+    chain = ChainStateHash(chain, record.hash);
+    record.chain = chain;
+}
+
+// Game thread, once per simulation tick. Only touches the file once per
+// STATE_HASH_LOG_BLOCK ticks.
+void RecordStateHash(const MatchState& m) {
+    StateHashHistory& h = stateHashes;
+    uint32_t slot = h.ticks & (STATE_HASH_HISTORY - 1);
+    FillStateHashRecord(h.records[slot], h.ticks, m, h.chain);
+    h.ticks++;
+    if (stateHashFile && h.ticks % STATE_HASH_LOG_BLOCK == 0) {
+        fwrite(&h.records[slot + 1 - STATE_HASH_LOG_BLOCK], sizeof(StateHashRecord), STATE_HASH_LOG_BLOCK,
+               stateHashFile);
+    }
+}
+
+bool StartStateHashLog(const char* path) {
+    stateHashFile = fopen(path, "wb");
+    if (!stateHashFile) {
+        return false;
+    }
+    // Unbuffered: block writes are already large, and stdio would
+    // otherwise allocate its buffer in the middle of a game frame
+    setvbuf(stateHashFile, NULL, _IONBF, 0);
+    uint32_t recordSize = sizeof(StateHashRecord);
+    fwrite(STATE_HASH_MAGIC, 1, sizeof(STATE_HASH_MAGIC), stateHashFile);
+    fwrite(&STATE_HASH_VERSION, sizeof(STATE_HASH_VERSION), 1, stateHashFile);
+    fwrite(&recordSize, sizeof(recordSize), 1, stateHashFile);
+    stateHashes.ticks = 0;
+    stateHashes.chain = 0;
+    return true;
+}
+
+void StopStateHashLog() {
+    if (!stateHashFile) {
+        return;
+    }
+    // The partly filled last block
+    uint32_t pending = stateHashes.ticks % STATE_HASH_LOG_BLOCK;
+    uint32_t first = (stateHashes.ticks - pending) & (STATE_HASH_HISTORY - 1);
+    fwrite(&stateHashes.records[first], sizeof(StateHashRecord), pending, stateHashFile);
+    fclose(stateHashFile);
+    stateHashFile = nullptr;
+}
+
+bool LoadStateHashLog(const char* path, std::vector<StateHashRecord>& records) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    char magic[8];
+    uint32_t version = 0;
+    uint32_t recordSize = 0;
+    bool valid = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                 memcmp(magic, STATE_HASH_MAGIC, sizeof(magic)) == 0 &&
+                 fread(&version, sizeof(version), 1, file) == 1 && version == STATE_HASH_VERSION &&
+                 fread(&recordSize, sizeof(recordSize), 1, file) == 1 && recordSize == sizeof(StateHashRecord);
+    StateHashRecord record;
+    while (valid && fread(&record, sizeof(record), 1, file) == 1) {
+        records.push_back(record);
+    }
+    fclose(file);
+    return valid;
+}
+
+// Index of the first record whose chain hash differs, or -1 if the shorter
+// stream matches the start of the longer one. Chains stay different once
+// they differ, so this is a binary search.
+int FindFirstDesync(const StateHashRecord* a, int countA, const StateHashRecord* b, int countB) {
+    int count = std::min(countA, countB);
+    if (count == 0 || a[count - 1].chain == b[count - 1].chain) {
+        return -1;
+    }
+    int low = 0;            // no record before `low` differs
+    int high = count - 1;   // record `high` differs
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (a[middle].chain == b[middle].chain) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return high;
+}
+
+// Bit mask of the STATE_FIELDS that differ
+int DifferingStateFields(const MatchState& a, const MatchState& b) {
+    uint32_t wordsA[STATE_FIELD_COUNT], wordsB[STATE_FIELD_COUNT];
+    CanonicalStateWords(a, wordsA);
+    CanonicalStateWords(b, wordsB);
+    int mask = 0;
+    for (int i = 0; i < STATE_FIELD_COUNT; i++) {
+        if (wordsA[i] != wordsB[i]) {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+}
+
+void PrintStateField(const MatchState& m, int field) {
+    const char* bytes = (const char*)&m + STATE_FIELDS[field].offset;
+    if (STATE_FIELDS[field].isFloat) {
+        float value;
+        uint32_t bits;
+        memcpy(&value, bytes, sizeof(value));
+        memcpy(&bits, bytes, sizeof(bits));
+        printf("%.9g (0x%08x)", value, bits);
+    } else {
+        int value;
+        memcpy(&value, bytes, sizeof(value));
+        printf("%d", value);
+    }
+}
+
+// Print where two hash streams part. Returns true if they agree.
+bool ReportDesync(const StateHashRecord* a, int countA, const StateHashRecord* b, int countB) {
+    int index = FindFirstDesync(a, countA, b, countB);
+    if (index < 0) {
+        printf("no desync in %d ticks", std::min(countA, countB));
+        if (countA != countB) {
+            printf(" (streams have %d and %d ticks)", countA, countB);
+        }
+        printf("\n");
+        return true;
+    }
+    printf("first desync at tick %u", a[index].tick);
+    if (index > 0) {
+        printf(" (tick %u matched)", a[index - 1].tick);
+    }
+    printf("\n");
+    int fields = DifferingStateFields(a[index].state, b[index].state);
+    if (fields == 0) {
+        printf("  states are equal but the hashes differ (different hash versions?)\n");
+    }
+    for (int i = 0; i < STATE_FIELD_COUNT; i++) {
+        if (fields & (1 << i)) {
+            printf("  %-14s ", STATE_FIELDS[i].name);
+            PrintStateField(a[index].state, i);
+            printf(" vs ");
+            PrintStateField(b[index].state, i);
+            printf("\n");
+        }
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// Telemetry
+//
+// The game thread records fixed-size events into a single-producer ring;
+// a background thread drains it every TELEMETRY_FLUSH_MS and appends the
+// events to a file as column blocks:
+//
+//   header: "PONGTLM1" | uint32 version
+//   block:  uint32 count | uint32 tick[count] | uint16 type[count] |
+//           int16 value[count] | float x[count] | float y[count]
+//
+// Recording is enabled with --telemetry <file>; --telemetry-report <file>
+// prints a summary of a recorded file.
+// ---------------------------------------------------------------------------
+
+enum TelemetryEventType {
+    TELEMETRY_FRAME,        // x: frame time in ms
+    TELEMETRY_PADDLE_HIT,   // value: hits this rally, x: hit position (0..1), y: side
+    TELEMETRY_SPEED_CAP,    // value: hits this rally (reached MAX_HITS_FOR_SPEED_INCREASE)
+    TELEMETRY_GOAL,         // value: scoring side, x: paddle hits in the rally
+    TELEMETRY_PAUSE,        // game paused
+    TELEMETRY_PAUSE_END,    // value: 0 resumed, 1 exited to menu; x: seconds paused
+    TELEMETRY_EFFECTS_TIER, // value: new effects tier, x: average paint ms that caused it
+    TELEMETRY_PARTY_GOAL,   // value: scoring side, x: paddle hits of the party ball
+    TELEMETRY_EVENT_TYPES
+};
+
+struct TelemetryEvent {
+    uint32_t tick;
+    uint16_t type;
+    int16_t value;
+    float x;
+    float y;
+};
+
+const uint32_t TELEMETRY_RING_SIZE = 1 << 14;  // power of two
+const uint32_t TELEMETRY_BLOCK_SIZE = 4096;
+const int TELEMETRY_FLUSH_MS = 50;
+const char TELEMETRY_MAGIC[8] = {'P', 'O', 'N', 'G', 'T', 'L', 'M', '1'};
+const uint32_t TELEMETRY_VERSION = 1;
+
+struct TelemetryRing {
+    alignas(64) std::atomic<uint32_t> head;  // next slot the game thread fills
+    alignas(64) std::atomic<uint32_t> tail;  // next slot the writer drains
+    alignas(64) uint32_t droppedEvents;      // game thread only
+    TelemetryEvent events[TELEMETRY_RING_SIZE];
+};
+
+TelemetryRing telemetryRing;
+bool telemetryEnabled = false;
+uint32_t telemetryTick = 0;
+LONGLONG pauseStartCounter = 0;
+std::atomic<bool> telemetryStopping(false);
+std::thread telemetryWriter;
+FILE* telemetryFile = nullptr;
+
+// Game thread only. Never blocks: drops the event if the writer is behind.
+inline void RecordTelemetry(TelemetryEventType type, int value, float x, float y) {
+    if (!telemetryEnabled) {
+        return;
+    }
+    uint32_t head = telemetryRing.head.load(std::memory_order_relaxed);
+    if (head - telemetryRing.tail.load(std::memory_order_acquire) == TELEMETRY_RING_SIZE) {
+        telemetryRing.droppedEvents++;
+        return;
+    }
+    TelemetryEvent& event = telemetryRing.events[head & (TELEMETRY_RING_SIZE - 1)];
+    event.tick = telemetryTick;
+    event.type = (uint16_t)type;
+    event.value = (int16_t)value;
+    event.x = x;
+    event.y = y;
+    telemetryRing.head.store(head + 1, std::memory_order_release);
+}
+
+// Column buffers for one block (writer thread only)
+struct TelemetryBlock {
+    uint32_t tick[TELEMETRY_BLOCK_SIZE];
+    uint16_t type[TELEMETRY_BLOCK_SIZE];
+    int16_t value[TELEMETRY_BLOCK_SIZE];
+    float x[TELEMETRY_BLOCK_SIZE];
+    float y[TELEMETRY_BLOCK_SIZE];
+};
+TelemetryBlock telemetryBlock;
+
+// Move up to one block of events out of the ring and append it to the file
+// (a null file just discards them). Returns the number of events drained.
+uint32_t FlushTelemetryBlock(FILE* file) {
+    uint32_t tail = telemetryRing.tail.load(std::memory_order_relaxed);
+    uint32_t count = telemetryRing.head.load(std::memory_order_acquire) - tail;
+    if (count > TELEMETRY_BLOCK_SIZE) count = TELEMETRY_BLOCK_SIZE;
+    if (count == 0) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const TelemetryEvent& event = telemetryRing.events[(tail + i) & (TELEMETRY_RING_SIZE - 1)];
+        telemetryBlock.tick[i] = event.tick;
+        telemetryBlock.type[i] = event.type;
+        telemetryBlock.value[i] = event.value;
+        telemetryBlock.x[i] = event.x;
+        telemetryBlock.y[i] = event.y;
+    }
+    telemetryRing.tail.store(tail + count, std::memory_order_release);
+    if (!file) {
+        return count;
+    }
+
+    fwrite(&count, sizeof(count), 1, file);
+    fwrite(telemetryBlock.tick, sizeof(uint32_t), count, file);
+    fwrite(telemetryBlock.type, sizeof(uint16_t), count, file);
+    fwrite(telemetryBlock.value, sizeof(int16_t), count, file);
+    fwrite(telemetryBlock.x, sizeof(float), count, file);
+    fwrite(telemetryBlock.y, sizeof(float), count, file);
+    return count;
+}
+
+void TelemetryWriterLoop(FILE* file) {
+    while (true) {
+        bool stopping = telemetryStopping.load();
+        while (FlushTelemetryBlock(file) == TELEMETRY_BLOCK_SIZE) {
+        }
+        if (stopping) {
+            // Everything recorded before the stop request is now written
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(TELEMETRY_FLUSH_MS));
+    }
+    if (file) {
+        fflush(file);
+    }
+}
+
+// Start recording to `path`, or with a null path into nothing (the writer
+// still drains the ring, for --telemetry-bench). Fails if the file cannot
+// be opened or a recording is already running.
+bool StartTelemetry(const char* path) {
+    if (telemetryEnabled) {
+        return false;
+    }
+    telemetryFile = nullptr;
+    if (path) {
+        telemetryFile = fopen(path, "wb");
+        if (!telemetryFile) {
+            return false;
+        }
+        fwrite(TELEMETRY_MAGIC, 1, sizeof(TELEMETRY_MAGIC), telemetryFile);
+        fwrite(&TELEMETRY_VERSION, sizeof(TELEMETRY_VERSION), 1, telemetryFile);
+    }
+
+    telemetryRing.head.store(0);
+    telemetryRing.tail.store(0);
+    telemetryRing.droppedEvents = 0;
+    telemetryStopping.store(false);
+    telemetryEnabled = true;
+    telemetryWriter = std::thread(TelemetryWriterLoop, telemetryFile);
+    return true;
+}
+
+void StopTelemetry() {
+    if (!telemetryEnabled) {
+        return;
+    }
+    telemetryEnabled = false;
+    telemetryStopping.store(true);
+    telemetryWriter.join();
+    if (telemetryFile) {
+        fclose(telemetryFile);
+        telemetryFile = nullptr;
+    }
+}
+
+float SecondsPaused() {
+    return (float)(CounterToMs(QueryCounter() - pauseStartCounter) / 1000.0);
+}
+
+// Record what a PLAYING step did
+void RecordMatchTelemetry(const MatchEvents& events, const MatchState& m) {
+    if (events.contact.paddleSide >= 0) {
+        RecordTelemetry(TELEMETRY_PADDLE_HIT, m.hitCount, events.contact.hitPos, (float)events.contact.paddleSide);
+        if (m.hitCount == MAX_HITS_FOR_SPEED_INCREASE) {
+            RecordTelemetry(TELEMETRY_SPEED_CAP, m.hitCount, 0.0f, 0.0f);
+        }
+    }
+    if (events.goalSide >= 0) {
+        RecordTelemetry(TELEMETRY_GOAL, events.goalSide, (float)events.rallyHits, 0.0f);
+    }
+}
+
+// Party balls score too; log their goals from the last step
+void RecordPartyTelemetry(const BallPool& pool) {
+    for (int g = 0; g < pool.goalCount; g++) {
+        RecordTelemetry(TELEMETRY_PARTY_GOAL, pool.goalSide[g], (float)pool.goalHits[g], 0.0f);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Audio
+//
+// The game thread never talks to the sound device. PostSound puts a play
+// command into a single-producer ring; a mixer thread drains the ring at the
+// moment the output needs another block, mixes up to AUDIO_MAX_VOICES voices
+// of pre-rendered PCM into AUDIO_BLOCK_FRAMES stereo frames and hands the
+// block to a sink. Mixing only once the output is ready keeps a sound posted
+// at any point within one block of being heard. Everything the mixer thread
+// touches is allocated before it starts and the game's side of it takes no
+// locks; its only wait is for the output. The waveOut sink is the exception
+// underneath: waveOutWrite goes through winmm, which takes its own internal
+// locks (and the driver may allocate), so the lock-free guarantee covers the
+// ring and the mix, not the device call.
+//
+// Sinks are tables of functions, like the pixel kernels: waveOut for the
+// game, a null sink that consumes blocks in real time and a WAV file writer
+// for headless runs. --audio-bench checks and times the mix loops and
+// measures the time from PostSound to the sound reaching the output.
+// ---------------------------------------------------------------------------
+
+const int AUDIO_SAMPLE_RATE = 48000;
+const int AUDIO_BLOCK_FRAMES = 256;        // 5.3 ms; a multiple of 4 for the SSE loops
+const int AUDIO_MAX_VOICES = 64;
+const uint32_t AUDIO_QUEUE_SIZE = 256;     // power of two
+const int AUDIO_WAVE_BUFFERS = 4;          // blocks queued on the device
+const uint32_t AUDIO_LATENCY_SAMPLES = 4096;
+const float AUDIO_MASTER_GAIN = 0.5f;
+
+enum SoundId {
+    SOUND_PADDLE_HIT,
+    SOUND_WALL_BOUNCE,
+    SOUND_GOAL,
+    SOUND_MENU_MOVE,
+    SOUND_MENU_SELECT,
+    SOUND_COUNTDOWN,
+    SOUND_COUNTDOWN_GO,
+    SOUND_COUNT
+};
+
+// The game ships no sound files, so every sound is a short tone rendered
+// once at startup: a frequency sweep under a quick attack and a decay
+struct SoundRecipe {
+    float startHz;
+    float endHz;
+    float seconds;
+    float square;   // 0: sine .. 1: square
+    float gain;
+};
+
+const SoundRecipe SOUND_RECIPES[SOUND_COUNT] = {
+    {520.0f, 520.0f, 0.07f, 0.6f, 0.8f},   // paddle hit
+    {300.0f, 280.0f, 0.05f, 0.6f, 0.5f},   // wall bounce
+    {660.0f, 220.0f, 0.45f, 0.3f, 0.8f},   // goal
+    {880.0f, 880.0f, 0.03f, 0.0f, 0.4f},   // menu move
+    {660.0f, 990.0f, 0.12f, 0.0f, 0.5f},   // menu select
+    {440.0f, 440.0f, 0.12f, 0.0f, 0.6f},   // countdown tick
+    {880.0f, 880.0f, 0.30f, 0.0f, 0.7f},   // countdown go
+};
+
+// Mono samples of every sound, each padded with silence to a multiple of 4
+struct SoundBank {
+    std::vector<float> samples;
+    int offset[SOUND_COUNT];
+    int length[SOUND_COUNT];
+};
+
+// One playing sound
+struct AudioVoice {
+    const float* samples;
+    int length;
+    int position;   // next sample, a multiple of 4
+    float gainLeft;
+    float gainRight;
+};
+
+struct AudioCommand {
+    LONGLONG postedAt;   // QueryCounter() when PostSound was called
+    int sound;
+    float gainLeft;
+    float gainRight;
+};
+
+struct AudioQueue {
+    alignas(64) std::atomic<uint32_t> head;  // next slot the game thread fills
+    alignas(64) std::atomic<uint32_t> tail;  // next slot the mixer drains
+    alignas(64) uint32_t droppedCommands;    // game thread only
+    AudioCommand commands[AUDIO_QUEUE_SIZE];
+};
+
+// Mixer thread state. Also driven directly by the offline WAV render.
+struct AudioMixer {
+    AudioVoice voices[AUDIO_MAX_VOICES];
+    int voiceCount;
+    alignas(16) float mix[AUDIO_BLOCK_FRAMES * 2];
+    alignas(16) int16_t output[AUDIO_BLOCK_FRAMES * 2];
+    LONGLONG blockTriggers[AUDIO_QUEUE_SIZE];   // postedAt of voices started this block
+    int blockTriggerCount;
+};
+
+// Written by the mixer thread, read after StopAudio
+struct AudioStats {
+    uint32_t blocks;
+    uint32_t voicesStarted;
+    uint32_t voicesStolen;
+    uint32_t underruns;
+    long long voiceBlocks;        // active voices summed over blocks
+    LONGLONG mixCounter;          // QueryCounter ticks spent draining and mixing
+    long long mixerAllocations;   // operator new calls on the mixer thread; HeapAlloc
+                                  // inside winmm or the driver is not counted
+    uint32_t latencyCount;
+    float latencyMs[AUDIO_LATENCY_SAMPLES];   // PostSound to output, first samples only
+};
+
+struct AudioKernels {
+    const char* name;
+    // out[2i] += samples[i] * gainLeft and out[2i + 1] += samples[i] *
+    // gainRight; count is a multiple of 4
+    void (*mixVoice)(float* out, const float* samples, int count, float gainLeft, float gainRight);
+    // Interleaved samples times `scale`, clamped and rounded to 16 bits
+    void (*convert)(int16_t* dst, const float* src, int count, float scale);
+};
+
+struct AudioSink {
+    const char* name;
+    bool (*open)(const char* path);
+    // Wait until the output can take another block
+    void (*wait)();
+    // Hand one block of interleaved stereo frames to the output. Returns
+    // the ms until the block is heard.
+    double (*write)(const int16_t* frames, int frameCount);
+    void (*close)();
+};
+
+SoundBank soundBank;
+AudioQueue audioQueue;
+AudioMixer audioMixer;
+AudioStats audioStats;
+bool audioEnabled = false;   // PostSound does nothing until StartAudio
+bool audioRequested = true;  // --no-audio turns sound off
+std::atomic<bool> audioStopping(false);
+std::thread audioMixerThread;
+const AudioSink* audioSink = nullptr;
+
+void RenderSoundBank(SoundBank& bank) {
+    int total = 0;
+    for (int s = 0; s < SOUND_COUNT; s++) {
+        bank.offset[s] = total;
+        bank.length[s] = ((int)(SOUND_RECIPES[s].seconds * AUDIO_SAMPLE_RATE) + 3) & ~3;
+        total += bank.length[s];
+    }
+    bank.samples.assign(total, 0.0f);
+
+    const float attack = 0.002f * AUDIO_SAMPLE_RATE;
+    for (int s = 0; s < SOUND_COUNT; s++) {
+        const SoundRecipe& recipe = SOUND_RECIPES[s];
+        int frames = (int)(recipe.seconds * AUDIO_SAMPLE_RATE);
+        float* out = &bank.samples[bank.offset[s]];
+        float phase = 0.0f;
+        for (int i = 0; i < frames; i++) {
+            float t = (float)i / frames;
+            phase += (recipe.startHz + (recipe.endHz - recipe.startHz) * t) / AUDIO_SAMPLE_RATE;
+            phase -= floorf(phase);
+            float sine = sinf(phase * 6.2831853f);
+            float square = phase < 0.5f ? 1.0f : -1.0f;
+            float envelope = std::min(1.0f, i / attack) * (1.0f - t) * (1.0f - t);
+            out[i] = (sine + (square - sine) * recipe.square) * envelope * recipe.gain;
+        }
+    }
+}
+
+void MixVoiceScalar(float* out, const float* samples, int count, float gainLeft, float gainRight) {
+    for (int i = 0; i < count; i++) {
+        out[2 * i] += samples[i] * gainLeft;
+        out[2 * i + 1] += samples[i] * gainRight;
+    }
+}
+
+void ConvertSamplesScalar(int16_t* dst, const float* src, int count, float scale) {
+    for (int i = 0; i < count; i++) {
+        float value = std::min(32767.0f, std::max(-32768.0f, src[i] * scale));
+        dst[i] = (int16_t)lrintf(value);
+    }
+}
+
+const AudioKernels SCALAR_AUDIO_KERNELS = {"scalar", MixVoiceScalar, ConvertSamplesScalar};
+
+#ifdef PIXEL_KERNELS_X86
+
+// Same multiplies and adds as the scalar loops, four samples at a time
+__attribute__((target("sse2")))
+void MixVoiceSse2(float* out, const float* samples, int count, float gainLeft, float gainRight) {
+    __m128 gains = _mm_setr_ps(gainLeft, gainRight, gainLeft, gainRight);
+    for (int i = 0; i < count; i += 4) {
+        __m128 mono = _mm_loadu_ps(samples + i);
+        __m128 first = _mm_mul_ps(_mm_unpacklo_ps(mono, mono), gains);
+        __m128 second = _mm_mul_ps(_mm_unpackhi_ps(mono, mono), gains);
+        _mm_storeu_ps(out + 2 * i, _mm_add_ps(_mm_loadu_ps(out + 2 * i), first));
+        _mm_storeu_ps(out + 2 * i + 4, _mm_add_ps(_mm_loadu_ps(out + 2 * i + 4), second));
+    }
+}
+
+// Clamped first, so the conversion never sees an out-of-range value
+__attribute__((target("sse2")))
+void ConvertSamplesSse2(int16_t* dst, const float* src, int count, float scale) {
+    __m128 factor = _mm_set1_ps(scale);
+    __m128 high = _mm_set1_ps(32767.0f);
+    __m128 low = _mm_set1_ps(-32768.0f);
+    for (int i = 0; i < count; i += 8) {
+        __m128 a = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(src + i), factor), high), low);
+        __m128 b = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), factor), high), low);
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128((__m128i*)(dst + i), packed);
+    }
+}
+
+const AudioKernels SSE2_AUDIO_KERNELS = {"sse2", MixVoiceSse2, ConvertSamplesSse2};
+
+#endif
+
+const AudioKernels* audioKernels = &SCALAR_AUDIO_KERNELS;
+
+// Kernel sets this CPU can run, narrowest first. Returns the count.
+int SupportedAudioKernels(const AudioKernels* sets[2]) {
+    int count = 0;
+    sets[count++] = &SCALAR_AUDIO_KERNELS;
+#ifdef PIXEL_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        sets[count++] = &SSE2_AUDIO_KERNELS;
+    }
+#endif
+    return count;
+}
+
+// Game thread. Never blocks: drops the sound if the mixer is behind.
+// `pan` goes from -1 (left) to 1 (right).
+void PostSound(SoundId sound, float volume, float pan) {
+    if (!audioEnabled) {
+        return;
+    }
+    uint32_t head = audioQueue.head.load(std::memory_order_relaxed);
+    if (head - audioQueue.tail.load(std::memory_order_acquire) == AUDIO_QUEUE_SIZE) {
+        audioQueue.droppedCommands++;
+        return;
+    }
+    // Equal-power pan
+    float angle = (std::min(1.0f, std::max(-1.0f, pan)) + 1.0f) * 0.78539816f;
+    AudioCommand& command = audioQueue.commands[head & (AUDIO_QUEUE_SIZE - 1)];
+    command.postedAt = QueryCounter();
+    command.sound = sound;
+    command.gainLeft = volume * cosf(angle);
+    command.gainRight = volume * sinf(angle);
+    audioQueue.head.store(head + 1, std::memory_order_release);
+}
+
+// Start a voice, replacing the one with the least left to play if all are busy
+void StartVoice(AudioMixer& mixer, const AudioCommand& command) {
+    int slot = mixer.voiceCount;
+    if (slot == AUDIO_MAX_VOICES) {
+        slot = 0;
+        for (int v = 1; v < mixer.voiceCount; v++) {
+            const AudioVoice& voice = mixer.voices[v];
+            const AudioVoice& best = mixer.voices[slot];
+            if (voice.length - voice.position < best.length - best.position) {
+                slot = v;
+            }
+        }
+        audioStats.voicesStolen++;
+    } else {
+        mixer.voiceCount++;
+    }
+    AudioVoice& voice = mixer.voices[slot];
+    voice.samples = &soundBank.samples[soundBank.offset[command.sound]];
+    voice.length = soundBank.length[command.sound];
+    voice.position = 0;
+    voice.gainLeft = command.gainLeft;
+    voice.gainRight = command.gainRight;
+    audioStats.voicesStarted++;
+}
+
+// Start a voice for every command posted so far
+void DrainAudioCommands(AudioMixer& mixer) {
+    uint32_t tail = audioQueue.tail.load(std::memory_order_relaxed);
+    uint32_t head = audioQueue.head.load(std::memory_order_acquire);
+    mixer.blockTriggerCount = 0;
+    for (; tail != head; tail++) {
+        const AudioCommand& command = audioQueue.commands[tail & (AUDIO_QUEUE_SIZE - 1)];
+        StartVoice(mixer, command);
+        mixer.blockTriggers[mixer.blockTriggerCount++] = command.postedAt;
+    }
+    audioQueue.tail.store(tail, std::memory_order_release);
+}
+
+// Mix one block of every voice into mixer.output and retire finished voices
+void MixAudioBlock(AudioMixer& mixer) {
+    memset(mixer.mix, 0, sizeof(mixer.mix));
+    audioStats.voiceBlocks += mixer.voiceCount;
+    for (int v = 0; v < mixer.voiceCount; v++) {
+        AudioVoice& voice = mixer.voices[v];
+        int count = std::min(AUDIO_BLOCK_FRAMES, voice.length - voice.position);
+        audioKernels->mixVoice(mixer.mix, voice.samples + voice.position, count, voice.gainLeft, voice.gainRight);
+        voice.position += count;
+        if (voice.position >= voice.length) {
+            mixer.voices[v--] = mixer.voices[--mixer.voiceCount];
+        }
+    }
+    audioKernels->convert(mixer.output, mixer.mix, AUDIO_BLOCK_FRAMES * 2, AUDIO_MASTER_GAIN * 32767.0f);
+    audioStats.blocks++;
+}
+
+// The block just handed over is heard `delayMs` from now
+void RecordAudioLatency(const AudioMixer& mixer, double delayMs) {
+    LONGLONG now = QueryCounter();
+    for (int i = 0; i < mixer.blockTriggerCount; i++) {
+        float latency = (float)(CounterToMs(now - mixer.blockTriggers[i]) + delayMs);
+        audioStats.latencyMs[audioStats.latencyCount++ % AUDIO_LATENCY_SAMPLES] = latency;
+    }
+}
+
+void AudioMixerLoop() {
+    long long allocationsBefore = threadHeapAllocations;
+    while (!audioStopping.load(std::memory_order_relaxed)) {
+        audioSink->wait();
+        LONGLONG start = QueryCounter();
+        DrainAudioCommands(audioMixer);
+        MixAudioBlock(audioMixer);
+        audioStats.mixCounter += QueryCounter() - start;
+        double delayMs = audioSink->write(audioMixer.output, AUDIO_BLOCK_FRAMES);
+        RecordAudioLatency(audioMixer, delayMs);
+    }
+    audioStats.mixerAllocations = threadHeapAllocations - allocationsBefore;
+}
+
+// Null sink: a device with no buffering of its own that asks for the next
+// block the moment the previous one has played. A block more than half a
+// block late counts as an underrun.
+std::chrono::steady_clock::time_point nullSinkDeadline;
+const std::chrono::nanoseconds AUDIO_BLOCK_DURATION(1000000000LL * AUDIO_BLOCK_FRAMES / AUDIO_SAMPLE_RATE);
+
+bool OpenNullSink(const char* path) {
+    nullSinkDeadline = std::chrono::steady_clock::now();
+    return true;
+}
+
+void WaitNullSink() {
+    std::this_thread::sleep_until(nullSinkDeadline);
+}
+
+double WriteNullSink(const int16_t* frames, int frameCount) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now > nullSinkDeadline + AUDIO_BLOCK_DURATION / 2) {
+        audioStats.underruns++;
+        nullSinkDeadline = now;
+    }
+    nullSinkDeadline += AUDIO_BLOCK_DURATION;
+    return 0.0;
+}
+
+void CloseNullSink() {
+}
+
+const AudioSink NULL_AUDIO_SINK = {"null", OpenNullSink, WaitNullSink, WriteNullSink, CloseNullSink};
+
+// WAV sink: 16-bit stereo PCM, sizes filled in on close
+FILE* wavSinkFile = nullptr;
+uint32_t wavSinkBytes = 0;
+char wavSinkBuffer[64 * 1024];
+
+void WriteWavHeader(FILE* file, uint32_t dataBytes) {
+    uint32_t riffBytes = 36 + dataBytes;
+    uint32_t formatBytes = 16;
+    uint16_t format = 1;
+    uint16_t channels = 2;
+    uint32_t rate = AUDIO_SAMPLE_RATE;
+    uint32_t byteRate = AUDIO_SAMPLE_RATE * 4;
+    uint16_t blockAlign = 4;
+    uint16_t bits = 16;
+    fwrite("RIFF", 1, 4, file);
+    fwrite(&riffBytes, 4, 1, file);
+    fwrite("WAVEfmt ", 1, 8, file);
+    fwrite(&formatBytes, 4, 1, file);
+    fwrite(&format, 2, 1, file);
+    fwrite(&channels, 2, 1, file);
+    fwrite(&rate, 4, 1, file);
+    fwrite(&byteRate, 4, 1, file);
+    fwrite(&blockAlign, 2, 1, file);
+    fwrite(&bits, 2, 1, file);
+    fwrite("data", 1, 4, file);
+    fwrite(&dataBytes, 4, 1, file);
+}
+
+bool OpenWavSink(const char* path) {
+    wavSinkFile = fopen(path, "wb");
+    if (!wavSinkFile) {
+        return false;
+    }
+    setvbuf(wavSinkFile, wavSinkBuffer, _IOFBF, sizeof(wavSinkBuffer));
+    wavSinkBytes = 0;
+    WriteWavHeader(wavSinkFile, 0);
+    return true;
+}
+
+void WaitWavSink() {
+}
+
+double WriteWavSink(const int16_t* frames, int frameCount) {
+    fwrite(frames, sizeof(int16_t) * 2, frameCount, wavSinkFile);
+    wavSinkBytes += frameCount * 4;
+    return 0.0;
+}
+
+void CloseWavSink() {
+    fseek(wavSinkFile, 0, SEEK_SET);
+    WriteWavHeader(wavSinkFile, wavSinkBytes);
+    fclose(wavSinkFile);
+    wavSinkFile = nullptr;
+}
+
+const AudioSink WAV_AUDIO_SINK = {"wav", OpenWavSink, WaitWavSink, WriteWavSink, CloseWavSink};
+
+// waveOut sink: AUDIO_WAVE_BUFFERS blocks cycle through the device, which
+// signals an event whenever it finishes one
+struct WaveOutDevice {
+    HWAVEOUT handle;
+    HANDLE bufferDone;
+    WAVEHDR headers[AUDIO_WAVE_BUFFERS];
+    int16_t buffers[AUDIO_WAVE_BUFFERS][AUDIO_BLOCK_FRAMES * 2];
+    int next;
+};
+WaveOutDevice waveOutDevice;
+
+bool OpenWaveOutSink(const char* path) {
+    WaveOutDevice& device = waveOutDevice;
+    WAVEFORMATEX format = {};
+    format.wFormatTag = WAVE_FORMAT_PCM;
+    format.nChannels = 2;
+    format.nSamplesPerSec = AUDIO_SAMPLE_RATE;
+    format.wBitsPerSample = 16;
+    format.nBlockAlign = 4;
+    format.nAvgBytesPerSec = AUDIO_SAMPLE_RATE * 4;
+    device.bufferDone = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (waveOutOpen(&device.handle, WAVE_MAPPER, &format, (DWORD_PTR)device.bufferDone, 0, CALLBACK_EVENT) !=
+        MMSYSERR_NOERROR) {
+        CloseHandle(device.bufferDone);
+        return false;
+    }
+    for (int i = 0; i < AUDIO_WAVE_BUFFERS; i++) {
+        WAVEHDR& header = device.headers[i];
+        memset(&header, 0, sizeof(header));
+        header.lpData = (LPSTR)device.buffers[i];
+        header.dwBufferLength = sizeof(device.buffers[i]);
+        waveOutPrepareHeader(device.handle, &header, sizeof(header));
+        header.dwFlags |= WHDR_DONE;   // free for the first write
+    }
+    device.next = 0;
+    return true;
+}
+
+void WaitWaveOutSink() {
+    WaveOutDevice& device = waveOutDevice;
+    while (!(device.headers[device.next].dwFlags & WHDR_DONE)) {
+        WaitForSingleObject(device.bufferDone, INFINITE);
+    }
+}
+
+double WriteWaveOutSink(const int16_t* frames, int frameCount) {
+    WaveOutDevice& device = waveOutDevice;
+    WAVEHDR& header = device.headers[device.next];
+    // Blocks still queued ahead of this one; none means the device ran dry
+    int queued = 0;
+    for (int i = 0; i < AUDIO_WAVE_BUFFERS; i++) {
+        if (i != device.next && !(device.headers[i].dwFlags & WHDR_DONE)) {
+            queued++;
+        }
+    }
+    if (queued == 0 && audioStats.blocks > AUDIO_WAVE_BUFFERS) {
+        audioStats.underruns++;
+    }
+    memcpy(header.lpData, frames, frameCount * 4);
+    // Takes winmm's internal locks; the only lock on the mixer thread
+    waveOutWrite(device.handle, &header, sizeof(header));
+    device.next = (device.next + 1) % AUDIO_WAVE_BUFFERS;
+    return queued * 1000.0 * AUDIO_BLOCK_FRAMES / AUDIO_SAMPLE_RATE;
+}
+
+void CloseWaveOutSink() {
+    WaveOutDevice& device = waveOutDevice;
+    waveOutReset(device.handle);
+    for (int i = 0; i < AUDIO_WAVE_BUFFERS; i++) {
+        waveOutUnprepareHeader(device.handle, &device.headers[i], sizeof(device.headers[i]));
+    }
+    waveOutClose(device.handle);
+    CloseHandle(device.bufferDone);
+}
+
+const AudioSink WAVE_OUT_AUDIO_SINK = {"waveout", OpenWaveOutSink, WaitWaveOutSink, WriteWaveOutSink, CloseWaveOutSink};
+
+// Reset the queue, voices and stats and render the sounds if needed
+void ResetAudio() {
+    if (soundBank.samples.empty()) {
+        RenderSoundBank(soundBank);
+    }
+    const AudioKernels* sets[2];
+    audioKernels = sets[SupportedAudioKernels(sets) - 1];
+    audioQueue.head.store(0);
+    audioQueue.tail.store(0);
+    audioQueue.droppedCommands = 0;
+    audioMixer.voiceCount = 0;
+    memset(&audioStats, 0, sizeof(audioStats));
+}
+
+bool StartAudio(const AudioSink* sink, const char* path) {
+    if (audioEnabled || !sink->open(path)) {
+        return false;
+    }
+    ResetAudio();
+    audioSink = sink;
+    audioStopping.store(false);
+    audioEnabled = true;
+    audioMixerThread = std::thread(AudioMixerLoop);
+    return true;
+}
+
+void StopAudio() {
+    if (!audioEnabled) {
+        return;
+    }
+    audioEnabled = false;
+    audioStopping.store(true);
+    audioMixerThread.join();
+    audioSink->close();
+}
+
+// Sounds for what a PLAYING step did; wall bounces pan with the ball
+void PlayMatchSounds(const MatchEvents& events, const MatchState& m, int fieldWidth) {
+    if (events.contact.paddleSide >= 0) {
+        PostSound(SOUND_PADDLE_HIT, 1.0f, events.contact.paddleSide == 0 ? -0.7f : 0.7f);
+    } else if (events.contact.wall) {
+        PostSound(SOUND_WALL_BOUNCE, 1.0f, m.ballX / fieldWidth * 2.0f - 1.0f);
+    }
+    if (events.goalSide >= 0) {
+        PostSound(SOUND_GOAL, 1.0f, 0.0f);
+    }
+}
+
+// Run the resume countdown; play continues once it reaches zero
+void UpdateResumeCountdown(float elapsedSeconds) {
+    float secondsBefore = ceilf(countdownTimer);
+    countdownTimer -= elapsedSeconds;
+    if (countdownTimer <= 0.0f) {
+        countdownTimer = 0.0f;
+        gameState = PLAYING;
+        isCountingDown = false;
+        RecordTelemetry(TELEMETRY_PAUSE_END, 0, SecondsPaused(), 0.0f);
+        ReleasePauseBackdrop();
+        PostSound(SOUND_COUNTDOWN_GO, 1.0f, 0.0f);
+    } else if (ceilf(countdownTimer) < secondsBefore) {
+        PostSound(SOUND_COUNTDOWN, 1.0f, 0.0f);
+    }
+}
+
+// Run the fixed ticks that `elapsedSeconds` of real time covers, then place
+// drawnMatch between the last two of them
+void AdvanceSimulation(float elapsedSeconds, const MatchInput& input, int fieldWidth, int fieldHeight) {
+    simulationAccumulator += elapsedSeconds;
+    int ticks = 0;
+    while (simulationAccumulator >= SIMULATION_TICK_SECONDS && ticks < MAX_TICKS_PER_FRAME) {
+        previousMatch = match;
+        MatchEvents events = StepMatch(match, input, currentPaddleSpeed, currentSpeedFactor, fieldWidth, fieldHeight);
+        mainBallScored = events.goalSide >= 0;
+        RecordMatchTelemetry(events, match);
+        PlayMatchSounds(events, match, fieldWidth);
+        RecordStateHash(match);
+        if (partyBalls.count > 0) {
+            StepPartyBalls(partyBalls, partyGrid, match, currentSpeedFactor, fieldWidth, fieldHeight);
+            RecordPartyTelemetry(partyBalls);
+        }
+        simulationAccumulator -= SIMULATION_TICK_SECONDS;
+        ticks++;
+    }
+    if (simulationAccumulator > SIMULATION_TICK_SECONDS) {
+        simulationAccumulator = SIMULATION_TICK_SECONDS;
+    }
+    renderAlpha = simulationAccumulator / SIMULATION_TICK_SECONDS;
+    drawnMatch = InterpolateMatch(previousMatch, match, renderAlpha, mainBallScored);
+}
+
+// ---------------------------------------------------------------------------
+// Pixel kernels
+//
+// The span loops behind the tile rasterizer, in scalar, SSE4.1 and AVX2
+// versions. The widest set the CPU supports is picked once at startup. All
+// versions do the same integer arithmetic, so they write the same bytes;
+// --pixel-kernel-test checks them against a plain per-channel blender.
+//
+// Pixels are 0xAARRGGBB. Blending colour channel s with alpha a over d is
+// (s * a + d * (255 - a) + 128) / 255, with the division done as
+// (t + (t >> 8)) >> 8, which is exact while t fits in 16 bits.
+// ---------------------------------------------------------------------------
+
+struct PixelKernels {
+    const char* name;
+    // Blend one straight-alpha colour over a span
+    void (*fillSpan)(uint32_t* dst, int count, uint32_t color);
+    // Blend premultiplied source pixels (channels <= alpha) over a span
+    void (*blendSpan)(uint32_t* dst, const uint32_t* src, int count);
+    // Colours of a linear gradient from `from` to `to` across `length`
+    // pixels, sampled at pixel centres, starting `offset` pixels in
+    void (*gradientSpan)(uint32_t* dst, int count, uint32_t from, uint32_t to, int offset, int length);
+    // Blend a colour over a span with its alpha scaled by coverage (0..255)
+    void (*coverageSpan)(uint32_t* dst, const uint8_t* coverage, int count, uint32_t color);
+};
+
+// d * inverse / 255 (rounded) plus a pre-multiplied source, on red/blue and
+// alpha/green pairs so each multiply does two channels
+inline uint32_t BlendPixel(uint32_t pixel, uint32_t sourceRB, uint32_t sourceAG, uint32_t inverse) {
+    uint32_t rb = (pixel & 0x00FF00FFu) * inverse + sourceRB;
+    uint32_t ag = ((pixel >> 8) & 0x00FF00FFu) * inverse + sourceAG;
+    rb = ((rb + ((rb >> 8) & 0x00FF00FFu)) >> 8) & 0x00FF00FFu;
+    ag = (ag + ((ag >> 8) & 0x00FF00FFu)) & 0xFF00FF00u;
+    return rb | ag;
+}
+
+// Gradient positions in 1/65536 of the gradient length, exactly: pixel j's
+// centre is at floor((2j + 1) * 32768 / length). Each pixel adds the
+// quotient of 65536 / length and carries the remainder, so the position
+// never drifts from that however long the span.
+struct GradientWalk {
+    int position;      // of the current pixel
+    int fraction;      // (2j + 1) * 32768 mod length
+    int step;          // 65536 / length
+    int stepFraction;  // 65536 mod length
+    int length;
+};
+
+inline GradientWalk StartGradientWalk(int offset, int length) {
+    long long numerator = (long long)(2 * offset + 1) << 15;
+    GradientWalk walk;
+    walk.position = (int)(numerator / length);
+    walk.fraction = (int)(numerator % length);
+    walk.step = 65536 / length;
+    walk.stepFraction = 65536 % length;
+    walk.length = length;
+    return walk;
+}
+
+inline void AdvanceGradientWalk(GradientWalk& walk) {
+    walk.position += walk.step;
+    walk.fraction += walk.stepFraction;
+    if (walk.fraction >= walk.length) {
+        walk.fraction -= walk.length;
+        walk.position++;
+    }
+}
+
+void FillSpanScalar(uint32_t* dst, int count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+    if (alpha == 0) return;
+    uint32_t opaque = color | 0xFF000000u;
+    if (alpha == 255) {
+        for (int i = 0; i < count; i++) dst[i] = opaque;
+        return;
+    }
+    uint32_t sourceRB = (opaque & 0x00FF00FFu) * alpha + 0x00800080u;
+    uint32_t sourceAG = ((opaque >> 8) & 0x00FF00FFu) * alpha + 0x00800080u;
+    for (int i = 0; i < count; i++) {
+        dst[i] = BlendPixel(dst[i], sourceRB, sourceAG, 255 - alpha);
+    }
+}
+
+void BlendSpanScalar(uint32_t* dst, const uint32_t* src, int count) {
+    for (int i = 0; i < count; i++) {
+        uint32_t source = src[i];
+        dst[i] = source + BlendPixel(dst[i], 0x00800080u, 0x00800080u, 255 - (source >> 24));
+    }
+}
+
+// Gradient pixels `first` to `count` - 1 of a span, `walk` starting at `first`
+void GradientPixels(uint32_t* dst, int first, int count, uint32_t from, uint32_t to, GradientWalk walk) {
+    for (int i = first; i < count; i++) {
+        int f = walk.position;
+        uint32_t result = 0;
+        for (int c = 0; c < 32; c += 8) {
+            int start = (from >> c) & 0xFF;
+            int diff = (int)((to >> c) & 0xFF) - start;
+            result |= (uint32_t)(start + ((diff * f + 32768) >> 16)) << c;
+        }
+        dst[i] = result;
+        AdvanceGradientWalk(walk);
+    }
+}
+
+void GradientSpanScalar(uint32_t* dst, int count, uint32_t from, uint32_t to, int offset, int length) {
+    GradientPixels(dst, 0, count, from, to, StartGradientWalk(offset, length));
+}
+
+void CoverageSpanScalar(uint32_t* dst, const uint8_t* coverage, int count, uint32_t color) {
+    uint32_t colorAlpha = color >> 24;
+    uint32_t opaque = color | 0xFF000000u;
+    for (int i = 0; i < count; i++) {
+        uint32_t t = colorAlpha * coverage[i] + 128;
+        uint32_t alpha = (t + (t >> 8)) >> 8;
+        if (alpha == 0) continue;
+        uint32_t sourceRB = (opaque & 0x00FF00FFu) * alpha + 0x00800080u;
+        uint32_t sourceAG = ((opaque >> 8) & 0x00FF00FFu) * alpha + 0x00800080u;
+        dst[i] = BlendPixel(dst[i], sourceRB, sourceAG, 255 - alpha);
+    }
+}
+
+const PixelKernels SCALAR_PIXEL_KERNELS = {
+    "scalar", FillSpanScalar, BlendSpanScalar, GradientSpanScalar, CoverageSpanScalar
+};
+
+#ifdef PIXEL_KERNELS_X86
+
+// 16-bit lanes: (t + (t >> 8)) >> 8
+#define DIV255_EPU16(t) _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8)
+#define DIV255_EPU16_256(t) _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8)
+
+// Each of four coverage bytes repeated over one pixel's four channels
+__attribute__((target("sse4.1")))
+inline __m128i SpreadCoverage(const uint8_t* coverage) {
+    int packed;
+    memcpy(&packed, coverage, 4);
+    __m128i bytes = _mm_cvtsi32_si128(packed);
+    bytes = _mm_unpacklo_epi8(bytes, bytes);
+    return _mm_unpacklo_epi16(bytes, bytes);
+}
+
+__attribute__((target("sse4.1")))
+void FillSpanSse4(uint32_t* dst, int count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+    if (alpha == 0 || alpha == 255) {
+        FillSpanScalar(dst, count, color);
+        return;
+    }
+    uint32_t opaque = color | 0xFF000000u;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i inverse = _mm_set1_epi16((short)(255 - alpha));
+    const __m128i source = _mm_set_epi16(
+        (short)(255 * alpha + 128), (short)(((opaque >> 16) & 0xFF) * alpha + 128),
+        (short)(((opaque >> 8) & 0xFF) * alpha + 128), (short)((opaque & 0xFF) * alpha + 128),
+        (short)(255 * alpha + 128), (short)(((opaque >> 16) & 0xFF) * alpha + 128),
+        (short)(((opaque >> 8) & 0xFF) * alpha + 128), (short)((opaque & 0xFF) * alpha + 128));
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), inverse), source);
+        __m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), inverse), source);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(DIV255_EPU16(low), DIV255_EPU16(high)));
+    }
+    FillSpanScalar(dst + i, count - i, color);
+}
+
+__attribute__((target("sse4.1")))
+void BlendSpanSse4(uint32_t* dst, const uint32_t* src, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i half = _mm_set1_epi16(128);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i source = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i alpha = _mm_srli_epi32(source, 24);
+        alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+        __m128i lowInverse = _mm_sub_epi16(full, _mm_unpacklo_epi32(alpha, alpha));
+        __m128i highInverse = _mm_sub_epi16(full, _mm_unpackhi_epi32(alpha, alpha));
+        __m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), lowInverse), half);
+        __m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), highInverse), half);
+        __m128i scaled = _mm_packus_epi16(DIV255_EPU16(low), DIV255_EPU16(high));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_adds_epu8(source, scaled));
+    }
+    BlendSpanScalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+void GradientSpanSse4(uint32_t* dst, int count, uint32_t from, uint32_t to, int offset, int length) {
+    const __m128i round = _mm_set1_epi32(32768);
+    __m128i starts[4], diffs[4];
+    for (int c = 0; c < 4; c++) {
+        int start = (from >> (c * 8)) & 0xFF;
+        starts[c] = _mm_set1_epi32(start);
+        diffs[c] = _mm_set1_epi32((int)((to >> (c * 8)) & 0xFF) - start);
+    }
+    // Each lane walks 4 pixels at a time: 4 * 65536 = advance * length +
+    // advanceFraction, with the same carry as AdvanceGradientWalk
+    GradientWalk walk = StartGradientWalk(offset, length);
+    alignas(16) int positions[4], fractions[4];
+    for (int lane = 0; lane < 4; lane++) {
+        positions[lane] = walk.position;
+        fractions[lane] = walk.fraction;
+        AdvanceGradientWalk(walk);
+    }
+    __m128i f = _mm_load_si128((const __m128i*)positions);
+    __m128i fraction = _mm_load_si128((const __m128i*)fractions);
+    const __m128i advance = _mm_set1_epi32((4 << 16) / length);
+    const __m128i advanceFraction = _mm_set1_epi32((4 << 16) % length);
+    const __m128i lengths = _mm_set1_epi32(length);
+    const __m128i lastFraction = _mm_set1_epi32(length - 1);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i result = _mm_setzero_si128();
+        for (int c = 0; c < 4; c++) {
+            __m128i value = _mm_srai_epi32(_mm_add_epi32(_mm_mullo_epi32(diffs[c], f), round), 16);
+            result = _mm_or_si128(result, _mm_slli_epi32(_mm_add_epi32(starts[c], value), c * 8));
+        }
+        _mm_storeu_si128((__m128i*)(dst + i), result);
+        f = _mm_add_epi32(f, advance);
+        fraction = _mm_add_epi32(fraction, advanceFraction);
+        __m128i carry = _mm_cmpgt_epi32(fraction, lastFraction);
+        fraction = _mm_sub_epi32(fraction, _mm_and_si128(carry, lengths));
+        f = _mm_sub_epi32(f, carry);
+    }
+    GradientPixels(dst, i, count, from, to, StartGradientWalk(offset + i, length));
+}
+
+__attribute__((target("sse4.1")))
+void CoverageSpanSse4(uint32_t* dst, const uint8_t* coverage, int count, uint32_t color) {
+    uint32_t opaque = color | 0xFF000000u;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i half = _mm_set1_epi16(128);
+    const __m128i colorAlpha = _mm_set1_epi16((short)(color >> 24));
+    const __m128i source = _mm_set_epi16(
+        255, (short)((opaque >> 16) & 0xFF), (short)((opaque >> 8) & 0xFF), (short)(opaque & 0xFF),
+        255, (short)((opaque >> 16) & 0xFF), (short)((opaque >> 8) & 0xFF), (short)(opaque & 0xFF));
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i spread = SpreadCoverage(coverage + i);
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i halves[2] = { _mm_unpacklo_epi8(spread, zero), _mm_unpackhi_epi8(spread, zero) };
+        __m128i targets[2] = { _mm_unpacklo_epi8(pixels, zero), _mm_unpackhi_epi8(pixels, zero) };
+        for (int h = 0; h < 2; h++) {
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(halves[h], colorAlpha), half);
+            __m128i alpha = DIV255_EPU16(t);
+            __m128i mixed = _mm_add_epi16(_mm_mullo_epi16(targets[h], _mm_sub_epi16(full, alpha)),
+                                          _mm_add_epi16(_mm_mullo_epi16(source, alpha), half));
+            targets[h] = DIV255_EPU16(mixed);
+        }
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(targets[0], targets[1]));
+    }
+    CoverageSpanScalar(dst + i, coverage + i, count - i, color);
+}
+
+__attribute__((target("avx2")))
+void FillSpanAvx2(uint32_t* dst, int count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+    if (alpha == 0 || alpha == 255) {
+        FillSpanScalar(dst, count, color);
+        return;
+    }
+    uint32_t opaque = color | 0xFF000000u;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i inverse = _mm256_set1_epi16((short)(255 - alpha));
+    const __m256i source = _mm256_set1_epi64x(
+        ((long long)(255 * alpha + 128) << 48) | ((long long)(((opaque >> 16) & 0xFF) * alpha + 128) << 32) |
+        ((long long)(((opaque >> 8) & 0xFF) * alpha + 128) << 16) | (long long)((opaque & 0xFF) * alpha + 128));
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i low = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(pixels, zero), inverse), source);
+        __m256i high = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(pixels, zero), inverse), source);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(DIV255_EPU16_256(low), DIV255_EPU16_256(high)));
+    }
+    _mm256_zeroupper();  // avoid the AVX/SSE transition penalty in the tail
+    FillSpanSse4(dst + i, count - i, color);
+}
+
+__attribute__((target("avx2")))
+void BlendSpanAvx2(uint32_t* dst, const uint32_t* src, int count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i full = _mm256_set1_epi16(255);
+    const __m256i half = _mm256_set1_epi16(128);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i source = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i pixels = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i alpha = _mm256_srli_epi32(source, 24);
+        alpha = _mm256_or_si256(alpha, _mm256_slli_epi32(alpha, 16));
+        __m256i lowInverse = _mm256_sub_epi16(full, _mm256_unpacklo_epi32(alpha, alpha));
+        __m256i highInverse = _mm256_sub_epi16(full, _mm256_unpackhi_epi32(alpha, alpha));
+        __m256i low = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(pixels, zero), lowInverse), half);
+        __m256i high = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(pixels, zero), highInverse), half);
+        __m256i scaled = _mm256_packus_epi16(DIV255_EPU16_256(low), DIV255_EPU16_256(high));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_adds_epu8(source, scaled));
+    }
+    _mm256_zeroupper();  // avoid the AVX/SSE transition penalty in the tail
+    BlendSpanSse4(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void GradientSpanAvx2(uint32_t* dst, int count, uint32_t from, uint32_t to, int offset, int length) {
+    const __m256i round = _mm256_set1_epi32(32768);
+    __m256i starts[4], diffs[4];
+    for (int c = 0; c < 4; c++) {
+        int start = (from >> (c * 8)) & 0xFF;
+        starts[c] = _mm256_set1_epi32(start);
+        diffs[c] = _mm256_set1_epi32((int)((to >> (c * 8)) & 0xFF) - start);
+    }
+    // Lanes walk 8 pixels at a time, as in GradientSpanSse4
+    GradientWalk walk = StartGradientWalk(offset, length);
+    alignas(32) int positions[8], fractions[8];
+    for (int lane = 0; lane < 8; lane++) {
+        positions[lane] = walk.position;
+        fractions[lane] = walk.fraction;
+        AdvanceGradientWalk(walk);
+    }
+    __m256i f = _mm256_load_si256((const __m256i*)positions);
+    __m256i fraction = _mm256_load_si256((const __m256i*)fractions);
+    const __m256i advance = _mm256_set1_epi32((8 << 16) / length);
+    const __m256i advanceFraction = _mm256_set1_epi32((8 << 16) % length);
+    const __m256i lengths = _mm256_set1_epi32(length);
+    const __m256i lastFraction = _mm256_set1_epi32(length - 1);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i result = _mm256_setzero_si256();
+        for (int c = 0; c < 4; c++) {
+            __m256i value = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(diffs[c], f), round), 16);
+            result = _mm256_or_si256(result, _mm256_slli_epi32(_mm256_add_epi32(starts[c], value), c * 8));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + i), result);
+        f = _mm256_add_epi32(f, advance);
+        fraction = _mm256_add_epi32(fraction, advanceFraction);
+        __m256i carry = _mm256_cmpgt_epi32(fraction, lastFraction);
+        fraction = _mm256_sub_epi32(fraction, _mm256_and_si256(carry, lengths));
+        f = _mm256_sub_epi32(f, carry);
+    }
+    GradientPixels(dst, i, count, from, to, StartGradientWalk(offset + i, length));
+}
+
+__attribute__((target("avx2")))
+void CoverageSpanAvx2(uint32_t* dst, const uint8_t* coverage, int count, uint32_t color) {
+    uint32_t opaque = color | 0xFF000000u;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i full = _mm256_set1_epi16(255);
+    const __m256i half = _mm256_set1_epi16(128);
+    const __m256i colorAlpha = _mm256_set1_epi16((short)(color >> 24));
+    const __m256i source = _mm256_set1_epi64x(
+        (255LL << 48) | ((long long)((opaque >> 16) & 0xFF) << 32) |
+        ((long long)((opaque >> 8) & 0xFF) << 16) | (long long)(opaque & 0xFF));
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // Pixels 0-3 live in the low 128-bit lane and 4-7 in the high one
+        __m256i spread = _mm256_inserti128_si256(_mm256_castsi128_si256(SpreadCoverage(coverage + i)),
+                                                 SpreadCoverage(coverage + i + 4), 1);
+        __m256i pixels = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i halves[2] = { _mm256_unpacklo_epi8(spread, zero), _mm256_unpackhi_epi8(spread, zero) };
+        __m256i targets[2] = { _mm256_unpacklo_epi8(pixels, zero), _mm256_unpackhi_epi8(pixels, zero) };
+        for (int h = 0; h < 2; h++) {
+            __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(halves[h], colorAlpha), half);
+            __m256i alpha = DIV255_EPU16_256(t);
+            __m256i mixed = _mm256_add_epi16(_mm256_mullo_epi16(targets[h], _mm256_sub_epi16(full, alpha)),
+                                             _mm256_add_epi16(_mm256_mullo_epi16(source, alpha), half));
+            targets[h] = DIV255_EPU16_256(mixed);
+        }
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(targets[0], targets[1]));
+    }
+    _mm256_zeroupper();  // avoid the AVX/SSE transition penalty in the tail
+    CoverageSpanSse4(dst + i, coverage + i, count - i, color);
+}
+
+const PixelKernels SSE4_PIXEL_KERNELS = {
+    "sse4", FillSpanSse4, BlendSpanSse4, GradientSpanSse4, CoverageSpanSse4
+};
+const PixelKernels AVX2_PIXEL_KERNELS = {
+    "avx2", FillSpanAvx2, BlendSpanAvx2, GradientSpanAvx2, CoverageSpanAvx2
+};
+
+#endif
+
+const PixelKernels* pixelKernels = &SCALAR_PIXEL_KERNELS;
+
+// Kernel sets this CPU can run, narrowest first. Returns the count.
+int SupportedPixelKernels(const PixelKernels* sets[3]) {
+    int count = 0;
+    sets[count++] = &SCALAR_PIXEL_KERNELS;
+#ifdef PIXEL_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1")) {
+        sets[count++] = &SSE4_PIXEL_KERNELS;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        sets[count++] = &AVX2_PIXEL_KERNELS;
+    }
+#endif
+    return count;
+}
+
+// Use the widest supported set, or the one named by `forced` if supported
+void SelectPixelKernels(const char* forced) {
+    const PixelKernels* sets[3];
+    int count = SupportedPixelKernels(sets);
+    pixelKernels = sets[count - 1];
+    for (int i = 0; forced && i < count; i++) {
+        if (strcmp(sets[i]->name, forced) == 0) {
+            pixelKernels = sets[i];
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Tile rasterizer
+//
+// The pause and difficulty screens stack many large translucent fills. Those
+// are queued as raster commands, binned into square screen tiles and blended
+// straight into the back buffer's pixels by a small set of worker threads.
+// Each tile runs its commands in the order they were queued, and a pixel's
+// value only depends on the commands that cover it, so the picture is the
+// same for any number of threads. Text and pens still go through GDI+
+// between batches.
+// ---------------------------------------------------------------------------
+
+const int RASTER_TILE_SIZE = 64;
+const int RASTER_MAX_COMMANDS = 256;
+const int RASTER_MAX_WORKERS = 7;   // the paint thread also rasterizes
+
+enum RasterOp {
+    RASTER_FILL,
+    RASTER_VERTICAL_GRADIENT,
+    RASTER_ELLIPSE,
+    RASTER_COPY,   // opaque image
+    RASTER_IMAGE,  // premultiplied image blended over
+    RASTER_MASK    // colour through an 8-bit coverage mask
+};
+
+struct RasterCommand {
+    RasterOp op;
+    int left, top, right, bottom;  // pixel bounds, right/bottom exclusive
+    uint32_t color;                // 0xAARRGGBB, straight alpha
+    uint32_t endColor;             // gradient colour at the bottom edge
+    const void* source;            // image/mask pixel at (left, top)
+    int sourceStride;              // in pixels
+};
+
+struct RasterTarget {
+    uint32_t* pixels;  // 32bpp top-down, 0xAARRGGBB
+    int width;
+    int height;
+    int stride;        // in pixels
+};
+
+struct RasterBatch {
+    RasterCommand commands[RASTER_MAX_COMMANDS];
+    int commandCount;
+    // RASTER_MAX_COMMANDS slots per tile, grown by SetRasterTarget to
+    // cover the largest target so far
+    std::vector<uint16_t> bins;
+    std::vector<int> binCounts;
+    int tilesX;
+    int tilesY;
+};
+
+// Persistent workers woken once per batch. They claim tiles from a shared
+// counter, so a batch costs no allocation on the paint thread.
+struct RasterWorkers {
+    std::thread threads[RASTER_MAX_WORKERS];
+    int threadCount = 0;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned generation = 0;
+    int busy = 0;
+    bool stopping = false;
+    std::atomic<int> nextTile{0};
+};
+
+RasterTarget rasterTarget = {};
+RasterBatch rasterBatch;
+RasterWorkers rasterWorkers;
+
+uint32_t RasterColor(int a, int r, int g, int b) {
+    return ((uint32_t)a << 24) | ((uint32_t)r << 16) | ((uint32_t)g << 8) | (uint32_t)b;
+}
+
+// Fraction of each pixel in [left, right) on `row` inside the ellipse,
+// from a 4x4 grid of samples
+void EllipseCoverageRow(const RasterCommand& cmd, int row, int left, int right, uint8_t* coverage) {
+    float radiusX = (cmd.right - cmd.left) * 0.5f;
+    float radiusY = (cmd.bottom - cmd.top) * 0.5f;
+    float centerX = cmd.left + radiusX;
+    float centerY = cmd.top + radiusY;
+    float rowTerms[4];
+    for (int sy = 0; sy < 4; sy++) {
+        float dy = (row + (sy + 0.5f) * 0.25f - centerY) / radiusY;
+        rowTerms[sy] = 1.0f - dy * dy;
+    }
+    for (int x = left; x < right; x++) {
+        int inside = 0;
+        for (int sx = 0; sx < 4; sx++) {
+            float dx = (x + (sx + 0.5f) * 0.25f - centerX) / radiusX;
+            float dx2 = dx * dx;
+            for (int sy = 0; sy < 4; sy++) {
+                if (dx2 <= rowTerms[sy]) inside++;
+            }
+        }
+        coverage[x - left] = (uint8_t)((inside * 255 + 8) / 16);
+    }
+}
+
+void RasterizeTile(int tile) {
+    const int tileX = tile % rasterBatch.tilesX;
+    const int tileY = tile / rasterBatch.tilesX;
+    const int tileLeft = tileX * RASTER_TILE_SIZE;
+    const int tileTop = tileY * RASTER_TILE_SIZE;
+    const int tileRight = std::min(tileLeft + RASTER_TILE_SIZE, rasterTarget.width);
+    const int tileBottom = std::min(tileTop + RASTER_TILE_SIZE, rasterTarget.height);
+    uint8_t coverage[RASTER_TILE_SIZE];
+    uint32_t rowColors[RASTER_TILE_SIZE];
+
+    for (int i = 0; i < rasterBatch.binCounts[tile]; i++) {
+        const RasterCommand& cmd = rasterBatch.commands[rasterBatch.bins[tile * RASTER_MAX_COMMANDS + i]];
+        int left = std::max(cmd.left, tileLeft);
+        int top = std::max(cmd.top, tileTop);
+        int right = std::min(cmd.right, tileRight);
+        int bottom = std::min(cmd.bottom, tileBottom);
+        if (cmd.op == RASTER_VERTICAL_GRADIENT && top < bottom) {
+            // One colour per row, taken down the gradient
+            pixelKernels->gradientSpan(rowColors, bottom - top, cmd.color, cmd.endColor, top - cmd.top, cmd.bottom - cmd.top);
+        }
+        for (int y = top; y < bottom; y++) {
+            uint32_t* row = rasterTarget.pixels + (size_t)y * rasterTarget.stride + left;
+            if (cmd.op == RASTER_FILL) {
+                pixelKernels->fillSpan(row, right - left, cmd.color);
+            } else if (cmd.op == RASTER_VERTICAL_GRADIENT) {
+                pixelKernels->fillSpan(row, right - left, rowColors[y - top]);
+            } else if (cmd.op == RASTER_COPY || cmd.op == RASTER_IMAGE) {
+                const uint32_t* source = (const uint32_t*)cmd.source + (size_t)(y - cmd.top) * cmd.sourceStride +
+                                         (left - cmd.left);
+                if (cmd.op == RASTER_COPY) {
+                    memcpy(row, source, (right - left) * sizeof(uint32_t));
+                } else {
+                    pixelKernels->blendSpan(row, source, right - left);
+                }
+            } else if (cmd.op == RASTER_MASK) {
+                const uint8_t* mask = (const uint8_t*)cmd.source + (size_t)(y - cmd.top) * cmd.sourceStride +
+                                      (left - cmd.left);
+                pixelKernels->coverageSpan(row, mask, right - left, cmd.color);
+            } else {
+                EllipseCoverageRow(cmd, y, left, right, coverage);
+                pixelKernels->coverageSpan(row, coverage, right - left, cmd.color);
+            }
+        }
+    }
+}
+
+// Claim and rasterize tiles until none are left
+void RasterizeClaimedTiles() {
+    int tileCount = rasterBatch.tilesX * rasterBatch.tilesY;
+    while (true) {
+        int tile = rasterWorkers.nextTile.fetch_add(1);
+        if (tile >= tileCount) return;
+        if (rasterBatch.binCounts[tile] > 0) {
+            RasterizeTile(tile);
+        }
+    }
+}
+
+void RasterWorkerLoop() {
+    unsigned seenGeneration = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(rasterWorkers.lock);
+            rasterWorkers.wake.wait(lock, [&] {
+                return rasterWorkers.stopping || rasterWorkers.generation != seenGeneration;
+            });
+            if (rasterWorkers.stopping) return;
+            seenGeneration = rasterWorkers.generation;
+        }
+        RasterizeClaimedTiles();
+        {
+            std::lock_guard<std::mutex> lock(rasterWorkers.lock);
+            if (--rasterWorkers.busy == 0) {
+                rasterWorkers.done.notify_one();
+            }
+        }
+    }
+}
+
+// `count` extra threads besides the paint thread; 0 rasterizes inline
+void StartRasterWorkers(int count) {
+    if (count > RASTER_MAX_WORKERS) count = RASTER_MAX_WORKERS;
+    // No workers are running here, so the batch counter can restart
+    rasterWorkers.stopping = false;
+    rasterWorkers.generation = 0;
+    for (int i = 0; i < count; i++) {
+        rasterWorkers.threads[i] = std::thread(RasterWorkerLoop);
+    }
+    rasterWorkers.threadCount = count < 0 ? 0 : count;
+}
+
+void StopRasterWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(rasterWorkers.lock);
+        rasterWorkers.stopping = true;
+    }
+    rasterWorkers.wake.notify_all();
+    for (int i = 0; i < rasterWorkers.threadCount; i++) {
+        rasterWorkers.threads[i].join();
+    }
+    rasterWorkers.threadCount = 0;
+}
+
+// Call outside the frame's allocation check: a target larger than any
+// before grows the tile bins
+void SetRasterTarget(uint32_t* pixels, int width, int height, int stride) {
+    rasterTarget.pixels = pixels;
+    rasterTarget.width = width;
+    rasterTarget.height = height;
+    rasterTarget.stride = stride;
+    rasterBatch.commandCount = 0;
+    rasterBatch.tilesX = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    rasterBatch.tilesY = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    size_t tileCount = (size_t)std::max(rasterBatch.tilesX * rasterBatch.tilesY, 0);
+    if (rasterBatch.binCounts.size() < tileCount) {
+        rasterBatch.binCounts.resize(tileCount);
+        rasterBatch.bins.resize(tileCount * RASTER_MAX_COMMANDS);
+    }
+}
+
+// Bin the queued commands and draw them into the target
+void FlushRaster() {
+    if (rasterBatch.commandCount == 0) return;
+    if (!rasterTarget.pixels) {
+        rasterBatch.commandCount = 0;
+        return;
+    }
+
+    std::fill(rasterBatch.binCounts.begin(), rasterBatch.binCounts.begin() + rasterBatch.tilesX * rasterBatch.tilesY, 0);
+    for (int i = 0; i < rasterBatch.commandCount; i++) {
+        const RasterCommand& cmd = rasterBatch.commands[i];
+        int left = std::max(cmd.left, 0);
+        int top = std::max(cmd.top, 0);
+        int right = std::min(cmd.right, rasterTarget.width);
+        int bottom = std::min(cmd.bottom, rasterTarget.height);
+        if (left >= right || top >= bottom) continue;
+        for (int ty = top / RASTER_TILE_SIZE; ty <= (bottom - 1) / RASTER_TILE_SIZE; ty++) {
+            for (int tx = left / RASTER_TILE_SIZE; tx <= (right - 1) / RASTER_TILE_SIZE; tx++) {
+                int tile = ty * rasterBatch.tilesX + tx;
+                rasterBatch.bins[tile * RASTER_MAX_COMMANDS + rasterBatch.binCounts[tile]++] = (uint16_t)i;
+            }
+        }
+    }
+
+    rasterWorkers.nextTile = 0;
+    if (rasterWorkers.threadCount > 0) {
+        {
+            std::lock_guard<std::mutex> lock(rasterWorkers.lock);
+            rasterWorkers.busy = rasterWorkers.threadCount;
+            rasterWorkers.generation++;
+        }
+        rasterWorkers.wake.notify_all();
+    }
+    RasterizeClaimedTiles();
+    if (rasterWorkers.threadCount > 0) {
+        std::unique_lock<std::mutex> lock(rasterWorkers.lock);
+        rasterWorkers.done.wait(lock, [] { return rasterWorkers.busy == 0; });
+    }
+    rasterBatch.commandCount = 0;
+}
+
+// Add a command to the batch. A full batch is drawn first to make room, so
+// whatever GDI+ drew under the new command must already be flushed to the
+// pixels (DrawRasterBatch flushes GDI+ before it draws a batch).
+RasterCommand* QueueRasterCommand(RasterOp op, int x, int y, int width, int height, uint32_t color, uint32_t endColor) {
+    if (width <= 0 || height <= 0) {
+        return nullptr;
+    }
+    if (rasterBatch.commandCount == RASTER_MAX_COMMANDS) {
+        FlushRaster();
+    }
+    RasterCommand& cmd = rasterBatch.commands[rasterBatch.commandCount++];
+    cmd.op = op;
+    cmd.left = x;
+    cmd.top = y;
+    cmd.right = x + width;
+    cmd.bottom = y + height;
+    cmd.color = color;
+    cmd.endColor = endColor;
+    cmd.source = nullptr;
+    cmd.sourceStride = 0;
+    return &cmd;
+}
+
+// Same pixels as Graphics::FillRectangle with integer coordinates
+void RasterFillRect(int x, int y, int width, int height, uint32_t color) {
+    QueueRasterCommand(RASTER_FILL, x, y, width, height, color, color);
+}
+
+// Vertical gradient from `topColor` at y to `bottomColor` at y + height
+void RasterGradientRect(int x, int y, int width, int height, uint32_t topColor, uint32_t bottomColor) {
+    QueueRasterCommand(RASTER_VERTICAL_GRADIENT, x, y, width, height, topColor, bottomColor);
+}
+
+// A gradient, or one fill of the colour halfway along it when the effects
+// tier has gradients off
+void RasterShadedRect(int x, int y, int width, int height, uint32_t topColor, uint32_t bottomColor) {
+    if (CurrentEffects().gradients) {
+        RasterGradientRect(x, y, width, height, topColor, bottomColor);
+    } else {
+        uint32_t middle = (((topColor ^ bottomColor) >> 1) & 0x7F7F7F7Fu) + (topColor & bottomColor);
+        RasterFillRect(x, y, width, height, middle);
+    }
+}
+
+void RasterFillEllipse(int x, int y, int width, int height, uint32_t color) {
+    QueueRasterCommand(RASTER_ELLIPSE, x, y, width, height, color, color);
+}
+
+// Images and masks are read while the batch is flushed, so they must stay
+// alive until then
+void QueueRasterSource(RasterOp op, int x, int y, int width, int height, const void* source, int stride, uint32_t color) {
+    RasterCommand* cmd = QueueRasterCommand(op, x, y, width, height, color, color);
+    if (cmd) {
+        cmd->source = source;
+        cmd->sourceStride = stride;
+    }
+}
+
+void RasterCopyImage(int x, int y, int width, int height, const uint32_t* pixels, int stride) {
+    QueueRasterSource(RASTER_COPY, x, y, width, height, pixels, stride, 0);
+}
+
+void RasterBlendImage(int x, int y, int width, int height, const uint32_t* pixels, int stride) {
+    QueueRasterSource(RASTER_IMAGE, x, y, width, height, pixels, stride, 0);
+}
+
+void RasterFillMask(int x, int y, int width, int height, const uint8_t* mask, int stride, uint32_t color) {
+    QueueRasterSource(RASTER_MASK, x, y, width, height, mask, stride, color);
+}
+
+// Outline centred on the rectangle's edges, like Graphics::DrawRectangle.
+// The four strips don't overlap, so translucent corners blend once.
+void RasterFrameRect(int x, int y, int width, int height, int penWidth, uint32_t color) {
+    int inner = penWidth / 2;
+    int outer = penWidth - inner;
+    RasterFillRect(x - inner, y - inner, width + penWidth, penWidth, color);
+    RasterFillRect(x - inner, y + height - inner, width + penWidth, penWidth, color);
+    RasterFillRect(x - inner, y + outer, penWidth, height - penWidth, color);
+    RasterFillRect(x + width - inner, y + outer, penWidth, height - penWidth, color);
+}
+
+// Frozen playfield under the pause overlay
+void QueuePausedScene(const MatchState& m, int clientWidth, int clientHeight) {
+    RasterFillRect(0, 0, clientWidth, clientHeight, RasterColor(255, 0, 0, 0));
+
+    // Center line (2 pixel pen, flat caps)
+    for (int y = 0; y < clientHeight; y += 20) {
+        RasterFillRect(clientWidth / 2 - 1, y, 2, 10, RasterColor(50, 255, 255, 255));
+    }
+
+    // Paddles and ball, dimmed
+    uint32_t dimmed = RasterColor(100, 255, 255, 255);
+    RasterFillRect(15, (int)m.leftPaddleY, PADDLE_WIDTH, PADDLE_HEIGHT, dimmed);
+    RasterFillRect(clientWidth - 15 - PADDLE_WIDTH, (int)m.rightPaddleY, PADDLE_WIDTH, PADDLE_HEIGHT, dimmed);
+    RasterFillEllipse((int)(m.ballX - BALL_RADIUS - 2), (int)(m.ballY - BALL_RADIUS - 2),
+                      (BALL_RADIUS + 2) * 2, (BALL_RADIUS + 2) * 2, RasterColor(50, 255, 255, 255));
+    RasterFillEllipse((int)(m.ballX - BALL_RADIUS), (int)(m.ballY - BALL_RADIUS), BALL_RADIUS * 2, BALL_RADIUS * 2, dimmed);
+    for (int i = 0; i < partyBalls.count; i++) {
+        RasterFillEllipse((int)(PartyBallDrawnX(i) - BALL_RADIUS), (int)(PartyBallDrawnY(i) - BALL_RADIUS),
+                          BALL_RADIUS * 2, BALL_RADIUS * 2, dimmed);
+    }
+}
+
+// The parts of the pause overlay that don't move: the gradient over the
+// frozen game and the glow layers around the menu frame
+void QueuePauseBackdrop(int clientWidth, int clientHeight, int frameX, int frameY, int frameWidth, int frameHeight) {
+    RasterShadedRect(0, 0, clientWidth, clientHeight, RasterColor(220, 0, 0, 20), RasterColor(220, 20, 0, 40));
+
+    // Outer glow layers
+    for (int i = EffectsGlowLayers(4); i > 0; i--) {
+        int alpha = 40 - i * 8;
+        int offset = i * 4;
+        RasterFrameRect(frameX - offset, frameY - offset, frameWidth + offset * 2, frameHeight + offset * 2, 3,
+                        RasterColor(alpha, 100, 200, 255));
+    }
+}
+
+// Orbiting particles and the menu frame fill over them. The particles
+// stay inside the frame, clear of the glow layers.
+void QueuePauseParticles(int clientWidth, int clientHeight, int frameX, int frameY, int frameWidth, int frameHeight) {
+    for (int i = 0; i < 20; i += CurrentEffects().particleStride) {
+        float angle = pauseAnimTime * 0.5f + (i * 3.14159f * 2.0f / 20.0f);
+        float radius = 150 + sin(pauseAnimTime + i) * 30;
+        float x = clientWidth / 2 + cos(angle) * radius;
+        float y = clientHeight / 2 + sin(angle) * radius;
+        int size = 2 + (int)(sin(pauseAnimTime * 2 + i) * 1.5f);
+        RasterFillEllipse((int)x - size, (int)y - size, size * 2, size * 2, RasterColor(80, 100, 200, 255));
+    }
+
+    RasterFillRect(frameX, frameY, frameWidth, frameHeight, RasterColor(180, 10, 10, 30));
+}
+
+// Glow and background of the two pause menu options
+void QueuePauseOptions(int optionX, int optionY, int optionWidth, int optionHeight, int optionSpacing) {
+    const uint32_t optionColors[] = {
+        RasterColor(255, 100, 255, 100),  // Green for Resume
+        RasterColor(255, 255, 100, 100)   // Red for Menu
+    };
+    for (int i = 0; i < 2; i++) {
+        int currentY = optionY + i * optionSpacing;
+        bool isSelected = (pauseMenuSelection == i);
+        float pulse = isSelected ? (0.85f + sin(pauseAnimTime * 5.0f) * 0.15f) : 0.4f;
+        if (isSelected) {
+            for (int glow = EffectsGlowLayers(3); glow > 0; glow--) {
+                int glowAlpha = (int)((60 - glow * 15) * pulse);
+                RasterFillRect(optionX - glow * 4, currentY - glow * 4, optionWidth + glow * 8, optionHeight + glow * 8,
+                               (optionColors[i] & 0x00FFFFFFu) | ((uint32_t)glowAlpha << 24));
+            }
+        }
+        RasterFillRect(optionX, currentY, optionWidth, optionHeight, RasterColor((int)(150 * pulse), 20, 20, 50));
+    }
+}
+
+void PauseFrameRect(int clientWidth, int clientHeight, int& frameX, int& frameY) {
+    frameX = (clientWidth - PAUSE_FRAME_WIDTH) / 2;
+    frameY = (clientHeight - PAUSE_FRAME_HEIGHT) / 2;
+}
+
+// Fill pauseBackdrop: copy the back buffer, darken it by PAUSE_DIM_ALPHA
+// and draw the static overlay on the copy
+void CapturePauseBackdrop(int width, int height) {
+    if (!backBufferPixels || width != backBufferWidth || height != backBufferHeight) {
+        return;
+    }
+    pauseBackdrop.width = width;
+    pauseBackdrop.height = height;
+    pauseBackdrop.pixels.assign(backBufferPixels, backBufferPixels + (size_t)width * height);
+
+    int frameX, frameY;
+    PauseFrameRect(width, height, frameX, frameY);
+    SetRasterTarget(pauseBackdrop.pixels.data(), width, height, width);
+    RasterFillRect(0, 0, width, height, RasterColor(PAUSE_DIM_ALPHA, 0, 0, 0));
+    QueuePauseBackdrop(width, height, frameX, frameY, PAUSE_FRAME_WIDTH, PAUSE_FRAME_HEIGHT);
+    FlushRaster();
+    SetRasterTarget(backBufferPixels, backBufferWidth, backBufferHeight, backBufferWidth);
+}
+
+// Make GDI+ and GDI finish drawing into the back buffer, then run the
+// queued raster commands on top
+void DrawRasterBatch(Graphics& graphics) {
+    graphics.Flush(FlushIntentionSync);
+    GdiFlush();
+    FlushRaster();
+}
+
+// ---------------------------------------------------------------------------
+// Menu atlas
+//
+// Everything on the MENU screen is a function of menuAnimTime, but one full
+// period of it (every sine lines up again after 20*pi, about 35 seconds) is
+// far too big to store as frames. Instead the atlas keeps what the
+// animation never changes - the background, the corner brackets, title,
+// lines and credits - plus sprites for the parts whose only animated
+// properties are position and alpha: the particle dots at each size and
+// the subtitle and prompt text as coverage masks. A frame then just
+// composites those with the tile rasterizer at the current phase.
+//
+// The static overlay is stored as premultiplied pixels for the 64x64 tiles
+// it touches, each cropped to its drawn pixels; masks are 8-bit. The atlas
+// is baked on the first MENU frame at a window size and is only used when
+// it fits in menuAtlasBudgetBytes (--menu-atlas-budget <KB>); a background
+// that doesn't also fit is drawn by GDI+ each frame. A window smaller than
+// the particle layer draws the menu live. After a resize the menu is drawn
+// live until the size has held for MENU_ATLAS_REBAKE_DELAY_MS, then
+// re-baked. --no-menu-atlas always draws the menu live.
+// ---------------------------------------------------------------------------
+
+const int MENU_PARTICLE_COUNT = 30;
+const int MENU_PARTICLE_MAX_SIZE = 4;
+const int MENU_PARTICLE_LAYER_SIZE = 32;  // square the particle masks are drawn on, centred
+const size_t MENU_ATLAS_DEFAULT_BUDGET_KB = 8192;
+const int MENU_ATLAS_REBAKE_DELAY_MS = 300;
+const wchar_t* MENU_SUBTITLE = L"Classic Arcade Experience";
+const wchar_t* MENU_PROMPT = L"Press Any Key to Start";
+
+struct MenuSprite {
+    int x, y;           // screen position, or offset from a particle's centre
+    int width, height;  // 0 when nothing was drawn
+    size_t offset;      // first pixel in MenuAtlas::pixels or ::masks
+};
+
+struct MenuAtlas {
+    int width, height;  // window size it was baked for
+    int pendingWidth, pendingHeight;  // a different size the window has now
+    LONGLONG pendingSince;            // QPC when it changed to that size
+    bool baked;
+    bool failed;        // over budget or too small at this size: draw live
+    bool hasBackground;
+    MenuSprite background;
+    std::vector<MenuSprite> overlay;
+    MenuSprite particles[MENU_PARTICLE_MAX_SIZE + 1];  // by particle size
+    MenuSprite subtitle;
+    MenuSprite prompt;
+    std::vector<uint32_t> pixels;
+    std::vector<uint8_t> masks;
+};
+
+MenuAtlas menuAtlas = {};
+bool menuAtlasEnabled = true;
+size_t menuAtlasBudgetBytes = MENU_ATLAS_DEFAULT_BUDGET_KB * 1024;
+
+size_t MenuAtlasBytes(const MenuAtlas& atlas) {
+    return atlas.pixels.size() * sizeof(uint32_t) + atlas.masks.size();
+}
+
+// Where the orbiting particle i is at time t
+void MenuParticle(int i, float t, int clientWidth, int clientHeight, float& x, float& y, int& size) {
+    float angle = t * 0.3f + (i * 3.14159f * 2.0f / 30.0f);
+    float radius = 200 + sin(t * 0.5f + i) * 50;
+    x = clientWidth / 2 + cos(angle) * radius;
+    y = clientHeight / 2 + sin(angle) * radius;
+    size = 2 + (int)(sin(t + i) * 2);
+}
+
+RectF MenuSubtitleRect(int clientWidth, int clientHeight) {
+    return RectF(0, clientHeight / 2 - 20, clientWidth, 50);
+}
+
+RectF MenuPromptRect(int clientWidth, int clientHeight, float bounce) {
+    return RectF(0, clientHeight / 2 + 80 + bounce, clientWidth, 60);
+}
+
+// Image or animated gradient under everything else
+void DrawMenuBackground(Graphics& graphics, int clientWidth, int clientHeight) {
+    if (backgroundImage) {
+        graphics.DrawImage(backgroundImage, 0, 0, clientWidth, clientHeight);
+    } else {
+        // Fallback to animated gradient background
+        float colorShift = sin(menuAnimTime * 0.5f) * 20;
+        if (CurrentEffects().gradients) {
+            LinearGradientBrush gradientBrush(
+                Point(0, 0),
+                Point(0, clientHeight),
+                Color(255, (int)(15 + colorShift), (int)(10 + colorShift), (int)(40 + colorShift)),
+                Color(255, (int)(40 + colorShift), (int)(10 + colorShift), (int)(60 + colorShift))
+            );
+            graphics.FillRectangle(&gradientBrush, 0, 0, clientWidth, clientHeight);
+        } else {
+            SolidBrush flatBrush(Color(255, (int)(27 + colorShift), (int)(10 + colorShift), (int)(50 + colorShift)));
+            graphics.FillRectangle(&flatBrush, 0, 0, clientWidth, clientHeight);
+        }
+    }
+}
+
+// The parts of the menu that never move: corner brackets, title, lines and
+// credits. None of them overlap the subtitle or prompt.
+void DrawMenuDecorations(Graphics& graphics, int clientWidth, int clientHeight) {
+    FontFamily& fontFamily = *gameFonts.family;
+    StringFormat& stringFormat = *gameFonts.centered;
+    // Draw decorative corner elements
+    Pen decorPen(Color(200, 100, 200, 255), 4);
+    int cornerSize = 60;
+    int cornerMargin = 40;
+    
+    // Animated corner brackets with glow (the first pass is the bracket)
+    int bracketPasses = std::max(1, EffectsGlowLayers(3));
+    for (int offset = 0; offset < bracketPasses; offset++) {
+        int alpha = 100 - offset * 30;
+        Pen glowPen(Color(alpha, 100, 200, 255), 4 - offset);
+        
+        // Top-left
+        graphics.DrawLine(&glowPen, cornerMargin - offset, cornerMargin - offset, 
+                         cornerMargin + cornerSize + offset, cornerMargin - offset);
+        graphics.DrawLine(&glowPen, cornerMargin - offset, cornerMargin - offset, 
+                         cornerMargin - offset, cornerMargin + cornerSize + offset);
+        
+        // Top-right
+        graphics.DrawLine(&glowPen, clientWidth - cornerMargin + offset, cornerMargin - offset, 
+                         clientWidth - cornerMargin - cornerSize - offset, cornerMargin - offset);
+        graphics.DrawLine(&glowPen, clientWidth - cornerMargin + offset, cornerMargin - offset, 
+                         clientWidth - cornerMargin + offset, cornerMargin + cornerSize + offset);
+        
+        // Bottom-left
+        graphics.DrawLine(&glowPen, cornerMargin - offset, clientHeight - cornerMargin + offset, 
+                         cornerMargin + cornerSize + offset, clientHeight - cornerMargin + offset);
+        graphics.DrawLine(&glowPen, cornerMargin - offset, clientHeight - cornerMargin + offset, 
+                         cornerMargin - offset, clientHeight - cornerMargin - cornerSize - offset);
+        
+        // Bottom-right
+        graphics.DrawLine(&glowPen, clientWidth - cornerMargin + offset, clientHeight - cornerMargin + offset, 
+                         clientWidth - cornerMargin - cornerSize - offset, clientHeight - cornerMargin + offset);
+        graphics.DrawLine(&glowPen, clientWidth - cornerMargin + offset, clientHeight - cornerMargin + offset, 
+                         clientWidth - cornerMargin + offset, clientHeight - cornerMargin - cornerSize - offset);
+    }
+
+    // Draw game title with glow effect
+    Font titleFont(&fontFamily, 96, FontStyleBold, UnitPixel);
+
+    // Title glow layers
+    for (int i = EffectsGlowLayers(3); i > 0; i--) {
+        int alpha = 60 - i * 15;
+        SolidBrush glowBrush(Color(alpha, 100, 200, 255));
+        RectF glowRect(0, clientHeight / 2 - 150 - i * 2, clientWidth, 120);
+        graphics.DrawString(L"PONG", -1, &titleFont, glowRect, &stringFormat, &glowBrush);
+    }
+
+    // Main title with gradient
+    RectF titleRect(0, clientHeight / 2 - 150, clientWidth, 120);
+    LinearGradientBrush titleGradient(
+        Point(clientWidth / 2, (int)(clientHeight / 2 - 150)),
+        Point(clientWidth / 2, (int)(clientHeight / 2 - 30)),
+        Color(255, 255, 255, 255),
+        Color(255, 100, 200, 255)
+    );
+    SolidBrush titleFlat(Color(255, 177, 227, 255));
+    Brush* titleBrush = CurrentEffects().gradients ? (Brush*)&titleGradient : &titleFlat;
+    graphics.DrawString(L"PONG", -1, &titleFont, titleRect, &stringFormat, titleBrush);
+
+    // Draw decorative lines
+    Pen linePen(Color(150, 100, 200, 255), 2);
+    int lineY = clientHeight / 2 + 160;
+    for (int i = 0; i < 5; i++) {
+        int lineWidth = 50 + i * 30;
+        int lineX = clientWidth / 2 - lineWidth / 2;
+        int alpha = 150 - i * 20;
+        Pen currentLinePen(Color(alpha, 100, 200, 255), 2);
+        graphics.DrawLine(&currentLinePen, lineX, lineY + i * 8, lineX + lineWidth, lineY + i * 8);
+    }
+
+    // Draw version/credits at bottom
+    Font creditFont(&fontFamily, 16, FontStyleRegular, UnitPixel);
+    SolidBrush creditBrush(Color(120, 150, 150, 150));
+    RectF creditRect(0, clientHeight - 50, clientWidth, 30);
+    graphics.DrawString(L"© 2024 Classic Games Revival", -1, &creditFont, creditRect, &stringFormat, &creditBrush);
+}
+
+// The whole menu through GDI+, as every frame used to draw it
+void DrawMenuLive(Graphics& graphics, int clientWidth, int clientHeight) {
+    FontFamily& fontFamily = *gameFonts.family;
+    StringFormat& stringFormat = *gameFonts.centered;
+    DrawMenuBackground(graphics, clientWidth, clientHeight);
+
+    // Draw animated background particles
+    SolidBrush particleBrush(Color(60, 255, 255, 255));
+    for (int i = 0; i < MENU_PARTICLE_COUNT; i += CurrentEffects().particleStride) {
+        float x, y;
+        int size;
+        MenuParticle(i, menuAnimTime, clientWidth, clientHeight, x, y, size);
+        graphics.FillEllipse(&particleBrush, (int)x - size, (int)y - size, size * 2, size * 2);
+    }
+
+    DrawMenuDecorations(graphics, clientWidth, clientHeight);
+
+    // Draw subtitle with pulse effect
+    Font subtitleFont(&fontFamily, 28, FontStyleRegular, UnitPixel);
+    int subtitleAlpha = (int)(180 + sin(menuAnimTime * 2.0f) * 75);
+    SolidBrush subtitleBrush(Color(subtitleAlpha, 200, 200, 200));
+    RectF subtitleRect = MenuSubtitleRect(clientWidth, clientHeight);
+    graphics.DrawString(MENU_SUBTITLE, -1, &subtitleFont, subtitleRect, &stringFormat, &subtitleBrush);
+
+    // Draw animated "Press Any Key" text with bounce effect
+    Font promptFont(&fontFamily, 36, FontStyleBold, UnitPixel);
+    float bounce = sin(menuAnimTime * 3.0f) * 10;
+    int promptAlpha = (int)(200 + sin(menuAnimTime * 4.0f) * 55);
+
+    // Glow effect for prompt
+    if (EffectsGlowLayers(1) > 0) {
+        SolidBrush promptGlowBrush(Color(promptAlpha / 2, 255, 255, 100));
+        RectF promptGlowRect = MenuPromptRect(clientWidth, clientHeight, bounce - 2);
+        graphics.DrawString(MENU_PROMPT, -1, &promptFont, promptGlowRect, &stringFormat, &promptGlowBrush);
+    }
+
+    // Main prompt text
+    SolidBrush promptBrush(Color(promptAlpha, 255, 255, 255));
+    RectF promptRect = MenuPromptRect(clientWidth, clientHeight, bounce);
+    graphics.DrawString(MENU_PROMPT, -1, &promptFont, promptRect, &stringFormat, &promptBrush);
+}
+
+bool FitsMenuAtlasBudget(const MenuAtlas& atlas, size_t extraBytes) {
+    return MenuAtlasBytes(atlas) + extraBytes <= menuAtlasBudgetBytes;
+}
+
+// Keep the drawn pixels of `layer` inside [left, right) x [top, bottom),
+// cropped to the ones that aren't transparent. False if over budget.
+bool AddOverlaySprite(MenuAtlas& atlas, const uint32_t* layer, int layerWidth, int left, int top, int right, int bottom) {
+    int minX = right, minY = bottom, maxX = left - 1, maxY = top - 1;
+    for (int y = top; y < bottom; y++) {
+        for (int x = left; x < right; x++) {
+            if (layer[(size_t)y * layerWidth + x] != 0) {
+                minX = std::min(minX, x);
+                maxX = std::max(maxX, x);
+                minY = std::min(minY, y);
+                maxY = y;
+            }
+        }
+    }
+    if (maxX < minX) {
+        return true;
+    }
+    MenuSprite sprite = {minX, minY, maxX - minX + 1, maxY - minY + 1, atlas.pixels.size()};
+    if (!FitsMenuAtlasBudget(atlas, (size_t)sprite.width * sprite.height * sizeof(uint32_t))) {
+        return false;
+    }
+    for (int y = minY; y <= maxY; y++) {
+        const uint32_t* row = layer + (size_t)y * layerWidth;
+        atlas.pixels.insert(atlas.pixels.end(), row + minX, row + maxX + 1);
+    }
+    atlas.overlay.push_back(sprite);
+    return true;
+}
+
+// Alpha of everything drawn on `layer` as a mask, positioned relative to
+// (originX, originY). False if over budget.
+bool AddMaskSprite(MenuAtlas& atlas, const uint32_t* layer, int layerWidth, int layerHeight, int originX, int originY,
+                   MenuSprite& sprite) {
+    int minX = layerWidth, minY = layerHeight, maxX = -1, maxY = -1;
+    for (int y = 0; y < layerHeight; y++) {
+        for (int x = 0; x < layerWidth; x++) {
+            if (layer[(size_t)y * layerWidth + x] >> 24) {
+                minX = std::min(minX, x);
+                maxX = std::max(maxX, x);
+                minY = std::min(minY, y);
+                maxY = y;
+            }
+        }
+    }
+    sprite = {0, 0, 0, 0, atlas.masks.size()};
+    if (maxX < 0) {
+        return true;
+    }
+    sprite.x = minX - originX;
+    sprite.y = minY - originY;
+    sprite.width = maxX - minX + 1;
+    sprite.height = maxY - minY + 1;
+    if (!FitsMenuAtlasBudget(atlas, (size_t)sprite.width * sprite.height)) {
+        return false;
+    }
+    for (int y = minY; y <= maxY; y++) {
+        for (int x = minX; x <= maxX; x++) {
+            atlas.masks.push_back((uint8_t)(layer[(size_t)y * layerWidth + x] >> 24));
+        }
+    }
+    return true;
+}
+
+// Draw each part of the menu alone on a transparent layer and keep what
+// it drew. Sprites come first; the background only if it still fits.
+void BakeMenuAtlas(MenuAtlas& atlas, int clientWidth, int clientHeight) {
+    atlas.width = clientWidth;
+    atlas.height = clientHeight;
+    atlas.baked = true;
+    atlas.failed = false;
+    atlas.hasBackground = false;
+    atlas.overlay.clear();
+    atlas.pixels.clear();
+    atlas.masks.clear();
+    if (clientWidth < MENU_PARTICLE_LAYER_SIZE || clientHeight < MENU_PARTICLE_LAYER_SIZE) {
+        // Not worth baking, and an empty layer has no pixels to draw on
+        atlas.failed = true;
+        return;
+    }
+
+    std::vector<uint32_t> layer((size_t)clientWidth * clientHeight);
+    Bitmap bitmap(clientWidth, clientHeight, clientWidth * sizeof(uint32_t), PixelFormat32bppPARGB, (BYTE*)&layer[0]);
+    bool fits = true;
+    {
+        Graphics graphics(&bitmap);
+        graphics.SetSmoothingMode(SmoothingModeAntiAlias);
+        // ClearType needs an opaque background to blend against
+        graphics.SetTextRenderingHint(TextRenderingHintAntiAlias);
+        StringFormat& stringFormat = *gameFonts.centered;
+        SolidBrush white(Color(255, 255, 255, 255));
+
+        // Baked layers cost the same per frame whatever they hold, so
+        // bake them at full quality
+        int effectsTier = effects.tier;
+        effects.tier = EFFECTS_HIGH;
+        graphics.Clear(Color(0, 0, 0, 0));
+        DrawMenuDecorations(graphics, clientWidth, clientHeight);
+        graphics.Flush(FlushIntentionSync);
+        effects.tier = effectsTier;
+        for (int top = 0; fits && top < clientHeight; top += RASTER_TILE_SIZE) {
+            for (int left = 0; fits && left < clientWidth; left += RASTER_TILE_SIZE) {
+                fits = AddOverlaySprite(atlas, &layer[0], clientWidth, left, top,
+                                        std::min(left + RASTER_TILE_SIZE, clientWidth),
+                                        std::min(top + RASTER_TILE_SIZE, clientHeight));
+            }
+        }
+
+        // Particles are drawn at integer positions, so one mask per size
+        {
+            const int particleOrigin = MENU_PARTICLE_LAYER_SIZE / 2;
+            std::vector<uint32_t> particleLayer(MENU_PARTICLE_LAYER_SIZE * MENU_PARTICLE_LAYER_SIZE);
+            Bitmap particleBitmap(MENU_PARTICLE_LAYER_SIZE, MENU_PARTICLE_LAYER_SIZE,
+                                  MENU_PARTICLE_LAYER_SIZE * sizeof(uint32_t), PixelFormat32bppPARGB,
+                                  (BYTE*)&particleLayer[0]);
+            Graphics particleGraphics(&particleBitmap);
+            particleGraphics.SetSmoothingMode(SmoothingModeAntiAlias);
+            atlas.particles[0] = {0, 0, 0, 0, 0};
+            for (int size = 1; fits && size <= MENU_PARTICLE_MAX_SIZE; size++) {
+                particleGraphics.Clear(Color(0, 0, 0, 0));
+                particleGraphics.FillEllipse(&white, particleOrigin - size, particleOrigin - size, size * 2, size * 2);
+                particleGraphics.Flush(FlushIntentionSync);
+                fits = AddMaskSprite(atlas, &particleLayer[0], MENU_PARTICLE_LAYER_SIZE, MENU_PARTICLE_LAYER_SIZE,
+                                     particleOrigin, particleOrigin, atlas.particles[size]);
+            }
+        }
+
+        Font subtitleFont(gameFonts.family, 28, FontStyleRegular, UnitPixel);
+        graphics.Clear(Color(0, 0, 0, 0));
+        graphics.DrawString(MENU_SUBTITLE, -1, &subtitleFont, MenuSubtitleRect(clientWidth, clientHeight), &stringFormat, &white);
+        graphics.Flush(FlushIntentionSync);
+        fits = fits && AddMaskSprite(atlas, &layer[0], clientWidth, clientHeight, 0, 0, atlas.subtitle);
+
+        Font promptFont(gameFonts.family, 36, FontStyleBold, UnitPixel);
+        graphics.Clear(Color(0, 0, 0, 0));
+        graphics.DrawString(MENU_PROMPT, -1, &promptFont, MenuPromptRect(clientWidth, clientHeight, 0.0f), &stringFormat, &white);
+        graphics.Flush(FlushIntentionSync);
+        fits = fits && AddMaskSprite(atlas, &layer[0], clientWidth, clientHeight, 0, 0, atlas.prompt);
+
+        size_t backgroundBytes = (size_t)clientWidth * clientHeight * sizeof(uint32_t);
+        if (fits && backgroundImage && FitsMenuAtlasBudget(atlas, backgroundBytes)) {
+            graphics.Clear(Color(255, 0, 0, 0));
+            graphics.DrawImage(backgroundImage, 0, 0, clientWidth, clientHeight);
+            graphics.Flush(FlushIntentionSync);
+            atlas.background = {0, 0, clientWidth, clientHeight, atlas.pixels.size()};
+            atlas.pixels.insert(atlas.pixels.end(), layer.begin(), layer.end());
+            atlas.hasBackground = true;
+        }
+    }
+
+    // One raster command per overlay tile, particle and text layer. A frame
+    // must fit one batch: a GDI+ background under it is only flushed by
+    // DrawRasterBatch, so commands flushed early would end up under it.
+    int commands = (int)atlas.overlay.size() + MENU_PARTICLE_COUNT + 4;
+    if (!fits || commands > RASTER_MAX_COMMANDS) {
+        atlas.failed = true;
+        atlas.overlay.clear();
+        atlas.pixels.clear();
+        atlas.masks.clear();
+        atlas.pixels.shrink_to_fit();
+        atlas.masks.shrink_to_fit();
+        OutputDebugStringA("Pong: menu atlas over budget, drawing the menu live\n");
+    }
+}
+
+// A menu frame from the atlas at the current menuAnimTime. Everything but
+// a background image that didn't fit the budget is queued here.
+void QueueMenuFromAtlas(const MenuAtlas& atlas, int clientWidth, int clientHeight) {
+    if (atlas.hasBackground) {
+        RasterCopyImage(0, 0, clientWidth, clientHeight, atlas.pixels.data() + atlas.background.offset, clientWidth);
+    } else if (!backgroundImage) {
+        float colorShift = sin(menuAnimTime * 0.5f) * 20;
+        RasterShadedRect(0, 0, clientWidth, clientHeight,
+                           RasterColor(255, (int)(15 + colorShift), (int)(10 + colorShift), (int)(40 + colorShift)),
+                           RasterColor(255, (int)(40 + colorShift), (int)(10 + colorShift), (int)(60 + colorShift)));
+    }
+
+    for (int i = 0; i < MENU_PARTICLE_COUNT; i += CurrentEffects().particleStride) {
+        float x, y;
+        int size;
+        MenuParticle(i, menuAnimTime, clientWidth, clientHeight, x, y, size);
+        if (size < 1 || size > MENU_PARTICLE_MAX_SIZE) continue;
+        const MenuSprite& dot = atlas.particles[size];
+        RasterFillMask((int)x + dot.x, (int)y + dot.y, dot.width, dot.height, atlas.masks.data() + dot.offset, dot.width,
+                       RasterColor(60, 255, 255, 255));
+    }
+
+    for (size_t i = 0; i < atlas.overlay.size(); i++) {
+        const MenuSprite& tile = atlas.overlay[i];
+        RasterBlendImage(tile.x, tile.y, tile.width, tile.height, atlas.pixels.data() + tile.offset, tile.width);
+    }
+
+    const MenuSprite& subtitle = atlas.subtitle;
+    int subtitleAlpha = (int)(180 + sin(menuAnimTime * 2.0f) * 75);
+    RasterFillMask(subtitle.x, subtitle.y, subtitle.width, subtitle.height, atlas.masks.data() + subtitle.offset,
+                   subtitle.width, RasterColor(subtitleAlpha, 200, 200, 200));
+
+    // Text is baked at whole pixels, so the bounce is rounded
+    const MenuSprite& prompt = atlas.prompt;
+    int bounce = (int)floorf(sin(menuAnimTime * 3.0f) * 10 + 0.5f);
+    int promptAlpha = (int)(200 + sin(menuAnimTime * 4.0f) * 55);
+    if (EffectsGlowLayers(1) > 0) {
+        RasterFillMask(prompt.x, prompt.y + bounce - 2, prompt.width, prompt.height, atlas.masks.data() + prompt.offset,
+                       prompt.width, RasterColor(promptAlpha / 2, 255, 255, 100));
+    }
+    RasterFillMask(prompt.x, prompt.y + bounce, prompt.width, prompt.height, atlas.masks.data() + prompt.offset,
+                   prompt.width, RasterColor(promptAlpha, 255, 255, 255));
+}
+
+void DrawMenuScreen(Graphics& graphics, int clientWidth, int clientHeight) {
+    bool useAtlas = menuAtlasEnabled && rasterTarget.pixels &&
+                    rasterTarget.width == clientWidth && rasterTarget.height == clientHeight;
+    if (useAtlas && (!menuAtlas.baked || menuAtlas.width != clientWidth || menuAtlas.height != clientHeight)) {
+        // Re-baking takes several frames' worth of time, so during a
+        // resize draw live and wait for the size to settle
+        LONGLONG now = QueryCounter();
+        if (menuAtlas.pendingWidth != clientWidth || menuAtlas.pendingHeight != clientHeight) {
+            menuAtlas.pendingWidth = clientWidth;
+            menuAtlas.pendingHeight = clientHeight;
+            menuAtlas.pendingSince = now;
+        }
+        if (!menuAtlas.baked || CounterToMs(now - menuAtlas.pendingSince) >= MENU_ATLAS_REBAKE_DELAY_MS) {
+            BakeMenuAtlas(menuAtlas, clientWidth, clientHeight);
+        } else {
+            useAtlas = false;
+        }
+    }
+    if (!useAtlas || menuAtlas.failed) {
+        DrawMenuLive(graphics, clientWidth, clientHeight);
+        return;
+    }
+    if (!menuAtlas.hasBackground && backgroundImage) {
+        DrawMenuBackground(graphics, clientWidth, clientHeight);
+    }
+    QueueMenuFromAtlas(menuAtlas, clientWidth, clientHeight);
+    DrawRasterBatch(graphics);
+}
+
+LRESULT CALLBACK WindowProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam) {
+    switch (msg) {
+        case WM_DESTROY:
+            PostQuitMessage(0);
+            return 0;
+        case WM_SIZE:
+            windowMinimized = (wparam == SIZE_MINIMIZED);
+            redrawRequested = true;
+            fullPresentRequired = true;
+            return 0;
+        case WM_DISPLAYCHANGE:
+            UpdateDisplayRefresh(hwnd);
+            fullPresentRequired = true;
+            return 0;
+        case WM_KEYDOWN:
+            // Show the effect of a key press without waiting for the next tick
+            redrawRequested = true;
+            if (latencyHarness.running && lparam != LATENCY_INJECTED_LPARAM && wparam != VK_F8) {
+                FinishLatencyHarness(hwnd, "a key was pressed");
+            }
+            if (wparam == 'W' || wparam == 'w') {
+                wKeyPressed = true;
+            } else if (wparam == 'S' || wparam == 's') {
+                sKeyPressed = true;
+            } else if (wparam == VK_UP) {
+                upKeyPressed = true;
+            } else if (wparam == VK_DOWN) {
+                downKeyPressed = true;
+            } else if (wparam == VK_ESCAPE) {
+                PostQuitMessage(0);
+            } else if (wparam == VK_F8 && gameState == PLAYING && !latencyHarness.running) {
+                StartLatencyHarness(hwnd, false);
+            } else if (wparam == VK_LEFT && gameState == DIFFICULTY_SELECT) {
+                if (selectedDifficulty > 0) {
+                    selectedDifficulty--;
+                    selectionAnimTime = 0.0f;
+                    PostSound(SOUND_MENU_MOVE, 1.0f, -0.3f);
+                }
+            } else if (wparam == VK_RIGHT && gameState == DIFFICULTY_SELECT) {
+                if (selectedDifficulty < 2) {
+                    selectedDifficulty++;
+                    selectionAnimTime = 0.0f;
+                    PostSound(SOUND_MENU_MOVE, 1.0f, 0.3f);
+                }
+            } else if (wparam == 'P' || wparam == 'p') {
+                if (gameState == PLAYING) {
+                    gameState = PAUSED;
+                    pauseMenuSelection = 0; // Default to resume
+                    isCountingDown = false;
+                    countdownTimer = 0.0f;
+                    pauseAnimTime = 0.0f;
+                    pauseStartCounter = QueryCounter();
+                    RecordTelemetry(TELEMETRY_PAUSE, 0, 0.0f, 0.0f);
+                    PostSound(SOUND_MENU_SELECT, 1.0f, 0.0f);
+                }
+            } else if (wparam == VK_LEFT && gameState == PAUSED && !isCountingDown) {
+                if (pauseMenuSelection > 0) {
+                    pauseMenuSelection--;
+                    PostSound(SOUND_MENU_MOVE, 1.0f, -0.3f);
+                }
+            } else if (wparam == VK_RIGHT && gameState == PAUSED && !isCountingDown) {
+                if (pauseMenuSelection < 1) {
+                    pauseMenuSelection++;
+                    PostSound(SOUND_MENU_MOVE, 1.0f, 0.3f);
+                }
+            } else if (wparam == VK_RETURN && gameState == PAUSED && !isCountingDown) {
+                PostSound(SOUND_MENU_SELECT, 1.0f, 0.0f);
+                if (pauseMenuSelection == 0) { // Resume
+                    isCountingDown = true;
+                    countdownTimer = 2.0f;
+                    PostSound(SOUND_COUNTDOWN, 1.0f, 0.0f);
+                } else if (pauseMenuSelection == 1) { // Exit to menu
+                    RecordTelemetry(TELEMETRY_PAUSE_END, 1, SecondsPaused(), 0.0f);
+                    ReleasePauseBackdrop();
+                    gameState = MENU;
+                    selectedDifficulty = -1;
+                    ResetMatch(match, WINDOW_WIDTH, WINDOW_HEIGHT);
+                    partyBalls.count = 0;
+                }
+            } else if ((wparam == 'M' || wparam == 'm') && gameState == DIFFICULTY_SELECT) {
+                partyMode = !partyMode;
+                PostSound(SOUND_MENU_MOVE, 1.0f, 0.0f);
+            } else if (wparam == VK_RETURN && gameState == DIFFICULTY_SELECT) {
+                // Start game with selected difficulty
+                gameState = PLAYING;
+                PostSound(SOUND_MENU_SELECT, 1.0f, 0.0f);
+                // Reset game state
+                ResetMatch(match, WINDOW_WIDTH, WINDOW_HEIGHT);
+                partyBalls.count = 0;
+                if (partyMode) {
+                    SpawnPartyBalls(partyBalls, PARTY_BALL_COUNT, WINDOW_WIDTH, WINDOW_HEIGHT);
+                }
+                SyncSimulation();
+                
+                // Set difficulty parameters
+                if (selectedDifficulty == 0) { // Easy
+                    currentSpeedFactor = 1.25f;
+                    currentPaddleSpeed = PADDLE_SPEED;
+                } else if (selectedDifficulty == 1) { // Medium
+                    currentSpeedFactor = 1.45f;
+                    currentPaddleSpeed = PADDLE_SPEED + 3;
+                } else if (selectedDifficulty == 2) { // Hard
+                    currentSpeedFactor = 1.70f;
+                    currentPaddleSpeed = PADDLE_SPEED + 6;
+                }
+            }
+            
+            if (gameState == MENU) {
+                gameState = DIFFICULTY_SELECT;
+                selectedDifficulty = 0; // Default to easy
+                selectionAnimTime = 0.0f;
+                PostSound(SOUND_MENU_SELECT, 1.0f, 0.0f);
+            }
+            return 0;
+        case WM_KEYUP:
+            if (latencyHarness.running && lparam != LATENCY_INJECTED_LPARAM && wparam != VK_F8) {
+                FinishLatencyHarness(hwnd, "a key was released");
+            }
+            if (wparam == 'W' || wparam == 'w') {
+                wKeyPressed = false;
+            } else if (wparam == 'S' || wparam == 's') {
+                sKeyPressed = false;
+            } else if (wparam == VK_UP) {
+                upKeyPressed = false;
+            } else if (wparam == VK_DOWN) {
+                downKeyPressed = false;
+            }
+            return 0;
+        case WM_PAINT: {
+            PAINTSTRUCT ps;
+            HDC hdc = BeginPaint(hwnd, &ps);
+            LONGLONG paintStart = QueryCounter();
+            UpdateFrameDelta();
+            telemetryTick++;
+            RecordTelemetry(TELEMETRY_FRAME, gameState, frameDeltaSeconds * 1000.0f, 0.0f);
+
+            // A paint we didn't schedule means the system wants (part of)
+            // the window restored, so present the whole back buffer
+            if (!paintScheduled) {
+                fullPresentRequired = true;
+            }
+            paintScheduled = false;
+            
+            // Draw into the persistent back buffer (prevents flickering)
+            RECT rect;
+            GetClientRect(hwnd, &rect);
+            int clientWidth = rect.right - rect.left;
+            int clientHeight = rect.bottom - rect.top;
+            HDC memDC = AcquireBackBuffer(hdc, clientWidth, clientHeight);
+            SetRasterTarget(backBufferPixels, clientWidth, clientHeight, clientWidth);
+
+            // Every state except PLAYING draws full frames
+            dirtyRectCount = -1;
+            if (gameState != PLAYING) {
+                playfieldValid = false;
+            }
+            
+            Graphics& graphics = *backBufferGraphics;
+            graphics.SetSmoothingMode(CurrentEffects().antiAlias ? SmoothingModeAntiAlias : SmoothingModeNone);
+
+            // Shared font objects
+            FontFamily& fontFamily = *gameFonts.family;
+            StringFormat& stringFormat = *gameFonts.centered;
+
+            // PLAYING and PAUSED frames must not touch the heap once the
+            // state has been entered
+            long long allocationsBefore = threadHeapAllocations;
+            GameState paintedState = gameState;
+
+            if (gameState == MENU) {
+                // Update animation time
+                menuAnimTime += 1.8f * frameDeltaSeconds;
+                DrawMenuScreen(graphics, clientWidth, clientHeight);
+
+            } else if (gameState == DIFFICULTY_SELECT) {
+                // Draw background image for difficulty selection
+                if (backgroundImage) {
+                    graphics.DrawImage(backgroundImage, 0, 0, clientWidth, clientHeight);
+                } else {
+                    // Fallback to gradient background
+                    RasterShadedRect(0, 0, clientWidth, clientHeight, RasterColor(255, 10, 10, 30), RasterColor(255, 30, 10, 50));
+                }
+
+                // Update animation time
+                selectionAnimTime += 3.0f * frameDeltaSeconds;
+
+                // Draw animated particles/dots around the screen (they never reach
+                // the corner brackets, so they can go first)
+                for (int i = 0; i < 15; i += CurrentEffects().particleStride) {
+                    float angle = selectionAnimTime + (i * 3.14159f * 2.0f / 15.0f);
+                    float x = clientWidth / 2 + cos(angle) * 350;
+                    float y = clientHeight / 2 + sin(angle) * 250;
+                    RasterFillEllipse((int)x - 3, (int)y - 3, 6, 6, RasterColor(100, 255, 255, 255));
+                }
+                DrawRasterBatch(graphics);
+
+                // Draw decorative elements - animated corner brackets
+                Pen decorPen(Color(255, 100, 200, 255), 3);
+                int bracketSize = 40;
+                int margin = 30;
+                
+                // Top-left bracket
+                graphics.DrawLine(&decorPen, margin, margin, margin + bracketSize, margin);
+                graphics.DrawLine(&decorPen, margin, margin, margin, margin + bracketSize);
+                
+                // Top-right bracket
+                graphics.DrawLine(&decorPen, clientWidth - margin, margin, clientWidth - margin - bracketSize, margin);
+                graphics.DrawLine(&decorPen, clientWidth - margin, margin, clientWidth - margin, margin + bracketSize);
+                
+                // Bottom-left bracket
+                graphics.DrawLine(&decorPen, margin, clientHeight - margin, margin + bracketSize, clientHeight - margin);
+                graphics.DrawLine(&decorPen, margin, clientHeight - margin, margin, clientHeight - margin - bracketSize);
+                
+                // Bottom-right bracket
+                graphics.DrawLine(&decorPen, clientWidth - margin, clientHeight - margin, clientWidth - margin - bracketSize, clientHeight - margin);
+                graphics.DrawLine(&decorPen, clientWidth - margin, clientHeight - margin, clientWidth - margin, clientHeight - margin - bracketSize);
+
+                // Draw difficulty selection menu with enhanced styling
+                Font titleFont(&fontFamily, 64, FontStyleBold, UnitPixel);
+                Font optionFont(&fontFamily, 44, FontStyleBold, UnitPixel);
+                Font descFont(&fontFamily, 18, FontStyleRegular, UnitPixel);
+                SolidBrush titleBrush(Color(255, 255, 255, 255)); // White text
+
+                // Draw glowing title with shadow
+                SolidBrush shadowBrush(Color(150, 0, 0, 0));
+                RectF titleShadowRect(3, 73, clientWidth, 80);
+                graphics.DrawString(L"SELECT DIFFICULTY", -1, &titleFont, titleShadowRect, &stringFormat, &shadowBrush);
+                
+                RectF titleRect(0, 70, clientWidth, 80);
+                LinearGradientBrush titleGradient(
+                    Point(clientWidth / 2, 70),
+                    Point(clientWidth / 2, 150),
+                    Color(255, 255, 200, 100),
+                    Color(255, 255, 255, 255)
+                );
+                SolidBrush titleFlat(Color(255, 255, 227, 177));
+                Brush* titleFill = CurrentEffects().gradients ? (Brush*)&titleGradient : &titleFlat;
+                graphics.DrawString(L"SELECT DIFFICULTY", -1, &titleFont, titleRect, &stringFormat, titleFill);
+
+                // Draw decorative line under title
+                Pen linePen(Color(255, 100, 200, 255), 2);
+                graphics.DrawLine(&linePen, clientWidth / 2 - 200, 170, clientWidth / 2 + 200, 170);
+
+                // Party mode toggle
+                SolidBrush partyBrush(partyMode ? Color(255, 255, 220, 100) : Color(180, 200, 200, 200));
+                RectF partyRect(0, 182, clientWidth, 30);
+                graphics.DrawString(partyMode ? L"PARTY MODE ON  •  M to toggle" : L"Press M for PARTY MODE", -1,
+                                    &descFont, partyRect, &stringFormat, &partyBrush);
+
+                // Draw difficulty options with cards
+                int cardWidth = 280;
+                int cardHeight = 220;
+                int optionY = 280;
+                int totalWidth = cardWidth * 3 + 100; // 3 cards with 50px spacing
+                int startX = (clientWidth - totalWidth) / 2;
+
+                const wchar_t* difficultyNames[] = {L"EASY", L"MEDIUM", L"HARD"};
+                const wchar_t* difficultyDescs[] = {
+                    L"Relaxed pace\nPerfect for beginners",
+                    L"Balanced challenge\nFor experienced players",
+                    L"Lightning fast\nUltimate test of skill"
+                };
+                Color cardColors[] = {
+                    Color(255, 50, 200, 100),   // Cyan for Easy
+                    Color(255, 255, 200, 50),   // Yellow for Medium
+                    Color(255, 255, 50, 50)     // Red for Hard
+                };
+
+                // Card glows, backgrounds and icons go through the tile
+                // rasterizer; borders and text are drawn over them below
+                for (int i = 0; i < 3; i++) {
+                    int cardX = startX + i * (cardWidth + 50);
+                    float pulse = (i == selectedDifficulty) ? sin(selectionAnimTime * 5.0f) * 0.15f + 0.85f : 0.5f;
+                    uint32_t cardRgb = cardColors[i].GetValue() & 0x00FFFFFFu;
+
+                    // Draw card background with glow effect
+                    if (i == selectedDifficulty && EffectsGlowLayers(1) > 0) {
+                        RasterFillRect(cardX - 10, optionY - 10, cardWidth + 20, cardHeight + 20,
+                                       cardRgb | ((uint32_t)(int)(100 * pulse) << 24));
+                    }
+                    RasterFillRect(cardX, optionY, cardWidth, cardHeight, RasterColor((int)(150 * pulse), 20, 20, 40));
+
+                    // Draw difficulty icon/symbol
+                    uint32_t iconColor = cardRgb | ((uint32_t)(int)(200 * pulse) << 24);
+                    int iconY = optionY + 30;
+                    if (i == 0) { // Easy - single bar
+                        RasterFillRect(cardX + cardWidth / 2 - 10, iconY, 20, 40, iconColor);
+                    } else if (i == 1) { // Medium - two bars
+                        RasterFillRect(cardX + cardWidth / 2 - 25, iconY + 10, 20, 40, iconColor);
+                        RasterFillRect(cardX + cardWidth / 2 + 5, iconY, 20, 50, iconColor);
+                    } else { // Hard - three bars
+                        RasterFillRect(cardX + cardWidth / 2 - 35, iconY + 20, 20, 30, iconColor);
+                        RasterFillRect(cardX + cardWidth / 2 - 10, iconY + 10, 20, 40, iconColor);
+                        RasterFillRect(cardX + cardWidth / 2 + 15, iconY, 20, 50, iconColor);
+                    }
+                }
+                DrawRasterBatch(graphics);
+
+                for (int i = 0; i < 3; i++) {
+                    int cardX = startX + i * (cardWidth + 50);
+                    
+                    // Calculate pulse effect for selected card
+                    float pulse = 0.0f;
+                    float scale = 1.0f;
+                    if (i == selectedDifficulty) {
+                        pulse = sin(selectionAnimTime * 5.0f) * 0.15f + 0.85f;
+                        scale = 1.05f + sin(selectionAnimTime * 3.0f) * 0.02f;
+                    } else {
+                        pulse = 0.5f;
+                        scale = 0.95f;
+                    }
+
+                    // Card border
+                    Pen borderPen(Color((int)(255 * pulse), cardColors[i].GetR(), cardColors[i].GetG(), cardColors[i].GetB()), 
+                                  i == selectedDifficulty ? 4 : 2);
+                    graphics.DrawRectangle(&borderPen, cardX, optionY, cardWidth, cardHeight);
+
+                    // Draw difficulty name
+                    Font cardTitleFont(&fontFamily, 36, FontStyleBold, UnitPixel);
+                    SolidBrush textBrush(Color((int)(255 * pulse), 255, 255, 255));
+                    RectF nameRect(cardX, optionY + 90, cardWidth, 50);
+                    graphics.DrawString(difficultyNames[i], -1, &cardTitleFont, nameRect, &stringFormat, &textBrush);
+
+                    // Draw difficulty description
+                    SolidBrush descBrush(Color((int)(200 * pulse), 200, 200, 200));
+                    RectF descRect(cardX + 10, optionY + 145, cardWidth - 20, 60);
+                    graphics.DrawString(difficultyDescs[i], -1, &descFont, descRect, &stringFormat, &descBrush);
+
+                    // Draw selection arrow above selected card
+                    if (i == selectedDifficulty) {
+                        SolidBrush arrowBrush(Color(255, 255, 255, 100));
+                        Point arrowPoints[3];
+                        int arrowX = cardX + cardWidth / 2;
+                        int arrowY = optionY - 30;
+                        arrowPoints[0] = Point(arrowX, arrowY + (int)(sin(selectionAnimTime * 4.0f) * 5.0f));
+                        arrowPoints[1] = Point(arrowX - 15, arrowY - 20 + (int)(sin(selectionAnimTime * 4.0f) * 5.0f));
+                        arrowPoints[2] = Point(arrowX + 15, arrowY - 20 + (int)(sin(selectionAnimTime * 4.0f) * 5.0f));
+                        graphics.FillPolygon(&arrowBrush, arrowPoints, 3);
+                    }
+                }
+
+                // Draw instructions at bottom with icon hints
+                Font instructionFont(&fontFamily, 22, FontStyleBold, UnitPixel);
+                SolidBrush instructionBrush(Color(255, 200, 200, 200));
+                
+                // Draw keyboard icons
+                SolidBrush keyBrush(Color(255, 60, 60, 80));
+                Pen keyPen(Color(255, 150, 150, 150), 2);
+                int keySize = 35;
+                int keyY = clientHeight - 100;
+                
+                // Left arrow key
+                graphics.FillRectangle(&keyBrush, clientWidth / 2 - 150, keyY, keySize, keySize);
+                graphics.DrawRectangle(&keyPen, clientWidth / 2 - 150, keyY, keySize, keySize);
+                RectF leftArrowRect(clientWidth / 2 - 150, keyY, keySize, keySize);
+                Font arrowFont(&fontFamily, 20, FontStyleBold, UnitPixel);
+                graphics.DrawString(L"◄", -1, &arrowFont, leftArrowRect, &stringFormat, &instructionBrush);
+                
+                // Right arrow key
+                graphics.FillRectangle(&keyBrush, clientWidth / 2 + 115, keyY, keySize, keySize);
+                graphics.DrawRectangle(&keyPen, clientWidth / 2 + 115, keyY, keySize, keySize);
+                RectF rightArrowRect(clientWidth / 2 + 115, keyY, keySize, keySize);
+                graphics.DrawString(L"►", -1, &arrowFont, rightArrowRect, &stringFormat, &instructionBrush);
+                
+                // Enter key (wider)
+                graphics.FillRectangle(&keyBrush, clientWidth / 2 - 40, keyY, keySize * 2, keySize);
+                graphics.DrawRectangle(&keyPen, clientWidth / 2 - 40, keyY, keySize * 2, keySize);
+                RectF enterRect(clientWidth / 2 - 40, keyY, keySize * 2, keySize);
+                Font enterFont(&fontFamily, 14, FontStyleBold, UnitPixel);
+                graphics.DrawString(L"ENTER", -1, &enterFont, enterRect, &stringFormat, &instructionBrush);
+
+                // Instruction text
+                RectF instructionRect(0, clientHeight - 50, clientWidth, 40);
+                graphics.DrawString(L"Navigate with ARROWS  •  Confirm with ENTER  •  ESC to Quit", -1, &instructionFont, instructionRect, &stringFormat, &instructionBrush);
+
+            } else if (gameState == PAUSED) {
+                // Update animation time
+                pauseAnimTime += 3.0f * frameDeltaSeconds;
+
+                // Decorative frame around pause menu
+                int frameWidth = PAUSE_FRAME_WIDTH;
+                int frameHeight = PAUSE_FRAME_HEIGHT;
+                int frameX, frameY;
+                PauseFrameRect(clientWidth, clientHeight, frameX, frameY);
+
+                // The frozen game, gradient overlay and glow layers are
+                // captured on the first paused frame and again after a
+                // resize. Nothing advances drawnMatch while paused, so it
+                // is still what the last gameplay frame showed.
+                if (!PauseBackdropMatches(clientWidth, clientHeight)) {
+                    DrawPlayfield(graphics, drawnMatch, clientWidth, clientHeight, gameFonts.score, &stringFormat);
+                    graphics.Flush(FlushIntentionSync);
+                    GdiFlush();
+                    CapturePauseBackdrop(clientWidth, clientHeight);
+                }
+
+                // Backdrop, then the animated particles and the frame
+                // background over it
+                if (PauseBackdropMatches(clientWidth, clientHeight)) {
+                    RasterCopyImage(0, 0, clientWidth, clientHeight, pauseBackdrop.pixels.data(), clientWidth);
+                } else {
+                    QueuePauseBackdrop(clientWidth, clientHeight, frameX, frameY, frameWidth, frameHeight);
+                }
+                QueuePauseParticles(clientWidth, clientHeight, frameX, frameY, frameWidth, frameHeight);
+                DrawRasterBatch(graphics);
+
+                graphics.DrawRectangle(LinePen(Color(255, 100, 200, 255), 4), frameX, frameY, frameWidth, frameHeight);
+
+                // Draw corner accents
+                int accentSize = 30;
+                Pen* accentPen = LinePen(Color(255, 255, 255, 100), 6);
+                
+                // Top-left corner
+                graphics.DrawLine(accentPen, frameX, frameY, frameX + accentSize, frameY);
+                graphics.DrawLine(accentPen, frameX, frameY, frameX, frameY + accentSize);
+                
+                // Top-right corner
+                graphics.DrawLine(accentPen, frameX + frameWidth, frameY, frameX + frameWidth - accentSize, frameY);
+                graphics.DrawLine(accentPen, frameX + frameWidth, frameY, frameX + frameWidth, frameY + accentSize);
+                
+                // Bottom-left corner
+                graphics.DrawLine(accentPen, frameX, frameY + frameHeight, frameX + accentSize, frameY + frameHeight);
+                graphics.DrawLine(accentPen, frameX, frameY + frameHeight, frameX, frameY + frameHeight - accentSize);
+                
+                // Bottom-right corner
+                graphics.DrawLine(accentPen, frameX + frameWidth, frameY + frameHeight, frameX + frameWidth - accentSize, frameY + frameHeight);
+                graphics.DrawLine(accentPen, frameX + frameWidth, frameY + frameHeight, frameX + frameWidth, frameY + frameHeight - accentSize);
+
+                // Draw pause title with glow and pulsing effect
+                Font& pauseTitleFont = *gameFonts.pauseTitle;
+                float titlePulse = 0.9f + sin(pauseAnimTime * 3.0f) * 0.1f;
+                
+                // Multiple glow layers for title
+                for (int i = EffectsGlowLayers(5); i > 0; i--) {
+                    int alpha = (int)((60 - i * 10) * titlePulse);
+                    RectF glowRect(frameX - i * 3, frameY + 40 - i * 2, frameWidth + i * 6, 100);
+                    graphics.DrawString(L"⏸ PAUSED", -1, &pauseTitleFont, glowRect, &stringFormat,
+                                        FillBrush(Color(alpha, 255, 100, 100)));
+                }
+                
+                // Main title with gradient
+                RectF pauseTitleRect(frameX, frameY + 40, frameWidth, 100);
+                PreparePauseGradients(frameX, frameY, frameWidth);
+                Brush* titleFill = FillBrush(Color((int)(255 * titlePulse), 255, 125, 125));
+                if (CurrentEffects().gradients) {
+                    gameBrushes.pauseTitle->SetLinearColors(Color((int)(255 * titlePulse), 255, 150, 150),
+                                                            Color((int)(255 * titlePulse), 255, 100, 100));
+                    titleFill = gameBrushes.pauseTitle;
+                }
+                graphics.DrawString(L"⏸ PAUSED", -1, &pauseTitleFont, pauseTitleRect, &stringFormat, titleFill);
+
+                // Draw decorative line under title
+                int dividerY = frameY + 160;
+                graphics.DrawLine(LinePen(Color(200, 100, 200, 255), 2), frameX + 50, dividerY, frameX + frameWidth - 50, dividerY);
+
+                if (isCountingDown) {
+                    // Update countdown timer
+                    UpdateResumeCountdown(frameDeltaSeconds);
+
+                    // Draw countdown with elaborate effects
+                    int countdown = (int)countdownTimer + 1;
+                    if (countdown > 3) countdown = 3;
+                    
+                    Font& countdownFont = *gameFonts.countdown;
+                    const wchar_t* countdownStr = IntToWString(countdown);
+                    
+                    // Countdown animation effects
+                    float countdownScale = 1.0f + (1.0f - (countdownTimer - (int)countdownTimer)) * 0.3f;
+                    int countdownAlpha = (int)(255 * (0.3f + (countdownTimer - (int)countdownTimer) * 0.7f));
+                    
+                    // Outer glow rings
+                    for (int ring = EffectsGlowLayers(5); ring > 0; ring--) {
+                        int ringAlpha = (int)((100 - ring * 15) * (countdownTimer - (int)countdownTimer));
+                        RectF ringRect(frameX - ring * 5, frameY + 200 - ring * 5, frameWidth + ring * 10, 200);
+                        graphics.DrawString(countdownStr, -1, &countdownFont, ringRect, &stringFormat,
+                                            FillBrush(Color(ringAlpha, 100, 255, 100)));
+                    }
+                    
+                    // Main countdown number with gradient
+                    RectF countdownRect(frameX, frameY + 200, frameWidth, 200);
+                    Brush* countdownFill = FillBrush(Color(countdownAlpha, 100, 255, 177));
+                    if (CurrentEffects().gradients) {
+                        gameBrushes.countdown->SetLinearColors(Color(countdownAlpha, 100, 255, 255),
+                                                               Color(countdownAlpha, 100, 255, 100));
+                        countdownFill = gameBrushes.countdown;
+                    }
+                    graphics.DrawString(countdownStr, -1, &countdownFont, countdownRect, &stringFormat, countdownFill);
+
+                    // Draw "Resuming..." text
+                    Font& resumingFont = *gameFonts.resuming;
+                    RectF resumingRect(frameX, frameY + 420, frameWidth, 40);
+                    graphics.DrawString(L"Resuming game...", -1, &resumingFont, resumingRect, &stringFormat,
+                                        FillBrush(Color(200, 200, 200, 200)));
+
+                } else {
+                    // Draw menu options with cards
+                    int optionY = frameY + 220;
+                    int optionWidth = 400;
+                    int optionHeight = 90;
+                    int optionX = frameX + (frameWidth - optionWidth) / 2;
+                    int optionSpacing = 120;
+
+                    // Option glows and backgrounds
+                    QueuePauseOptions(optionX, optionY, optionWidth, optionHeight, optionSpacing);
+                    DrawRasterBatch(graphics);
+
+                    const wchar_t* optionTexts[] = {L"▶ RESUME", L"🏠 MAIN MENU"};
+                    Color optionColors[] = {
+                        Color(255, 100, 255, 100),  // Green for Resume
+                        Color(255, 255, 100, 100)   // Red for Menu
+                    };
+
+                    for (int i = 0; i < 2; i++) {
+                        int currentY = optionY + i * optionSpacing;
+                        bool isSelected = (pauseMenuSelection == i);
+                        
+                        // Calculate pulse effect
+                        float pulse = isSelected ? (0.85f + sin(pauseAnimTime * 5.0f) * 0.15f) : 0.4f;
+                        
+                        // Draw option border
+                        Pen* optionPen = LinePen(Color((int)(255 * pulse), optionColors[i].GetR(), optionColors[i].GetG(), optionColors[i].GetB()),
+                                                 isSelected ? 5 : 2);
+                        graphics.DrawRectangle(optionPen, optionX, currentY, optionWidth, optionHeight);
+                        
+                        // Draw selection indicator (animated arrow)
+                        if (isSelected) {
+                            float arrowOffset = sin(pauseAnimTime * 6.0f) * 8;
+                            
+                            Point arrowPoints[3];
+                            arrowPoints[0] = Point((int)(optionX - 25 + arrowOffset), currentY + optionHeight / 2);
+                            arrowPoints[1] = Point((int)(optionX - 40 + arrowOffset), currentY + optionHeight / 2 - 12);
+                            arrowPoints[2] = Point((int)(optionX - 40 + arrowOffset), currentY + optionHeight / 2 + 12);
+                            graphics.FillPolygon(FillBrush(Color(255, 255, 255, 200)), arrowPoints, 3);
+                        }
+                        
+                        // Draw option text
+                        Font& optionFont = *gameFonts.pauseOption;
+                        RectF textRect(optionX, currentY, optionWidth, optionHeight);
+                        graphics.DrawString(optionTexts[i], -1, &optionFont, textRect, &stringFormat,
+                                            FillBrush(Color((int)(255 * pulse), 255, 255, 255)));
+                    }
+
+                    // Draw instructions at bottom with enhanced styling
+                    Font& instructionFont = *gameFonts.pauseHint;
+                    RectF instructionRect(frameX, frameY + frameHeight - 60, frameWidth, 40);
+                    graphics.DrawString(L"Use ← → to navigate  •  Press ENTER to select  •  P to resume", 
+                                      -1, &instructionFont, instructionRect, &stringFormat, FillBrush(Color(180, 200, 200, 200)));
+
+                    // Draw tip text
+                    Font& tipFont = *gameFonts.pauseTip;
+                    RectF tipRect(frameX, frameY + frameHeight - 30, frameWidth, 25);
+                    graphics.DrawString(L"💡 Take a break, champion!", -1, &tipFont, tipRect, &stringFormat,
+                                        FillBrush(Color(150, 150, 150, 150)));
+                }
+
+            } else {
+                // Game is playing - run the simulation ticks this frame
+                // covers and draw between the last two
+                MatchInput input = { wKeyPressed, sKeyPressed, upKeyPressed, downKeyPressed };
+                AdvanceSimulation(frameDeltaSeconds, input, clientWidth, clientHeight);
+                if (partyBalls.count > 0) {
+                    // Too many moving parts for dirty rects to pay off
+                    playfieldValid = false;
+                }
+
+                CollectPlayfieldDirtyRects(drawnMatch, clientWidth, clientHeight);
+                DrawPlayfield(graphics, drawnMatch, clientWidth, clientHeight, gameFonts.score, &stringFormat);
+            }
+
+            // Steady-state gameplay frames must not allocate; report any
+            // that do (the first frame after a state change may warm up)
+            if ((paintedState == PLAYING || paintedState == PAUSED) && paintedState == lastPaintedState &&
+                threadHeapAllocations != allocationsBefore) {
+                frameAllocationViolations++;
+                OutputDebugStringA("Pong: heap allocation during a steady-state frame\n");
+            }
+            lastPaintedState = paintedState;
+            ResetFrameArena();
+
+            // Copy from memory DC to screen (eliminates flickering) - just
+            // the dirty rects when the screen already shows the rest
+            if (dirtyRectCount < 0 || fullPresentRequired) {
+                BitBlt(hdc, 0, 0, clientWidth, clientHeight, memDC, 0, 0, SRCCOPY);
+                fullPresentRequired = false;
+            } else {
+                for (int i = 0; i < dirtyRectCount; i++) {
+                    const RECT& dirty = dirtyRects[i];
+                    BitBlt(hdc, dirty.left, dirty.top, dirty.right - dirty.left, dirty.bottom - dirty.top,
+                           memDC, dirty.left, dirty.top, SRCCOPY);
+                }
+            }
+            OnFramePresented(hwnd);
+
+            // --slow-render: pretend every effect costs more
+            if (slowRenderMs > 0.0f) {
+                float extraMs = slowRenderMs * (effects.tier + 1) / EFFECTS_TIER_COUNT;
+                while (CounterToMs(QueryCounter() - paintStart) < extraMs) {
+                }
+            }
+            if (effectsAdaptive &&
+                UpdateEffectsGovernor(effects, (float)CounterToMs(QueryCounter() - paintStart), frameDeltaSeconds)) {
+                RecordTelemetry(TELEMETRY_EFFECTS_TIER, effects.tier, effects.changeAverageMs, 0.0f);
+                // Anti-aliasing may have changed, so redraw all of PLAYING
+                playfieldValid = false;
+            }
+            
+            EndPaint(hwnd, &ps);
+            return 0;
+        }
+        case WM_ERASEBKGND:
+            // Prevent background erasing to reduce flicker
+            return 1;
+        default:
+            return DefWindowProc(hwnd, msg, wparam, lparam);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Headless tournament host
+//
+// Runs many independent bot-vs-bot matches without a window. Every active
+// match is stepped once per fixed tick; the steps are spread over a
+// work-stealing thread pool and any match whose step finishes after the
+// tick deadline is counted as a missed tick. Matches are organised as a
+// single-elimination bracket: winners of one round meet in the next.
+//
+//   game.exe --tournament <players> [--threads N] [--fast]
+//   game.exe --host-scaling <players>
+// ---------------------------------------------------------------------------
+
+const int HOST_TICK_RATE = 60;
+const int HOST_WINNING_SCORE = 5;
+const int HOST_MAX_TICKS_PER_MATCH = HOST_TICK_RATE * 60 * 3; // 3 minutes of game time
+const int HOST_MATCHES_PER_CHUNK = 16;
+const int HOST_IDLE_SPINS = 64;  // yields before an idle worker goes to sleep
+
+// Fixed-size pool that runs one parallel loop at a time on the calling
+// thread plus threadCount - 1 workers. The loop's items are cut into chunks
+// and every thread starts with an even, contiguous share of the chunks in
+// its own deque. A thread pops chunks from the front of its own deque and,
+// once that is empty, steals from the back of a sibling's, so uneven chunks
+// still spread across cores. Each deque is a [front, back) range packed
+// into one atomic word, so a pop or a steal is a single compare-exchange
+// and no lock is taken while a loop runs. Workers only block on the
+// condition variable once they have been idle for a while, and the caller
+// only takes the lock to wake them when one of them is actually asleep.
+class WorkStealingPool {
+public:
+    typedef void (*ChunkFunction)(void* context, int first, int last);
+
+    explicit WorkStealingPool(int threadCount) {
+        if (threadCount < 1) threadCount = 1;
+        deques.reset(new ChunkDeque[threadCount]);
+        dequeCount = threadCount;
+        for (int i = 1; i < threadCount; i++) {
+            threads.push_back(std::thread(&WorkStealingPool::WorkerLoop, this, i));
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(wakeLock);
+            stopping = true;
+        }
+        wakeSignal.notify_all();
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i].join();
+        }
+    }
+
+    int ThreadCount() const { return dequeCount; }
+
+    // Call function(context, first, last) over [0, itemCount) in chunks of
+    // chunkSize items and return once every chunk has run
+    void Run(int itemCount, int chunkSize, ChunkFunction function, void* context) {
+        int chunkCount = (itemCount + chunkSize - 1) / chunkSize;
+        if (chunkCount == 0) return;
+
+        loopFunction = function;
+        loopContext = context;
+        loopItems = itemCount;
+        loopChunkSize = chunkSize;
+        remainingChunks.store(chunkCount, std::memory_order_relaxed);
+        for (int i = 0; i < dequeCount; i++) {
+            uint32_t front = (uint32_t)((long long)chunkCount * i / dequeCount);
+            uint32_t back = (uint32_t)((long long)chunkCount * (i + 1) / dequeCount);
+            deques[i].range.store(PackRange(front, back), std::memory_order_release);
+        }
+        generation.fetch_add(1);
+        if (sleepers.load() > 0) {
+            std::lock_guard<std::mutex> lock(wakeLock);
+            wakeSignal.notify_all();
+        }
+
+        RunChunks(0);
+        while (remainingChunks.load(std::memory_order_acquire) > 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    long long StealCount() const {
+        long long total = 0;
+        for (int i = 0; i < dequeCount; i++) total += deques[i].steals;
+        return total;
+    }
+
+private:
+    struct alignas(64) ChunkDeque {
+        std::atomic<uint64_t> range{0};  // front in the low half, back in the high half
+        long long steals = 0;            // chunks this thread took from others
+    };
+
+    static uint64_t PackRange(uint32_t front, uint32_t back) { return (uint64_t)back << 32 | front; }
+
+    bool PopFront(ChunkDeque& deque, uint32_t& chunk) {
+        uint64_t range = deque.range.load(std::memory_order_acquire);
+        while ((uint32_t)range < (uint32_t)(range >> 32)) {
+            if (deque.range.compare_exchange_weak(range, range + 1, std::memory_order_acquire)) {
+                chunk = (uint32_t)range;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool StealBack(ChunkDeque& deque, uint32_t& chunk) {
+        uint64_t range = deque.range.load(std::memory_order_acquire);
+        while ((uint32_t)range < (uint32_t)(range >> 32)) {
+            uint32_t back = (uint32_t)(range >> 32) - 1;
+            if (deque.range.compare_exchange_weak(range, PackRange((uint32_t)range, back), std::memory_order_acquire)) {
+                chunk = back;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Run chunks until every deque is empty; false if there was nothing to take
+    bool RunChunks(int self) {
+        bool ranAny = false;
+        while (true) {
+            uint32_t chunk;
+            bool found = PopFront(deques[self], chunk);
+            for (int i = 1; !found && i < dequeCount; i++) {
+                found = StealBack(deques[(self + i) % dequeCount], chunk);
+                if (found) deques[self].steals++;
+            }
+            if (!found) return ranAny;
+
+            // The loop parameters are written before the deques are filled,
+            // so a successful pop always sees the loop its chunk belongs to
+            int first = (int)chunk * loopChunkSize;
+            int last = std::min(first + loopChunkSize, loopItems);
+            loopFunction(loopContext, first, last);
+            remainingChunks.fetch_sub(1, std::memory_order_release);
+            ranAny = true;
+        }
+    }
+
+    void WorkerLoop(int self) {
+        while (true) {
+            unsigned seen = generation.load();
+            if (RunChunks(self)) continue;
+
+            for (int spin = 0; spin < HOST_IDLE_SPINS && generation.load() == seen; spin++) {
+                std::this_thread::yield();
+            }
+            if (generation.load() != seen) continue;
+
+            std::unique_lock<std::mutex> lock(wakeLock);
+            sleepers++;
+            wakeSignal.wait(lock, [this, seen] { return stopping || generation.load() != seen; });
+            sleepers--;
+            if (stopping) return;
+        }
+    }
+
+    std::unique_ptr<ChunkDeque[]> deques;
+    int dequeCount = 0;
+    std::vector<std::thread> threads;
+
+    ChunkFunction loopFunction = nullptr;
+    void* loopContext = nullptr;
+    int loopItems = 0;
+    int loopChunkSize = 1;
+    std::atomic<int> remainingChunks{0};
+
+    std::atomic<unsigned> generation{0};
+    std::atomic<int> sleepers{0};
+    std::mutex wakeLock;
+    std::condition_variable wakeSignal;
+    bool stopping = false;
+};
+
+// Simple paddle AI: follow the ball when it is coming towards us, drift back
+// to the centre otherwise. Lower skill means a larger aiming error.
+struct BotController {
+    float skill;     // 0..1
+    float aimError;  // pixels, re-rolled every rally
+};
+
+bool BotWantsUp(const BotController& bot, float paddleY, float targetY) {
+    return targetY + bot.aimError < paddleY + PADDLE_HEIGHT * 0.35f;
+}
+
+bool BotWantsDown(const BotController& bot, float paddleY, float targetY) {
+    return targetY + bot.aimError > paddleY + PADDLE_HEIGHT * 0.65f;
+}
+
+struct HostedMatch {
+    MatchState state;
+    BotController left;
+    BotController right;
+    int leftPlayer;
+    int rightPlayer;
+    int ticks;
+    int missedTicks;
+    unsigned rng;
+    bool finished;
+};
+
+MatchEvents StepHostedMatch(HostedMatch& hm) {
+    MatchState& m = hm.state;
+    int lastHits = m.hitCount;
+    int lastGoals = m.leftScore + m.rightScore;
+
+    float centreY = WINDOW_HEIGHT / 2.0f;
+    float leftTarget = m.ballVelocityX < 0 ? m.ballY : centreY;
+    float rightTarget = m.ballVelocityX > 0 ? m.ballY : centreY;
+
+    MatchInput input;
+    input.leftUp = BotWantsUp(hm.left, m.leftPaddleY, leftTarget);
+    input.leftDown = BotWantsDown(hm.left, m.leftPaddleY, leftTarget);
+    input.rightUp = BotWantsUp(hm.right, m.rightPaddleY, rightTarget);
+    input.rightDown = BotWantsDown(hm.right, m.rightPaddleY, rightTarget);
+
+    MatchEvents events = StepMatch(m, input, PADDLE_SPEED, SPEED_INCREASE_FACTOR, WINDOW_WIDTH, WINDOW_HEIGHT);
+    hm.ticks++;
+
+    // New rally or paddle hit: re-roll how far off each bot aims
+    if (m.hitCount != lastHits || m.leftScore + m.rightScore != lastGoals) {
+        hm.left.aimError = (NextRandom(hm.rng) - 0.5f) * (1.0f - hm.left.skill) * PADDLE_HEIGHT * 2.0f;
+        hm.right.aimError = (NextRandom(hm.rng) - 0.5f) * (1.0f - hm.right.skill) * PADDLE_HEIGHT * 2.0f;
+    }
+
+    if (m.leftScore >= HOST_WINNING_SCORE || m.rightScore >= HOST_WINNING_SCORE ||
+        hm.ticks >= HOST_MAX_TICKS_PER_MATCH) {
+        hm.finished = true;
+    }
+    return events;
+}
+
+int HostedMatchWinner(const HostedMatch& hm) {
+    // Ties at the tick limit go to the left (higher seeded) player
+    return hm.state.rightScore > hm.state.leftScore ? hm.rightPlayer : hm.leftPlayer;
+}
+
+struct TournamentStats {
+    int rounds;
+    int matches;
+    int champion;
+    long long ticks;
+    long long missedTicks;
+    long long steals;
+    double seconds;
+};
+
+typedef std::chrono::steady_clock HostClock;
+
+// One tick of a bracket, shared by every chunk of the parallel loop
+struct HostTick {
+    HostedMatch* matches;
+    HostClock::time_point deadline;
+    bool realTime;
+};
+
+void StepHostedChunk(void* context, int first, int last) {
+    HostTick& tick = *(HostTick*)context;
+    for (int i = first; i < last; i++) {
+        HostedMatch& hm = tick.matches[i];
+        if (hm.finished) continue;
+        StepHostedMatch(hm);
+        if (tick.realTime && HostClock::now() > tick.deadline) {
+            hm.missedTicks++;
+        }
+    }
+}
+
+// Run a full bracket. In real-time mode every tick has a deadline of
+// 1/HOST_TICK_RATE seconds after the previous one; in fast mode ticks are
+// issued back to back and only throughput matters.
+TournamentStats RunTournament(int players, int threadCount, bool realTime) {
+    TournamentStats stats = {};
+    WorkStealingPool pool(threadCount);
+
+    std::vector<float> skills(players);
+    unsigned seedRng = 12345u;
+    for (int i = 0; i < players; i++) {
+        skills[i] = 0.5f + NextRandom(seedRng) * 0.5f;
+    }
+
+    std::vector<int> entrants(players);
+    for (int i = 0; i < players; i++) entrants[i] = i;
+
+    typedef HostClock Clock;
+    const Clock::duration tickPeriod = std::chrono::microseconds(1000000 / HOST_TICK_RATE);
+    Clock::time_point startTime = Clock::now();
+
+    while (entrants.size() > 1) {
+        // Pair up this round's entrants; an odd one out gets a bye
+        std::vector<HostedMatch> bracket;
+        std::vector<int> nextRound;
+        for (size_t i = 0; i + 1 < entrants.size(); i += 2) {
+            HostedMatch hm = {};
+            ResetMatch(hm.state, WINDOW_WIDTH, WINDOW_HEIGHT);
+            hm.leftPlayer = entrants[i];
+            hm.rightPlayer = entrants[i + 1];
+            hm.left.skill = skills[hm.leftPlayer];
+            hm.right.skill = skills[hm.rightPlayer];
+            hm.rng = 0x9E3779B9u * (unsigned)(stats.matches + 1);
+            bracket.push_back(hm);
+            stats.matches++;
+        }
+        if (entrants.size() % 2 == 1) {
+            nextRound.push_back(entrants.back());
+        }
+
+        HostTick tick = {&bracket[0], Clock::now() + tickPeriod, realTime};
+        size_t running = bracket.size();
+        while (running > 0) {
+            pool.Run((int)bracket.size(), HOST_MATCHES_PER_CHUNK, StepHostedChunk, &tick);
+
+            running = 0;
+            for (size_t i = 0; i < bracket.size(); i++) {
+                if (!bracket[i].finished) running++;
+            }
+
+            if (realTime) {
+                std::this_thread::sleep_until(tick.deadline);
+                tick.deadline += tickPeriod;
+            }
+        }
+
+        for (size_t i = 0; i < bracket.size(); i++) {
+            stats.ticks += bracket[i].ticks;
+            stats.missedTicks += bracket[i].missedTicks;
+            nextRound.push_back(HostedMatchWinner(bracket[i]));
+        }
+        entrants.swap(nextRound);
+        stats.rounds++;
+    }
+
+    stats.champion = entrants.empty() ? -1 : entrants[0];
+    stats.steals = pool.StealCount();
+    stats.seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+    return stats;
+}
+
+void PrintTournamentStats(const TournamentStats& stats, int threadCount) {
+    printf("threads: %d\n", threadCount);
+    printf("rounds: %d  matches: %d  champion: player %d\n", stats.rounds, stats.matches, stats.champion);
+    printf("ticks: %lld  missed deadlines: %lld (%.3f%%)\n", stats.ticks, stats.missedTicks,
+           stats.ticks > 0 ? 100.0 * stats.missedTicks / stats.ticks : 0.0);
+    printf("steals: %lld\n", stats.steals);
+    printf("time: %.2f s  throughput: %.0f ticks/s\n", stats.seconds,
+           stats.seconds > 0 ? stats.ticks / stats.seconds : 0.0);
+}
+
+// Run the same bracket in fast mode with 1, 2, 4, ... threads and report how
+// throughput scales against the single-threaded run
+void RunHostScaling(int players) {
+    int maxThreads = (int)std::thread::hardware_concurrency();
+    if (maxThreads < 1) maxThreads = 1;
+
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    double baseline = 0.0;
+    printf("%8s %14s %10s\n", "threads", "ticks/s", "speedup");
+    for (size_t i = 0; i < threadCounts.size(); i++) {
+        TournamentStats stats = RunTournament(players, threadCounts[i], false);
+        double throughput = stats.seconds > 0 ? stats.ticks / stats.seconds : 0.0;
+        if (i == 0) baseline = throughput;
+        printf("%8d %14.0f %9.2fx\n", threadCounts[i], throughput, baseline > 0 ? throughput / baseline : 0.0);
+    }
+}
+
+// Time the party-mode step (movement, paddles, broadphase and contacts)
+// for `ballCount` balls on the calling thread
+void RunPartyBenchmark(int ballCount) {
+    const int warmupTicks = 60;
+    const int measuredTicks = 600;
+    MatchState m;
+    ResetMatch(m, WINDOW_WIDTH, WINDOW_HEIGHT);
+    SpawnPartyBalls(partyBalls, ballCount, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    for (int tick = 0; tick < warmupTicks; tick++) {
+        StepPartyBalls(partyBalls, partyGrid, m, SPEED_INCREASE_FACTOR, WINDOW_WIDTH, WINDOW_HEIGHT);
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < measuredTicks; tick++) {
+        StepPartyBalls(partyBalls, partyGrid, m, SPEED_INCREASE_FACTOR, WINDOW_WIDTH, WINDOW_HEIGHT);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double msPerTick = seconds * 1000.0 / measuredTicks;
+    printf("balls: %d  ticks: %d\n", partyBalls.count, measuredTicks);
+    printf("%.3f ms/tick  (%.1f%% of a 60 Hz frame)\n", msPerTick, msPerTick * 100.0 / (1000.0 / 60.0));
+}
+
+// Read a telemetry file and print rally, hit, pause and frame time stats
+bool PrintTelemetryReport(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        printf("cannot open %s\n", path);
+        return false;
+    }
+    char magic[sizeof(TELEMETRY_MAGIC)];
+    uint32_t version = 0;
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, TELEMETRY_MAGIC, sizeof(magic)) != 0 ||
+        fread(&version, sizeof(version), 1, file) != 1 || version != TELEMETRY_VERSION) {
+        printf("%s is not a telemetry file\n", path);
+        fclose(file);
+        return false;
+    }
+
+    long long typeCounts[TELEMETRY_EVENT_TYPES] = {};
+    long long hitBuckets[10] = {};
+    long long goals[2] = {};
+    long long partyGoals[2] = {};
+    long long rallyHitsTotal = 0;
+    int longestRally = 0;
+    double pausedSeconds = 0.0;
+    int lastEffectsTier = EFFECTS_HIGH;
+    std::vector<float> frameTimes;
+
+    uint32_t count = 0;
+    while (fread(&count, sizeof(count), 1, file) == 1 && count <= TELEMETRY_BLOCK_SIZE) {
+        bool complete =
+            fread(telemetryBlock.tick, sizeof(uint32_t), count, file) == count &&
+            fread(telemetryBlock.type, sizeof(uint16_t), count, file) == count &&
+            fread(telemetryBlock.value, sizeof(int16_t), count, file) == count &&
+            fread(telemetryBlock.x, sizeof(float), count, file) == count &&
+            fread(telemetryBlock.y, sizeof(float), count, file) == count;
+        if (!complete) {
+            break;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            int type = telemetryBlock.type[i];
+            if (type >= TELEMETRY_EVENT_TYPES) continue;
+            typeCounts[type]++;
+            float x = telemetryBlock.x[i];
+            switch (type) {
+                case TELEMETRY_FRAME:
+                    frameTimes.push_back(x);
+                    break;
+                case TELEMETRY_PADDLE_HIT: {
+                    int bucket = (int)(x * 10);
+                    hitBuckets[bucket < 0 ? 0 : (bucket > 9 ? 9 : bucket)]++;
+                    break;
+                }
+                case TELEMETRY_GOAL:
+                    goals[telemetryBlock.value[i] == 1 ? 1 : 0]++;
+                    rallyHitsTotal += (long long)x;
+                    if ((int)x > longestRally) longestRally = (int)x;
+                    break;
+                case TELEMETRY_PARTY_GOAL:
+                    partyGoals[telemetryBlock.value[i] == 1 ? 1 : 0]++;
+                    break;
+                case TELEMETRY_PAUSE_END:
+                    pausedSeconds += x;
+                    break;
+                case TELEMETRY_EFFECTS_TIER:
+                    lastEffectsTier = std::min(std::max((int)telemetryBlock.value[i], 0), EFFECTS_TIER_COUNT - 1);
+                    break;
+            }
+        }
+    }
+    fclose(file);
+
+    long long rallies = typeCounts[TELEMETRY_GOAL];
+    printf("rallies: %lld  (left scored %lld, right scored %lld)\n", rallies, goals[0], goals[1]);
+    if (typeCounts[TELEMETRY_PARTY_GOAL] > 0) {
+        printf("party ball goals: %lld  (left scored %lld, right scored %lld)\n", typeCounts[TELEMETRY_PARTY_GOAL],
+               partyGoals[0], partyGoals[1]);
+    }
+    printf("hits per rally: mean %.2f  max %d\n", rallies > 0 ? (double)rallyHitsTotal / rallies : 0.0, longestRally);
+    printf("paddle hits: %lld  reached speed cap: %lld times\n", typeCounts[TELEMETRY_PADDLE_HIT], typeCounts[TELEMETRY_SPEED_CAP]);
+    printf("hit position (top -> bottom):");
+    for (int b = 0; b < 10; b++) {
+        printf(" %lld", hitBuckets[b]);
+    }
+    printf("\n");
+    printf("pauses: %lld  total paused %.1f s\n", typeCounts[TELEMETRY_PAUSE], pausedSeconds);
+    printf("effects tier changes: %lld  last tier %s\n", typeCounts[TELEMETRY_EFFECTS_TIER],
+           EFFECTS_TIERS[lastEffectsTier].name);
+
+    if (!frameTimes.empty()) {
+        double total = 0.0;
+        for (size_t i = 0; i < frameTimes.size(); i++) total += frameTimes[i];
+        std::sort(frameTimes.begin(), frameTimes.end());
+        size_t n = frameTimes.size();
+        printf("frames: %zu  mean %.2f ms  p50 %.2f ms  p99 %.2f ms  max %.2f ms\n", n, total / n,
+               frameTimes[n / 2], frameTimes[n * 99 / 100], frameTimes[n - 1]);
+    }
+    return true;
+}
+
+// Time RecordTelemetry on this thread while the writer drains and discards
+// the events. Events go in bursts of half a ring and only the recording is
+// timed, so the figure is the game thread's cost, not the drop path.
+void RunTelemetryBenchmark() {
+    const int eventCount = 10000000;
+    const int burst = TELEMETRY_RING_SIZE / 2;
+    StartTelemetry(nullptr);
+
+    double seconds = 0.0;
+    for (int recorded = 0; recorded < eventCount; recorded += burst) {
+        while (telemetryRing.head.load() - telemetryRing.tail.load() > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < burst; i++) {
+            telemetryTick = (uint32_t)(recorded + i);
+            RecordTelemetry(TELEMETRY_PADDLE_HIT, i & 7, 0.5f, 1.0f);
+        }
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    uint32_t dropped = telemetryRing.droppedEvents;
+    StopTelemetry();
+
+    printf("events: %d  dropped: %u\n", eventCount, dropped);
+    printf("%.1f ns per event on the game thread\n", seconds * 1e9 / eventCount);
+}
+
+// ---------------------------------------------------------------------------
+// Terminal frontend
+//
+// Plays the game inside a console (local or over SSH) using truecolor ANSI
+// output. Every character cell shows two playfield pixels with an upper
+// half block: the foreground colour is the top pixel, the background the
+// bottom one. The previous frame's cells are kept and only changed cells
+// are sent, so output size follows how much moved, not the screen size.
+//
+//   game.exe --terminal [columns]
+//   game.exe --terminal-bench
+//
+// Console input and output go through the Win32 console API, so like the
+// rest of the game this needs Windows (Windows Terminal, conhost, or an SSH
+// session into a Windows host).
+// ---------------------------------------------------------------------------
+
+const int TERMINAL_DEFAULT_COLUMNS = 80;
+const int TERMINAL_MAX_COLUMNS = 320;
+const int TERMINAL_FRAME_RATE = 120;
+const int TERMINAL_KEY_HOLD_MS = 150;  // terminals only send presses; hold paddle keys this long
+const uint32_t TERMINAL_BLACK = 0x000000;
+const uint32_t TERMINAL_WHITE = 0xFFFFFF;
+
+struct TerminalCell {
+    uint32_t fg;
+    uint32_t bg;
+    char glyph;  // 0: upper half block, otherwise an ASCII character
+};
+
+struct TerminalRenderer {
+    int columns;
+    int rows;
+    int pixelWidth;
+    int pixelHeight;
+    std::vector<uint32_t> pixels;       // pixelWidth x pixelHeight, 0xRRGGBB
+    std::vector<TerminalCell> cells;
+    std::vector<TerminalCell> previous;
+    std::vector<char> output;
+    size_t outputLength;
+    bool fullRedraw;                    // send every cell (first frame)
+};
+
+void InitTerminalRenderer(TerminalRenderer& tr, int columns) {
+    if (columns < 20) columns = 20;
+    if (columns > TERMINAL_MAX_COLUMNS) columns = TERMINAL_MAX_COLUMNS;
+    tr.columns = columns;
+    tr.pixelWidth = columns;
+    tr.pixelHeight = (int)((float)columns * WINDOW_HEIGHT / WINDOW_WIDTH + 0.5f);
+    tr.rows = (tr.pixelHeight + 1) / 2;
+    tr.pixels.assign(tr.pixelWidth * tr.rows * 2, TERMINAL_BLACK);
+    tr.cells.assign(tr.columns * tr.rows, TerminalCell());
+    tr.previous.assign(tr.columns * tr.rows, TerminalCell());
+    // Worst case per cell: cursor move + two colour changes + a 3-byte glyph
+    tr.output.assign(tr.columns * tr.rows * 64 + 64, 0);
+    tr.outputLength = 0;
+    tr.fullRedraw = true;
+}
+
+// Fill a rectangle given in playfield units
+void TerminalFillRect(TerminalRenderer& tr, float left, float top, float right, float bottom, uint32_t color) {
+    float scale = (float)tr.pixelWidth / WINDOW_WIDTH;
+    int x0 = (int)(left * scale);
+    int y0 = (int)(top * scale);
+    int x1 = (int)(right * scale + 0.999f);
+    int y1 = (int)(bottom * scale + 0.999f);
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > tr.pixelWidth) x1 = tr.pixelWidth;
+    if (y1 > tr.pixelHeight) y1 = tr.pixelHeight;
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            tr.pixels[y * tr.pixelWidth + x] = color;
+        }
+    }
+}
+
+// Turn the pixel buffer into half-block cells
+void ComposeTerminalCells(TerminalRenderer& tr) {
+    for (int row = 0; row < tr.rows; row++) {
+        const uint32_t* top = &tr.pixels[(row * 2) * tr.pixelWidth];
+        const uint32_t* bottom = top + tr.pixelWidth;
+        for (int column = 0; column < tr.columns; column++) {
+            TerminalCell& cell = tr.cells[row * tr.columns + column];
+            cell.fg = top[column];
+            cell.bg = bottom[column];
+            cell.glyph = 0;
+        }
+    }
+}
+
+// Write text over the cells, centred on `centerColumn`, keeping each cell's
+// lower pixel as the background
+void TerminalText(TerminalRenderer& tr, int row, int centerColumn, const char* text, uint32_t color) {
+    if (row < 0 || row >= tr.rows) return;
+    int length = (int)strlen(text);
+    int column = centerColumn - length / 2;
+    for (int i = 0; i < length; i++, column++) {
+        if (column < 0 || column >= tr.columns) continue;
+        TerminalCell& cell = tr.cells[row * tr.columns + column];
+        cell.fg = color;
+        cell.glyph = text[i];
+    }
+}
+
+// Draw the current game state from `m` into the cells
+void DrawTerminalScene(TerminalRenderer& tr, const MatchState& m) {
+    int centerColumn = tr.columns / 2;
+    int middleRow = tr.rows / 2;
+    char line[64];
+
+    if (gameState == MENU || gameState == DIFFICULTY_SELECT) {
+        // Same dark purple gradient as the window fallback background
+        for (int y = 0; y < tr.pixelHeight; y++) {
+            int shade = y * 30 / tr.pixelHeight;
+            uint32_t color = ((15 + shade) << 16) | (10 << 8) | (40 + shade);
+            TerminalFillRect(tr, 0, y * (float)WINDOW_WIDTH / tr.pixelWidth, WINDOW_WIDTH,
+                             (y + 1) * (float)WINDOW_WIDTH / tr.pixelWidth, color);
+        }
+        ComposeTerminalCells(tr);
+        TerminalText(tr, middleRow - 4, centerColumn, "P O N G", 0x64C8FF);
+        if (gameState == MENU) {
+            TerminalText(tr, middleRow - 2, centerColumn, "Classic Arcade Experience", 0xC8C8C8);
+            TerminalText(tr, middleRow + 2, centerColumn, "Press Any Key to Start", TERMINAL_WHITE);
+        } else {
+            const char* names[] = {"EASY", "MEDIUM", "HARD"};
+            const uint32_t colors[] = {0x32C864, 0xFFC832, 0xFF3232};
+            for (int i = 0; i < 3; i++) {
+                snprintf(line, sizeof(line), i == selectedDifficulty ? "> %s <" : "  %s  ", names[i]);
+                TerminalText(tr, middleRow, centerColumn + (i - 1) * (tr.columns / 4), line,
+                             i == selectedDifficulty ? colors[i] : 0x808080);
+            }
+            TerminalText(tr, middleRow + 3, centerColumn, "LEFT/RIGHT select  ENTER start  ESC quit", 0xC8C8C8);
+        }
+        return;
+    }
+
+    // Playfield (PLAYING, or frozen under the pause overlay)
+    bool paused = (gameState == PAUSED);
+    uint32_t bright = paused ? 0x646464 : TERMINAL_WHITE;
+    std::fill(tr.pixels.begin(), tr.pixels.end(), TERMINAL_BLACK);
+    for (int y = 0; y < WINDOW_HEIGHT; y += 20) {
+        TerminalFillRect(tr, WINDOW_WIDTH / 2.0f - 1, (float)y, WINDOW_WIDTH / 2.0f + 1, (float)y + 10, paused ? 0x202020 : 0x404040);
+    }
+    TerminalFillRect(tr, 15, m.leftPaddleY, 15 + PADDLE_WIDTH, m.leftPaddleY + PADDLE_HEIGHT, bright);
+    TerminalFillRect(tr, WINDOW_WIDTH - 15 - PADDLE_WIDTH, m.rightPaddleY, WINDOW_WIDTH - 15, m.rightPaddleY + PADDLE_HEIGHT, bright);
+    TerminalFillRect(tr, m.ballX - BALL_RADIUS, m.ballY - BALL_RADIUS, m.ballX + BALL_RADIUS, m.ballY + BALL_RADIUS, bright);
+    for (int i = 0; i < partyBalls.count; i++) {
+        TerminalFillRect(tr, partyBalls.x[i] - BALL_RADIUS, partyBalls.y[i] - BALL_RADIUS,
+                         partyBalls.x[i] + BALL_RADIUS, partyBalls.y[i] + BALL_RADIUS, paused ? 0x645A28 : 0xFFDC64);
+    }
+    ComposeTerminalCells(tr);
+
+    snprintf(line, sizeof(line), "%d", m.leftScore);
+    TerminalText(tr, 1, tr.columns / 4, line, bright);
+    snprintf(line, sizeof(line), "%d", m.rightScore);
+    TerminalText(tr, 1, tr.columns * 3 / 4, line, bright);
+
+    if (paused) {
+        TerminalText(tr, middleRow - 3, centerColumn, "PAUSED", 0xFF6464);
+        if (isCountingDown) {
+            int countdown = (int)countdownTimer + 1;
+            if (countdown > 3) countdown = 3;
+            snprintf(line, sizeof(line), "Resuming in %d...", countdown);
+            TerminalText(tr, middleRow, centerColumn, line, 0x64FF64);
+        } else {
+            TerminalText(tr, middleRow, centerColumn - 8, pauseMenuSelection == 0 ? "> RESUME <" : "  RESUME  ",
+                         pauseMenuSelection == 0 ? 0x64FF64 : 0x808080);
+            TerminalText(tr, middleRow, centerColumn + 8, pauseMenuSelection == 1 ? "> MAIN MENU <" : "  MAIN MENU  ",
+                         pauseMenuSelection == 1 ? 0xFF6464 : 0x808080);
+            TerminalText(tr, middleRow + 2, centerColumn, "LEFT/RIGHT select  ENTER confirm", 0xC8C8C8);
+        }
+    }
+}
+
+void AppendBytes(TerminalRenderer& tr, const char* bytes, size_t count) {
+    memcpy(&tr.output[tr.outputLength], bytes, count);
+    tr.outputLength += count;
+}
+
+void AppendNumber(TerminalRenderer& tr, int value) {
+    char digits[12];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (count > 0) {
+        tr.output[tr.outputLength++] = digits[--count];
+    }
+}
+
+int DigitCount(int value) {
+    return value >= 100 ? 3 : (value >= 10 ? 2 : 1);
+}
+
+void AppendColor(TerminalRenderer& tr, bool background, uint32_t color) {
+    AppendBytes(tr, background ? "\x1b[48;2;" : "\x1b[38;2;", 7);
+    AppendNumber(tr, (color >> 16) & 0xFF);
+    tr.output[tr.outputLength++] = ';';
+    AppendNumber(tr, (color >> 8) & 0xFF);
+    tr.output[tr.outputLength++] = ';';
+    AppendNumber(tr, color & 0xFF);
+    tr.output[tr.outputLength++] = 'm';
+}
+
+bool SameCell(const TerminalCell& a, const TerminalCell& b) {
+    return a.fg == b.fg && a.bg == b.bg && a.glyph == b.glyph;
+}
+
+// Encode the cells that changed since the previous frame. Returns the
+// number of bytes in tr.output.
+size_t EncodeTerminalFrame(TerminalRenderer& tr) {
+    tr.outputLength = 0;
+    if (tr.fullRedraw) {
+        AppendBytes(tr, "\x1b[?25l\x1b[2J", 10);
+    }
+
+    int cursorRow = -1;
+    int cursorColumn = -1;
+    uint32_t currentFg = 0xFFFFFFFFu;
+    uint32_t currentBg = 0xFFFFFFFFu;
+    for (int row = 0; row < tr.rows; row++) {
+        for (int column = 0; column < tr.columns; column++) {
+            const TerminalCell& cell = tr.cells[row * tr.columns + column];
+            if (!tr.fullRedraw && SameCell(cell, tr.previous[row * tr.columns + column])) {
+                continue;
+            }
+
+            // Move the cursor with whichever sequence is shorter
+            if (row != cursorRow || column != cursorColumn) {
+                int skip = column - cursorColumn;
+                int forwardLength = 3 + DigitCount(skip);
+                int absoluteLength = 4 + DigitCount(row + 1) + DigitCount(column + 1);
+                if (row == cursorRow && skip > 0 && forwardLength < absoluteLength) {
+                    AppendBytes(tr, "\x1b[", 2);
+                    AppendNumber(tr, skip);
+                    tr.output[tr.outputLength++] = 'C';
+                } else {
+                    AppendBytes(tr, "\x1b[", 2);
+                    AppendNumber(tr, row + 1);
+                    tr.output[tr.outputLength++] = ';';
+                    AppendNumber(tr, column + 1);
+                    tr.output[tr.outputLength++] = 'H';
+                }
+            }
+
+            if (cell.fg != currentFg) {
+                AppendColor(tr, false, cell.fg);
+                currentFg = cell.fg;
+            }
+            if (cell.bg != currentBg) {
+                AppendColor(tr, true, cell.bg);
+                currentBg = cell.bg;
+            }
+            if (cell.glyph) {
+                tr.output[tr.outputLength++] = cell.glyph;
+            } else {
+                AppendBytes(tr, "\xE2\x96\x80", 3);  // U+2580 upper half block
+            }
+
+            cursorRow = row;
+            cursorColumn = column + 1;
+            if (cursorColumn == tr.columns) {
+                // The cursor may wrap or stick at the margin; force a full move
+                cursorRow = -1;
+            }
+        }
+    }
+
+    tr.previous = tr.cells;
+    tr.fullRedraw = false;
+    return tr.outputLength;
+}
+
+bool IsPaddleKey(WPARAM key) {
+    return key == 'W' || key == 'S' || key == VK_UP || key == VK_DOWN;
+}
+
+// Run the game in the console until ESC
+void RunTerminalGame(int columns) {
+    if (!AttachConsole(ATTACH_PARENT_PROCESS)) {
+        AllocConsole();
+    }
+    // A GUI-subsystem process has no standard handles; open the console directly
+    HANDLE output = CreateFileA("CONOUT$", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                NULL, OPEN_EXISTING, 0, NULL);
+    HANDLE input = CreateFileA("CONIN$", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                               NULL, OPEN_EXISTING, 0, NULL);
+    if (output == INVALID_HANDLE_VALUE || input == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    DWORD mode = 0;
+    GetConsoleMode(output, &mode);
+    SetConsoleMode(output, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    SetConsoleOutputCP(CP_UTF8);
+
+    TerminalRenderer tr;
+    InitTerminalRenderer(tr, columns);
+
+    // Paddle keys stay down until no repeat has arrived for a while
+    LONGLONG paddleKeyRelease[256] = {};
+
+    // 1 ms timer resolution: with the default ~15.6 ms the waits below
+    // would cap the loop near 64 Hz, under both the tick and frame rate
+    timeBeginPeriod(1);
+    const LONGLONG tickLength = MsToCounter(1000) / HOST_TICK_RATE;
+    const LONGLONG frameLength = MsToCounter(1000) / TERMINAL_FRAME_RATE;
+    LONGLONG nextTick = QueryCounter();
+    LONGLONG lastFrame = QueryCounter();
+    bool running = true;
+    while (running) {
+        LONGLONG now = QueryCounter();
+
+        // Input: feed key presses through the window's key handler
+        DWORD pending = 0;
+        GetNumberOfConsoleInputEvents(input, &pending);
+        while (pending-- > 0) {
+            INPUT_RECORD record;
+            DWORD read = 0;
+            if (!ReadConsoleInputA(input, &record, 1, &read) || read == 0) break;
+            if (record.EventType != KEY_EVENT) continue;
+            WPARAM key = record.Event.KeyEvent.wVirtualKeyCode;
+            if (key == VK_ESCAPE) {
+                running = false;
+                break;
+            }
+            if (key == VK_F8) continue;
+            if (!record.Event.KeyEvent.bKeyDown) {
+                if (IsPaddleKey(key) && paddleKeyRelease[key] != 0) {
+                    paddleKeyRelease[key] = 0;
+                    WindowProc(NULL, WM_KEYUP, key, 0);
+                }
+                continue;
+            }
+            if (IsPaddleKey(key)) {
+                if (paddleKeyRelease[key] == 0) {
+                    WindowProc(NULL, WM_KEYDOWN, key, 0);
+                }
+                paddleKeyRelease[key] = now + MsToCounter(TERMINAL_KEY_HOLD_MS);
+            } else {
+                WindowProc(NULL, WM_KEYDOWN, key, 0);
+            }
+        }
+        for (int key = 0; key < 256; key++) {
+            if (paddleKeyRelease[key] != 0 && now >= paddleKeyRelease[key]) {
+                paddleKeyRelease[key] = 0;
+                WindowProc(NULL, WM_KEYUP, key, 0);
+            }
+        }
+
+        // Fixed-rate simulation, same rules as the window
+        while (now >= nextTick) {
+            if (gameState == PLAYING) {
+                MatchInput paddles = { wKeyPressed, sKeyPressed, upKeyPressed, downKeyPressed };
+                MatchEvents events = StepMatch(match, paddles, currentPaddleSpeed, currentSpeedFactor, WINDOW_WIDTH, WINDOW_HEIGHT);
+                RecordMatchTelemetry(events, match);
+                RecordStateHash(match);
+                if (partyBalls.count > 0) {
+                    StepPartyBalls(partyBalls, partyGrid, match, currentSpeedFactor, WINDOW_WIDTH, WINDOW_HEIGHT);
+                    RecordPartyTelemetry(partyBalls);
+                }
+            } else if (gameState == PAUSED && isCountingDown) {
+                UpdateResumeCountdown(1.0f / HOST_TICK_RATE);
+            }
+            nextTick += tickLength;
+        }
+
+        if (now - lastFrame >= frameLength) {
+            lastFrame = now;
+            DrawTerminalScene(tr, match);
+            DWORD written = 0;
+            size_t length = EncodeTerminalFrame(tr);
+            if (length > 0) {
+                WriteFile(output, &tr.output[0], (DWORD)length, &written, NULL);
+            }
+        }
+
+        // Sleep until the next tick or frame is due, or a key arrives
+        LONGLONG nextFrame = lastFrame + frameLength;
+        LONGLONG due = nextTick < nextFrame ? nextTick : nextFrame;
+        now = QueryCounter();
+        if (due > now) {
+            WaitForSingleObject(input, (DWORD)ceil(CounterToMs(due - now)));
+        }
+    }
+    timeEndPeriod(1);
+
+    const char* restore = "\x1b[0m\x1b[2J\x1b[H\x1b[?25h";
+    DWORD written = 0;
+    WriteFile(output, restore, (DWORD)strlen(restore), &written, NULL);
+    SetConsoleMode(output, mode);
+    CloseHandle(input);
+    CloseHandle(output);
+}
+
+// Bot match rendered at TERMINAL_FRAME_RATE without writing anywhere:
+// report bytes per frame and CPU time per frame
+void RunTerminalBenchmark(int columns) {
+    const int seconds = 30;
+    const int frames = seconds * TERMINAL_FRAME_RATE;
+
+    TerminalRenderer tr;
+    InitTerminalRenderer(tr, columns);
+    HostedMatch hm = {};
+    ResetMatch(hm.state, WINDOW_WIDTH, WINDOW_HEIGHT);
+    hm.left.skill = 0.8f;
+    hm.right.skill = 0.9f;
+    hm.rng = 42u;
+    gameState = PLAYING;
+
+    DrawTerminalScene(tr, hm.state);
+    size_t fullFrameBytes = EncodeTerminalFrame(tr);
+
+    long long totalBytes = 0;
+    size_t maxBytes = 0;
+    double cpuSeconds = 0.0;
+    for (int frame = 0; frame < frames; frame++) {
+        // The simulation runs at HOST_TICK_RATE, frames at TERMINAL_FRAME_RATE
+        if (frame * HOST_TICK_RATE / TERMINAL_FRAME_RATE != (frame + 1) * HOST_TICK_RATE / TERMINAL_FRAME_RATE) {
+            StepHostedMatch(hm);
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        DrawTerminalScene(tr, hm.state);
+        size_t bytes = EncodeTerminalFrame(tr);
+        cpuSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        totalBytes += bytes;
+        if (bytes > maxBytes) maxBytes = bytes;
+    }
+    gameState = MENU;
+
+    printf("terminal %dx%d cells, %d frames at %d Hz\n", tr.columns, tr.rows, frames, TERMINAL_FRAME_RATE);
+    printf("full frame: %zu bytes\n", fullFrameBytes);
+    printf("diff frames: mean %.0f bytes  max %zu bytes  (%.1f KB/s)\n", (double)totalBytes / frames, maxBytes,
+           totalBytes / 1024.0 / seconds);
+    printf("cpu: %.1f us/frame\n", cpuSeconds * 1e6 / frames);
+}
+
+// Per-channel versions of the pixel kernels with plain division, used as
+// the reference for --pixel-kernel-test
+uint32_t ReferenceBlend(uint32_t dst, uint32_t color, uint32_t alpha) {
+    uint32_t result = 0;
+    for (int c = 0; c < 32; c += 8) {
+        uint32_t source = c == 24 ? 255 : (color >> c) & 0xFF;
+        uint32_t target = (dst >> c) & 0xFF;
+        result |= ((source * alpha + target * (255 - alpha) + 127) / 255) << c;
+    }
+    return result;
+}
+
+uint32_t ReferenceBlendPremultiplied(uint32_t dst, uint32_t src) {
+    uint32_t alpha = src >> 24;
+    uint32_t result = 0;
+    for (int c = 0; c < 32; c += 8) {
+        uint32_t target = (dst >> c) & 0xFF;
+        result |= (((src >> c) & 0xFF) + (target * (255 - alpha) + 127) / 255) << c;
+    }
+    return result;
+}
+
+// Straight from the definition: pixel j's centre is (2j + 1) / (2 * length)
+// of the way along, in 1/65536 steps rounded down
+uint32_t ReferenceGradient(uint32_t from, uint32_t to, int offset, int length, int i) {
+    double f = (double)(((long long)(2 * (offset + i) + 1) * 32768) / length);
+    uint32_t result = 0;
+    for (int c = 0; c < 32; c += 8) {
+        int start = (from >> c) & 0xFF;
+        int diff = (int)((to >> c) & 0xFF) - start;
+        result |= (uint32_t)(start + (int)floor((diff * f + 32768.0) / 65536.0)) << c;
+    }
+    return result;
+}
+
+// Check every supported kernel set against the reference on random spans
+// of random lengths and alignments
+bool RunPixelKernelTest() {
+    const int trials = 20000;
+    const int maxSpan = 70;
+    const PixelKernels* sets[3];
+    int setCount = SupportedPixelKernels(sets);
+    uint32_t dst[maxSpan + 8], expected[maxSpan + 8], src[maxSpan + 8];
+    uint8_t coverage[maxSpan + 8];
+    bool allPassed = true;
+
+    for (int s = 0; s < setCount; s++) {
+        const PixelKernels& k = *sets[s];
+        int failures[4] = {};
+        unsigned rng = 12345u;
+        for (int trial = 0; trial < trials; trial++) {
+            int count = (int)(NextRandom(rng) * maxSpan);
+            int shift = (int)(NextRandom(rng) * 8);  // misalign the span
+            if (shift + count > maxSpan + 8) count = maxSpan + 8 - shift;
+            uint32_t color = (uint32_t)(NextRandom(rng) * 16777216.0f) |
+                             ((uint32_t)(NextRandom(rng) * 256.0f) << 24);
+            if (trial % 8 == 0) color |= 0xFF000000u;
+            if (trial % 8 == 1) color &= 0x00FFFFFFu;
+            for (int i = 0; i < maxSpan + 8; i++) {
+                dst[i] = (uint32_t)(NextRandom(rng) * 65536.0f) | ((uint32_t)(NextRandom(rng) * 65536.0f) << 16);
+                uint32_t alpha = (uint32_t)(NextRandom(rng) * 256.0f);
+                src[i] = alpha << 24;
+                for (int c = 0; c < 24; c += 8) {
+                    src[i] |= (uint32_t)(NextRandom(rng) * (alpha + 1)) << c;
+                }
+                float pick = NextRandom(rng);
+                coverage[i] = pick < 0.2f ? 0 : (pick < 0.4f ? 255 : (uint8_t)(NextRandom(rng) * 256.0f));
+            }
+
+            // Fill
+            memcpy(expected, dst, sizeof(dst));
+            for (int i = 0; i < count; i++) expected[shift + i] = ReferenceBlend(dst[shift + i], color, color >> 24);
+            uint32_t work[maxSpan + 8];
+            memcpy(work, dst, sizeof(dst));
+            k.fillSpan(work + shift, count, color);
+            if (memcmp(work, expected, sizeof(work)) != 0) failures[0]++;
+
+            // Premultiplied span
+            for (int i = 0; i < count; i++) expected[shift + i] = ReferenceBlendPremultiplied(dst[shift + i], src[shift + i]);
+            memcpy(work, dst, sizeof(dst));
+            k.blendSpan(work + shift, src + shift, count);
+            if (memcmp(work, expected, sizeof(work)) != 0) failures[1]++;
+
+            // Gradient
+            int length = 1 + (int)(NextRandom(rng) * 2000);
+            int offset = (int)(NextRandom(rng) * length);
+            int gradientCount = std::min(count, length - offset);
+            memcpy(expected, dst, sizeof(dst));
+            for (int i = 0; i < gradientCount; i++) {
+                expected[shift + i] = ReferenceGradient(color, dst[0], offset, length, i);
+            }
+            memcpy(work, dst, sizeof(dst));
+            k.gradientSpan(work + shift, gradientCount, color, dst[0], offset, length);
+            if (memcmp(work, expected, sizeof(work)) != 0) failures[2]++;
+
+            // Coverage
+            memcpy(expected, dst, sizeof(dst));
+            for (int i = 0; i < count; i++) {
+                uint32_t alpha = ((color >> 24) * coverage[shift + i] + 127) / 255;
+                expected[shift + i] = ReferenceBlend(dst[shift + i], color, alpha);
+            }
+            memcpy(work, dst, sizeof(dst));
+            k.coverageSpan(work + shift, coverage + shift, count, color);
+            if (memcmp(work, expected, sizeof(work)) != 0) failures[3]++;
+        }
+
+        // Whole gradients, where an inexact step would drift the furthest
+        static uint32_t gradientRow[2048];
+        for (int length = 1; length <= 2048; length += 7) {
+            uint32_t from = 0xFF000000u | (uint32_t)length * 2654435761u;
+            uint32_t to = ~from;
+            k.gradientSpan(gradientRow, length, from, to, 0, length);
+            for (int i = 0; i < length; i++) {
+                if (gradientRow[i] != ReferenceGradient(from, to, 0, length, i)) {
+                    failures[2]++;
+                    break;
+                }
+            }
+        }
+
+        const char* names[4] = {"fill", "blend", "gradient", "coverage"};
+        printf("%-7s", k.name);
+        for (int i = 0; i < 4; i++) {
+            if (failures[i] == 0) {
+                printf("  %s ok", names[i]);
+            } else {
+                printf("  %s FAILED (%d of %d spans)", names[i], failures[i], trials);
+                allPassed = false;
+            }
+        }
+        printf("\n");
+    }
+    printf(allPassed ? "all pixel kernels match the reference\n" : "pixel kernel mismatch\n");
+    return allPassed;
+}
+
+// Throughput of each kernel over full 1280-pixel rows of a frame
+void RunPixelKernelBenchmark() {
+    const int width = WINDOW_WIDTH;
+    const int height = WINDOW_HEIGHT;
+    const int frames = 60;
+    std::vector<uint32_t> frame(width * height, 0xFF202040u);
+    std::vector<uint32_t> source(width);
+    std::vector<uint8_t> coverage(width);
+    unsigned rng = 777u;
+    for (int i = 0; i < width; i++) {
+        uint32_t alpha = (uint32_t)(NextRandom(rng) * 256.0f);
+        source[i] = (alpha << 24) | ((alpha / 2) << 16) | ((alpha / 3) << 8) | (alpha / 4);
+        coverage[i] = (uint8_t)(NextRandom(rng) * 256.0f);
+    }
+
+    const PixelKernels* sets[3];
+    int setCount = SupportedPixelKernels(sets);
+    printf("pixel kernels, %dx%d frame, GPix/s\n", width, height);
+    printf("kernels     fill    blend  gradient  coverage\n");
+    for (int s = 0; s < setCount; s++) {
+        const PixelKernels& k = *sets[s];
+        double rates[4];
+        for (int kernel = 0; kernel < 4; kernel++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int f = 0; f < frames; f++) {
+                uint32_t color = 0x80C06020u + (uint32_t)f;
+                for (int y = 0; y < height; y++) {
+                    uint32_t* row = &frame[y * width];
+                    if (kernel == 0) {
+                        k.fillSpan(row, width, color);
+                    } else if (kernel == 1) {
+                        k.blendSpan(row, &source[0], width);
+                    } else if (kernel == 2) {
+                        k.gradientSpan(row, width, color, 0xFF10E0A0u, 0, width);
+                    } else {
+                        k.coverageSpan(row, &coverage[0], width, color);
+                    }
+                }
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            rates[kernel] = (double)width * height * frames / seconds / 1e9;
+        }
+        printf("%-7s  %7.2f  %7.2f  %8.2f  %8.2f\n", k.name, rates[0], rates[1], rates[2], rates[3]);
+    }
+    printf("checksum %08x\n", frame[width * height / 2 + width / 2]);
+}
+
+// Paint PLAYING and PAUSED frames through the real WM_PAINT handler into a
+// hidden window's back buffer, driving the state changes with the same key
+// messages a player sends, and count the frames that allocated. As in the
+// game, the first frame after a state change may warm up.
+struct AllocationPhase {
+    const char* name;
+    WPARAM key;     // sent before the phase, 0 for none
+    int frames;
+};
+
+bool RunAllocationTest() {
+    const AllocationPhase phases[] = {
+        {"playing", VK_RETURN, 600},        // from the difficulty screen
+        {"paused", 'P', 300},
+        {"paused, other option", VK_RIGHT, 60},
+        {"paused, back", VK_LEFT, 60},
+        {"countdown and playing", VK_RETURN, 600},
+    };
+
+    GdiplusStartupInput gdiplusStartupInput;
+    GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
+    CreateGameFonts();
+    CreateGameBrushes();
+    HINSTANCE instance = GetModuleHandle(NULL);
+    WNDCLASSA wc = {};
+    wc.lpfnWndProc = WindowProc;
+    wc.hInstance = instance;
+    wc.lpszClassName = "PongAllocationTest";
+    RegisterClassA(&wc);
+    HWND hwnd = CreateWindowExA(0, wc.lpszClassName, "", WS_POPUP, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT,
+                                NULL, NULL, instance, NULL);
+    timeBeginPeriod(1);
+
+    gameState = DIFFICULTY_SELECT;
+    selectedDifficulty = 0;
+    partyMode = false;
+    bool passed = true;
+    printf("%-22s %8s %14s\n", "phase", "frames", "allocating");
+    for (const AllocationPhase& phase : phases) {
+        if (phase.key) {
+            SendMessageA(hwnd, WM_KEYDOWN, phase.key, 0);
+        }
+        long long violationsBefore = frameAllocationViolations;
+        for (int frame = 0; frame < phase.frames; frame++) {
+            paintScheduled = true;
+            SendMessageA(hwnd, WM_PAINT, 0, 0);
+            Sleep(4);
+        }
+        long long violations = frameAllocationViolations - violationsBefore;
+        printf("%-22s %8d %14lld\n", phase.name, phase.frames, violations);
+        passed = passed && violations == 0;
+    }
+
+    timeEndPeriod(1);
+    DestroyWindow(hwnd);
+    UnregisterClassA(wc.lpszClassName, instance);
+    ReleasePauseBackdrop();
+    ReleaseBackBuffer();
+    DeleteGameBrushes();
+    DeleteGameFonts();
+    GdiplusShutdown(gdiplusToken);
+    printf(passed ? "no steady-state frame allocated\n" : "allocation test FAILED\n");
+    return passed;
+}
+
+// Play a bot match into two DIB sections, one redrawn in full every frame
+// and one only through its dirty rects, and compare them byte for byte
+// after every frame
+bool RunDirtyRectTest(int frames) {
+    const int width = WINDOW_WIDTH;
+    const int height = WINDOW_HEIGHT;
+    const size_t frameBytes = (size_t)width * height * sizeof(uint32_t);
+
+    GdiplusStartupInput gdiplusStartupInput;
+    GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
+    CreateGameFonts();
+    CreateGameBrushes();
+    HDC screenDC = GetDC(NULL);
+    HDC dcs[2];
+    HBITMAP bitmaps[2];
+    HBITMAP oldBitmaps[2];
+    uint32_t* pixels[2];
+    for (int k = 0; k < 2; k++) {
+        BITMAPINFO info = {};
+        info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        info.bmiHeader.biWidth = width;
+        info.bmiHeader.biHeight = -height;
+        info.bmiHeader.biPlanes = 1;
+        info.bmiHeader.biBitCount = 32;
+        info.bmiHeader.biCompression = BI_RGB;
+        void* bits = nullptr;
+        dcs[k] = CreateCompatibleDC(screenDC);
+        bitmaps[k] = CreateDIBSection(screenDC, &info, DIB_RGB_COLORS, &bits, NULL, 0);
+        pixels[k] = (uint32_t*)bits;
+        oldBitmaps[k] = (HBITMAP)SelectObject(dcs[k], bitmaps[k]);
+    }
+    ReleaseDC(NULL, screenDC);
+
+    partyBalls.count = 0;
+    ResetMatch(match, width, height);
+    SyncSimulation();
+    playfieldValid = false;
+    BotController bots[2] = {{0.6f, 0.0f}, {0.8f, 0.0f}};
+    unsigned rng = 777u;
+    int lastHits = 0;
+    int mismatchedFrames = 0;
+    int firstMismatch = -1;
+    int fullFrames = 0;
+    double dirtyArea = 0.0;
+    for (int frame = 0; frame < frames; frame++) {
+        // Jittered frames between 100 and 150 Hz, so the ball is drawn
+        // between ticks
+        float elapsed = (float)((0.8 + 0.4 * NextRandom(rng)) / 120.0);
+        float centreY = height / 2.0f;
+        float leftTarget = match.ballVelocityX < 0 ? match.ballY : centreY;
+        float rightTarget = match.ballVelocityX > 0 ? match.ballY : centreY;
+        MatchInput input = {BotWantsUp(bots[0], match.leftPaddleY, leftTarget),
+                            BotWantsDown(bots[0], match.leftPaddleY, leftTarget),
+                            BotWantsUp(bots[1], match.rightPaddleY, rightTarget),
+                            BotWantsDown(bots[1], match.rightPaddleY, rightTarget)};
+        AdvanceSimulation(elapsed, input, width, height);
+        if (match.hitCount != lastHits) {
+            for (int k = 0; k < 2; k++) {
+                bots[k].aimError = (NextRandom(rng) - 0.5f) * (1.0f - bots[k].skill) * PADDLE_HEIGHT * 2.0f;
+            }
+            lastHits = match.hitCount;
+        }
+
+        for (int k = 0; k < 2; k++) {
+            Graphics graphics(dcs[k]);
+            graphics.SetSmoothingMode(SmoothingModeAntiAlias);
+            if (k == 0) {
+                dirtyRectCount = -1;
+            } else {
+                CollectPlayfieldDirtyRects(drawnMatch, width, height);
+                if (dirtyRectCount < 0) {
+                    fullFrames++;
+                }
+                for (int i = 0; i < dirtyRectCount; i++) {
+                    const RECT& dirty = dirtyRects[i];
+                    dirtyArea += (double)(dirty.right - dirty.left) * (dirty.bottom - dirty.top);
+                }
+            }
+            DrawPlayfield(graphics, drawnMatch, width, height, gameFonts.score, gameFonts.centered);
+        }
+        GdiFlush();
+        if (memcmp(pixels[0], pixels[1], frameBytes) != 0) {
+            mismatchedFrames++;
+            if (firstMismatch < 0) {
+                firstMismatch = frame;
+            }
+        }
+    }
+
+    printf("%d frames, %d-%d, %d full redraws\n", frames, match.leftScore, match.rightScore, fullFrames);
+    printf("dirty rects cover %.2f%% of the frame on average\n",
+           dirtyArea * 100.0 / ((double)width * height * std::max(frames - fullFrames, 1)));
+    if (mismatchedFrames > 0) {
+        printf("%d frames differ from a full redraw, the first is frame %d\n", mismatchedFrames, firstMismatch);
+    } else {
+        printf("every frame matches a full redraw byte for byte\n");
+    }
+
+    dirtyRectCount = -1;
+    playfieldValid = false;
+    ResetMatch(match, width, height);
+    SyncSimulation();
+    for (int k = 0; k < 2; k++) {
+        SelectObject(dcs[k], oldBitmaps[k]);
+        DeleteObject(bitmaps[k]);
+        DeleteDC(dcs[k]);
+    }
+    DeleteGameBrushes();
+    DeleteGameFonts();
+    GdiplusShutdown(gdiplusToken);
+    return mismatchedFrames == 0;
+}
+
+// Render the pause screen's raster layers offscreen with an increasing
+// number of worker threads. Every frame is hashed so each thread count can
+// be checked against the single-threaded pixels.
+void RunRasterBenchmark(int frames) {
+    const int width = WINDOW_WIDTH;
+    const int height = WINDOW_HEIGHT;
+    std::vector<uint32_t> pixels(width * height);
+    SetRasterTarget(&pixels[0], width, height, width);
+    ResetMatch(match, width, height);
+
+    int frameWidth = PAUSE_FRAME_WIDTH;
+    int frameHeight = PAUSE_FRAME_HEIGHT;
+    int frameX, frameY;
+    PauseFrameRect(width, height, frameX, frameY);
+    int optionWidth = 400;
+    int optionX = frameX + (frameWidth - optionWidth) / 2;
+
+    int maxWorkers = std::min((int)std::thread::hardware_concurrency() - 1, RASTER_MAX_WORKERS);
+    std::vector<int> workerCounts;
+    workerCounts.push_back(0);
+    for (int workers = 1; ; workers = workers * 2 + 1) {
+        workerCounts.push_back(std::min(workers, std::max(maxWorkers, 1)));
+        if (workers >= maxWorkers) break;
+    }
+
+    printf("pause screen raster layers, %dx%d, %d frames\n", width, height, frames);
+    printf("threads  ms/frame  speedup  pixels\n");
+    double baseMs = 0.0;
+    uint64_t baseHash = 0;
+    for (size_t run = 0; run < workerCounts.size(); run++) {
+        StartRasterWorkers(workerCounts[run]);
+        double seconds = 0.0;
+        uint64_t hash = 1469598103934665603ull;
+        for (int frame = 0; frame < frames; frame++) {
+            pauseAnimTime = frame * 0.05f;
+            pauseMenuSelection = frame / 30 % 2;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            QueuePausedScene(match, width, height);
+            FlushRaster();
+            QueuePauseBackdrop(width, height, frameX, frameY, frameWidth, frameHeight);
+            QueuePauseParticles(width, height, frameX, frameY, frameWidth, frameHeight);
+            FlushRaster();
+            QueuePauseOptions(optionX, frameY + 220, optionWidth, 90, 120);
+            FlushRaster();
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            for (size_t i = 0; i < pixels.size(); i++) {
+                hash = (hash ^ pixels[i]) * 1099511628211ull;
+            }
+        }
+        StopRasterWorkers();
+
+        double ms = seconds * 1000.0 / frames;
+        if (run == 0) {
+            baseMs = ms;
+            baseHash = hash;
+        }
+        printf("%7d  %8.3f  %6.2fx  %s\n", workerCounts[run] + 1, ms, baseMs / ms,
+               hash == baseHash ? "identical" : "MISMATCH");
+    }
+    pauseAnimTime = 0.0f;
+    pauseMenuSelection = 0;
+    SetRasterTarget(nullptr, 0, 0, 0);
+}
+
+// Draw each raster primitive over the same opaque background with GDI+ and
+// with the tile rasterizer and report how far apart the pictures are, per
+// colour channel. Fills must match GDI+ to one level; gradients and ellipse
+// edges are only reported, since they round differently (see the readme).
+struct RasterCompareCase {
+    const char* name;
+    RasterOp op;
+    int x, y, width, height;
+    uint32_t color;
+    uint32_t endColor;
+};
+
+bool RunRasterCompare() {
+    const int width = 512;
+    const int height = 384;
+    const uint32_t background = 0xFF303030u;
+    const RasterCompareCase cases[] = {
+        {"opaque fill", RASTER_FILL, 37, 21, 301, 203, 0xFF4080C0u, 0},
+        {"translucent fill", RASTER_FILL, 37, 21, 301, 203, 0xB40A0A1Eu, 0},
+        {"faint fill", RASTER_FILL, 0, 0, width, height, 0x28FFFFFFu, 0},
+        {"gradient", RASTER_VERTICAL_GRADIENT, 0, 0, width, height, 0xDC000014u, 0xDC140028u},
+        {"opaque gradient", RASTER_VERTICAL_GRADIENT, 50, 40, 200, 300, 0xFF0A0A1Eu, 0xFFC80A32u},
+        {"ellipse", RASTER_ELLIPSE, 100, 80, 240, 160, 0x64FFFFFFu, 0},
+        {"small ellipse", RASTER_ELLIPSE, 203, 151, 12, 12, 0xFF64C8FFu, 0},
+    };
+
+    GdiplusStartupInput gdiplusStartupInput;
+    GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
+    HDC screenDC = GetDC(NULL);
+    AcquireBackBuffer(screenDC, width, height);
+    ReleaseDC(NULL, screenDC);
+    Graphics& graphics = *backBufferGraphics;
+    graphics.SetSmoothingMode(SmoothingModeAntiAlias);
+    SetRasterTarget(backBufferPixels, width, height, width);
+    std::vector<uint32_t> reference((size_t)width * height);
+
+    bool passed = true;
+    printf("%-18s %9s %14s\n", "primitive", "max diff", "pixels off >1");
+    for (const RasterCompareCase& c : cases) {
+        graphics.Clear(Color(background));
+        if (c.op == RASTER_VERTICAL_GRADIENT) {
+            LinearGradientBrush brush(Rect(c.x, c.y, c.width, c.height), Color(c.color), Color(c.endColor),
+                                      LinearGradientModeVertical);
+            graphics.FillRectangle(&brush, c.x, c.y, c.width, c.height);
+        } else {
+            SolidBrush brush(Color(c.color));
+            if (c.op == RASTER_ELLIPSE) {
+                graphics.FillEllipse(&brush, c.x, c.y, c.width, c.height);
+            } else {
+                graphics.FillRectangle(&brush, c.x, c.y, c.width, c.height);
+            }
+        }
+        graphics.Flush(FlushIntentionSync);
+        GdiFlush();
+        reference.assign(backBufferPixels, backBufferPixels + reference.size());
+
+        RasterFillRect(0, 0, width, height, background);
+        QueueRasterCommand(c.op, c.x, c.y, c.width, c.height, c.color, c.endColor);
+        FlushRaster();
+
+        int maxDiff = 0;
+        long long off = 0;
+        for (size_t i = 0; i < reference.size(); i++) {
+            int pixelDiff = 0;
+            for (int shift = 0; shift < 24; shift += 8) {
+                int diff = abs((int)((reference[i] >> shift) & 0xFF) - (int)((backBufferPixels[i] >> shift) & 0xFF));
+                pixelDiff = std::max(pixelDiff, diff);
+            }
+            maxDiff = std::max(maxDiff, pixelDiff);
+            off += pixelDiff > 1;
+        }
+        bool matches = c.op != RASTER_FILL || maxDiff <= 1;
+        printf("%-18s %9d %14lld%s\n", c.name, maxDiff, off, matches ? "" : "  MISMATCH");
+        passed = passed && matches;
+    }
+
+    SetRasterTarget(nullptr, 0, 0, 0);
+    ReleaseBackBuffer();
+    GdiplusShutdown(gdiplusToken);
+    return passed;
+}
+
+// CPU time of MENU frames drawn live and from the atlas over one full
+// animation period, plus how far the two pictures are apart
+void RunMenuAtlasBenchmark(int frames) {
+    const int width = WINDOW_WIDTH;
+    const int height = WINDOW_HEIGHT;
+    const float period = 20.0f * 3.14159265f;
+    const int compareEvery = std::max(frames / 8, 1);
+
+    GdiplusStartupInput gdiplusStartupInput;
+    GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
+    CreateGameFonts();
+    backgroundImage = new Image(BACKGROUND_IMAGE);
+    HDC screenDC = GetDC(NULL);
+    HDC memDC = AcquireBackBuffer(screenDC, width, height);
+    ReleaseDC(NULL, screenDC);
+    SetRasterTarget(backBufferPixels, width, height, width);
+
+    double seconds[2] = {0.0, 0.0};
+    double bakeMs = 0.0;
+    double differenceSum = 0.0;
+    long long differingPixels = 0;
+    int comparedFrames = 0;
+    std::vector<uint32_t> atlasFrame((size_t)width * height);
+    {
+        Graphics graphics(memDC);
+        graphics.SetSmoothingMode(SmoothingModeAntiAlias);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        BakeMenuAtlas(menuAtlas, width, height);
+        bakeMs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000.0;
+
+        for (int pass = 0; pass < 2; pass++) {
+            menuAtlasEnabled = pass == 1;
+            for (int frame = 0; frame < frames; frame++) {
+                menuAnimTime = period * frame / frames;
+                start = std::chrono::steady_clock::now();
+                DrawMenuScreen(graphics, width, height);
+                graphics.Flush(FlushIntentionSync);
+                GdiFlush();
+                seconds[pass] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                // Draw the same phase live and compare (not timed)
+                if (pass == 1 && frame % compareEvery == 0) {
+                    memcpy(&atlasFrame[0], backBufferPixels, atlasFrame.size() * sizeof(uint32_t));
+                    menuAtlasEnabled = false;
+                    DrawMenuScreen(graphics, width, height);
+                    graphics.Flush(FlushIntentionSync);
+                    GdiFlush();
+                    menuAtlasEnabled = true;
+                    for (size_t i = 0; i < atlasFrame.size(); i++) {
+                        int largest = 0;
+                        for (int c = 0; c < 24; c += 8) {
+                            int difference = abs((int)((atlasFrame[i] >> c) & 0xFF) - (int)((backBufferPixels[i] >> c) & 0xFF));
+                            differenceSum += difference;
+                            largest = std::max(largest, difference);
+                        }
+                        if (largest > 16) differingPixels++;
+                    }
+                    comparedFrames++;
+                }
+            }
+        }
+    }
+
+    size_t frameBytes = (size_t)width * height * sizeof(uint32_t);
+    printf("menu %dx%d, %d frames over one animation period\n", width, height, frames);
+    if (menuAtlas.failed) {
+        printf("atlas over the %zu KB budget, both runs drew live\n", menuAtlasBudgetBytes / 1024);
+    } else {
+        printf("atlas: %zu KB of %zu KB budget (a full frame is %zu KB), baked in %.1f ms\n",
+               MenuAtlasBytes(menuAtlas) / 1024, menuAtlasBudgetBytes / 1024, frameBytes / 1024, bakeMs);
+        printf("  %zu overlay tiles, background %s\n", menuAtlas.overlay.size(),
+               menuAtlas.hasBackground ? "baked" : "drawn live");
+    }
+    double liveMs = seconds[0] * 1000.0 / frames;
+    double atlasMs = seconds[1] * 1000.0 / frames;
+    printf("live   %7.3f ms/frame\n", liveMs);
+    printf("atlas  %7.3f ms/frame  (%.1fx)\n", atlasMs, liveMs / atlasMs);
+    double pixels = (double)comparedFrames * width * height;
+    printf("atlas vs live: mean channel difference %.2f, %.2f%% of pixels off by more than 16\n",
+           differenceSum / (pixels * 3), differingPixels * 100.0 / pixels);
+
+    menuAnimTime = 0.0f;
+    menuAtlasEnabled = true;
+    menuAtlas = MenuAtlas();
+    SetRasterTarget(nullptr, 0, 0, 0);
+    ReleaseBackBuffer();
+    delete backgroundImage;
+    backgroundImage = nullptr;
+    DeleteGameFonts();
+    GdiplusShutdown(gdiplusToken);
+}
+
+// Run the message loop's frame scheduling with real waits in each idle
+// situation, count the frames it asks for and the CPU time the loop itself
+// uses, and scale both to a minute. Painting is left out (the telemetry
+// frame times cover it), so this checks the schedule: no more frames than
+// the state's interval allows, none while hidden or minimized, and
+// blocking rather than spinning in between.
+struct IdleScenario {
+    const char* name;
+    GameState state;
+    bool minimized;
+    bool hidden;
+};
+
+double ThreadCpuMs() {
+    FILETIME creation, exited, kernel, user;
+    GetThreadTimes(GetCurrentThread(), &creation, &exited, &kernel, &user);
+    ULONGLONG kernelTime = ((ULONGLONG)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    ULONGLONG userTime = ((ULONGLONG)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (kernelTime + userTime) / 10000.0;  // 100 ns units
+}
+
+bool RunIdleTest() {
+    const double seconds = 5.0;
+    const double maxCpuFraction = 0.02;
+    const IdleScenario scenarios[5] = {
+        {"menu", MENU, false, false},
+        {"paused", PAUSED, false, false},
+        {"paused hidden", PAUSED, false, true},
+        {"menu hidden", MENU, false, true},
+        {"minimized", MENU, true, false},
+    };
+    GameState savedState = gameState;
+    bool savedCountdown = isCountingDown;
+    bool passed = true;
+
+    timeBeginPeriod(1);
+    printf("%-14s %14s %14s %16s\n", "state", "frames/minute", "limit/minute", "loop CPU ms/min");
+    for (int sc = 0; sc < 5; sc++) {
+        const IdleScenario& scenario = scenarios[sc];
+        gameState = scenario.state;
+        isCountingDown = false;
+        int frameLimit = 0;
+        if (!scenario.minimized && !scenario.hidden) {
+            frameLimit = (int)(seconds * 1000.0 / FrameWakeIntervalMs()) + 1;
+        }
+
+        int frames = 0;
+        LONGLONG start = QueryCounter();
+        LONGLONG lastFrame = start - MsToCounter(1000);
+        double cpuStart = ThreadCpuMs();
+        while (true) {
+            LONGLONG now = QueryCounter();
+            double remainingMs = seconds * 1000.0 - CounterToMs(now - start);
+            if (remainingMs <= 0) {
+                break;
+            }
+            DWORD waitMs = NextFrameWaitMs(scenario.minimized, scenario.hidden, CounterToMs(now - lastFrame), false);
+            if (waitMs == 0) {
+                frames++;
+                lastFrame = now;
+                continue;
+            }
+            waitMs = std::min(waitMs, (DWORD)ceil(remainingMs));
+            MsgWaitForMultipleObjectsEx(0, NULL, waitMs, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+        }
+        double cpuMs = ThreadCpuMs() - cpuStart;
+
+        double perMinute = 60.0 / seconds;
+        bool ok = frames <= frameLimit && cpuMs <= seconds * 1000.0 * maxCpuFraction;
+        printf("%-14s %14.0f %14.0f %16.1f%s\n", scenario.name, frames * perMinute, frameLimit * perMinute,
+               cpuMs * perMinute, ok ? "" : "  FAILED");
+        passed = passed && ok;
+    }
+    timeEndPeriod(1);
+
+    gameState = savedState;
+    isCountingDown = savedCountdown;
+    printf(passed ? "idle states stay within their frame budget\n" : "idle test FAILED\n");
+    return passed;
+}
+
+// Drive AdvanceSimulation with jittered frame times at common refresh rates
+// and compare where the ball is drawn with its analytic path: a straight
+// line at the launch velocity, reflected off the top and bottom walls at
+// the moment it touches them and relaunched from the centre after a goal.
+// The simulation puts a ball that passed a wall back onto it, which is
+// only exact when the contact falls on a tick, so the bounce scenario is
+// set up that way. For every frame the test looks up how far back along
+// the path the drawn ball is. Interpolation should show a steady lag of
+// one tick with the ball exactly on the path; drawing the latest tick (the
+// old behaviour, shown for comparison) jumps between no lag and one tick.
+// In the party scenario, party balls score around the match ball. Their
+// goals change the score but must not make the match ball skip ahead.
+struct InterpolationScenario {
+    const char* name;
+    float seconds;
+    bool goal;                // the ball scores: check it never slides to the centre
+    float relaunchVelocityX;  // of the ball put back in the centre after the goal
+    float relaunchVelocityY;
+    int partyBallCount;       // sent straight at the left goal along the top of the field
+    MatchState start;
+};
+
+// Where a ball launched from `launch` is `ticks` ticks later with nothing
+// in its way
+void AnalyticBallPosition(const MatchState& launch, double ticks, int height, double& x, double& y) {
+    double span = height - 2.0 * BALL_RADIUS;
+    double along = fmod(launch.ballY - BALL_RADIUS + launch.ballVelocityY * ticks, 2.0 * span);
+    if (along < 0) along += 2.0 * span;
+    x = launch.ballX + launch.ballVelocityX * ticks;
+    y = BALL_RADIUS + (along > span ? 2.0 * span - along : along);
+}
+
+bool RunInterpolationTest() {
+    const int width = WINDOW_WIDTH;
+    const int height = WINDOW_HEIGHT;
+    const float centeredPaddle = (height - PADDLE_HEIGHT) / 2.0f;
+    // 360 - 6 = 59 ticks of 6 px to the top wall, 708 / 6 = 118 across
+    const InterpolationScenario scenarios[4] = {
+        {"straight", 3.0f, false, 0.0f, 0.0f, 0, {centeredPaddle, centeredPaddle, 100.0f, 360.0f, 5.0f, 0.0f, 0, 0, 0}},
+        {"bounces", 3.0f, false, 0.0f, 0.0f, 0, {centeredPaddle, centeredPaddle, 640.0f, 360.0f, 0.0f, -6.0f, 0, 0, 0}},
+        {"goal", 1.0f, true, 5.0f, 3.0f, 0, {600.0f, centeredPaddle, 100.0f, 100.0f, -12.0f, 0.0f, 0, 0, 0}},
+        {"party", 3.0f, false, 0.0f, 0.0f, 6, {centeredPaddle, centeredPaddle, 100.0f, 360.0f, 5.0f, 0.0f, 0, 0, 0}},
+    };
+    const int refreshRates[3] = {60, 144, 240};
+    const double tickSeconds = SIMULATION_TICK_SECONDS;
+    const int lagSteps = 2000;  // lags from 0 to 2 ticks searched in 1/1000 tick steps
+    MatchInput noInput = {false, false, false, false};
+    bool passed = true;
+
+    printf("scenario   Hz  frames  lag ms: latest       interp       off path px     behind px  repeated frames   smeared\n");
+    printf("                               min    max   min    max   latest  interp  interp     latest  interp    latest  interp\n");
+    for (int sc = 0; sc < 4; sc++) {
+        const InterpolationScenario& scenario = scenarios[sc];
+        // The tick the ball is over the goal line, and where it starts again
+        int goalTick = -1;
+        MatchState relaunch = scenario.start;
+        if (scenario.goal) {
+            goalTick = 1;
+            while (scenario.start.ballX + scenario.start.ballVelocityX * goalTick + BALL_RADIUS >= 0) goalTick++;
+            relaunch.ballX = width / 2.0f;
+            relaunch.ballY = height / 2.0f;
+            relaunch.ballVelocityX = scenario.relaunchVelocityX;
+            relaunch.ballVelocityY = scenario.relaunchVelocityY;
+        }
+        auto truth = [&](double ticks, double& x, double& y) {
+            if (goalTick >= 0 && ticks >= goalTick) {
+                AnalyticBallPosition(relaunch, ticks - goalTick, height, x, y);
+            } else {
+                AnalyticBallPosition(scenario.start, ticks, height, x, y);
+            }
+        };
+
+        for (int r = 0; r < 3; r++) {
+            match = scenario.start;
+            // A row each, clear of the paddles and each other, reaching
+            // the goal on different ticks (the first after 70)
+            SpawnPartyBalls(partyBalls, scenario.partyBallCount, width, height);
+            for (int i = 0; i < partyBalls.count; i++) {
+                partyBalls.x[i] = width / 2.0f;
+                partyBalls.y[i] = 30.0f + i * 20.0f;
+                partyBalls.velocityX[i] = -4.0f - i;
+                partyBalls.velocityY[i] = 0.0f;
+            }
+            SyncSimulation();
+            unsigned rng = 4242u + r;
+            double now = 0.0;
+            int frames = 0;
+            double lagMin[2] = {1e9, 1e9};
+            double lagMax[2] = {-1e9, -1e9};
+            double lastLag[2] = {1.0, 1.0};
+            double offPath[2] = {0.0, 0.0};
+            double behind = 0.0;
+            int repeated[2] = {0, 0};
+            int smeared[2] = {0, 0};
+            float lastX[2] = {-1.0f, -1.0f};
+            float lastY[2] = {-1.0f, -1.0f};
+            double lastTruthX = scenario.start.ballX;
+            double lastTruthY = scenario.start.ballY;
+            while (now < scenario.seconds) {
+                float elapsed = (float)((0.9 + 0.2 * NextRandom(rng)) / refreshRates[r]);
+                now += elapsed;
+                AdvanceSimulation(elapsed, noInput, width, height);
+                frames++;
+
+                double frameTicks = now / tickSeconds;
+                double truthX, truthY;
+                truth(frameTicks, truthX, truthY);
+                bool truthMoved = truthX != lastTruthX || truthY != lastTruthY;
+                lastTruthX = truthX;
+                lastTruthY = truthY;
+                // The first tick has no earlier state to draw, and the ball
+                // is off the field on either side of the goal
+                bool measured = frameTicks >= 1.0 && !(goalTick >= 0 && frameTicks >= goalTick - 1 && frameTicks < goalTick + 1);
+
+                const MatchState* shown[2] = {&match, &drawnMatch};
+                for (int k = 0; k < 2; k++) {
+                    float x = shown[k]->ballX;
+                    float y = shown[k]->ballY;
+                    if (measured) {
+                        // Closest point of the path up to two ticks back; a
+                        // point just off a wall is on the path both before and
+                        // after the bounce, so keep the lag nearest the last one
+                        double bestDistance = 1e9;
+                        for (int step = 0; step <= lagSteps; step++) {
+                            double pathX, pathY;
+                            truth(frameTicks - step * 2.0 / lagSteps, pathX, pathY);
+                            bestDistance = std::min(bestDistance, hypot(x - pathX, y - pathY));
+                        }
+                        double lag = -1.0;
+                        for (int step = 0; step <= lagSteps; step++) {
+                            double candidate = step * 2.0 / lagSteps;
+                            double pathX, pathY;
+                            truth(frameTicks - candidate, pathX, pathY);
+                            if (hypot(x - pathX, y - pathY) <= bestDistance + 0.01 &&
+                                (lag < 0 || fabs(candidate - lastLag[k]) < fabs(lag - lastLag[k]))) {
+                                lag = candidate;
+                            }
+                        }
+                        lastLag[k] = lag;
+                        lagMin[k] = std::min(lagMin[k], lag);
+                        lagMax[k] = std::max(lagMax[k], lag);
+                        offPath[k] = std::max(offPath[k], bestDistance);
+                        if (k == 1) {
+                            behind = std::max(behind, hypot(x - truthX, y - truthY));
+                        }
+                        // The ball moved but the frame shows it where it was
+                        if (truthMoved && x == lastX[k] && y == lastY[k]) {
+                            repeated[k]++;
+                        }
+                    }
+                    // Between the last spot before the goal and the centre
+                    if (scenario.goal && y > scenario.start.ballY + 0.5f && y < height / 2.0f - 0.5f) {
+                        smeared[k]++;
+                    }
+                    lastX[k] = x;
+                    lastY[k] = y;
+                }
+            }
+            double tickMs = tickSeconds * 1000.0;
+            printf("%-8s  %3d  %6d  %12.2f %6.2f %6.2f %6.2f  %7.3f %7.3f  %6.2f  %8d  %6d  %8d  %6d\n", scenario.name,
+                   refreshRates[r], frames, lagMin[0] * tickMs, lagMax[0] * tickMs, lagMin[1] * tickMs,
+                   lagMax[1] * tickMs, offPath[0], offPath[1], behind, repeated[0], repeated[1], smeared[0], smeared[1]);
+            if (lagMin[1] < 0.99 || lagMax[1] > 1.01 || offPath[1] > 0.02 || repeated[1] > 0 || smeared[1] > 0) {
+                passed = false;
+            }
+            // The match ball never scores in the party scenario, so these
+            // are all party ball goals
+            if (scenario.partyBallCount > 0 && match.leftScore + match.rightScore == 0) {
+                printf("    no party ball scored\n");
+                passed = false;
+            }
+        }
+    }
+    partyBalls.count = 0;
+    printf("interpolated frames lag the simulation by one tick (%.2f ms)\n", tickSeconds * 1000.0);
+    printf(passed ? "interpolated frames follow the ball\n" : "interpolation FAILED\n");
+    ResetMatch(match, width, height);
+    SyncSimulation();
+    return passed;
+}
 
-                // Instruction text
-                RectF instructionRect(0, clientHeight - 50, clientWidth, 40);
-                graphics.DrawString(L"Navigate with ARROWS  •  Confirm with ENTER  •  ESC to Quit", -1, &instructionFont, instructionRect, &stringFormat, &instructionBrush);
+// Hash a bot match tick by tick, as RecordStateHash would. `nudgeTick`
+// changes the ball's vertical speed by one float step before that tick.
+void RecordBotMatchHashes(int ticks, int nudgeTick, std::vector<StateHashRecord>& records) {
+    HostedMatch hm = {};
+    ResetMatch(hm.state, WINDOW_WIDTH, WINDOW_HEIGHT);
+    hm.left.skill = 0.85f;
+    hm.right.skill = 0.9f;
+    hm.rng = 99u;
+    uint64_t chain = 0;
+    records.resize(ticks);
+    for (int tick = 0; tick < ticks; tick++) {
+        if (tick == nudgeTick) {
+            hm.state.ballVelocityY = nextafterf(hm.state.ballVelocityY, 100.0f);
+        }
+        StepHostedMatch(hm);
+        FillStateHashRecord(records[tick], (uint32_t)tick, hm.state, chain);
+    }
+}
 
-            } else if (gameState == PAUSED) {
-                // Update animation time
-                pauseAnimTime += 0.05f;
+// Time the per-tick hash and check the comparator finds a one-ulp nudge
+bool RunDesyncTest() {
+    const double budgetNs = 20.0;
+    const int ticks = 100000;
+    const int nudgeTick = 54321;
+    std::vector<StateHashRecord> a, b;
+    RecordBotMatchHashes(ticks, -1, a);
 
-                // Draw the game background (frozen state)
-                SolidBrush blackBrush(Color(255, 0, 0, 0));
-                graphics.FillRectangle(&blackBrush, 0, 0, clientWidth, clientHeight);
+    // Cost of RecordStateHash's work on real states. The game hashes the
+    // state it just stepped, so cycle through a cache-sized window of them.
+    const int rounds = 50;
+    const int window = 1024;
+    uint64_t chain = 0;
+    StateHashRecord record;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        for (int tick = 0; tick < ticks; tick++) {
+            FillStateHashRecord(record, (uint32_t)tick, a[tick & (window - 1)].state, chain);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double nsPerTick = seconds * 1e9 / ((double)rounds * ticks);
+    printf("state hash: %.2f ns/tick (budget %.0f ns), chain %016llx\n", nsPerTick, budgetNs,
+           (unsigned long long)chain);
+    if (nsPerTick > budgetNs) {
+        // Timing depends on the machine, so this warns rather than fails
+        printf("warning: state hashing is over its per-tick budget\n");
+    }
 
-                // Draw center line
-                Pen centerLinePen(Color(50, 255, 255, 255), 2);
-                for (int y = 0; y < clientHeight; y += 20) {
-                    graphics.DrawLine(&centerLinePen, clientWidth / 2, y, clientWidth / 2, y + 10);
-                }
+    bool passed = true;
+    RecordBotMatchHashes(ticks, -1, b);
+    printf("identical runs: ");
+    if (!ReportDesync(&a[0], ticks, &b[0], ticks)) {
+        passed = false;
+    }
 
-                // Draw paddles (dimmed)
-                SolidBrush paddleBrush(Color(100, 255, 255, 255));
-                graphics.FillRectangle(&paddleBrush, 15, (int)leftPaddleY, PADDLE_WIDTH, PADDLE_HEIGHT);
-                graphics.FillRectangle(&paddleBrush, clientWidth - 15 - PADDLE_WIDTH, (int)rightPaddleY, PADDLE_WIDTH, PADDLE_HEIGHT);
+    RecordBotMatchHashes(ticks, nudgeTick, b);
+    printf("ball nudged before tick %d: ", nudgeTick);
+    if (ReportDesync(&a[0], ticks, &b[0], ticks) ||
+        FindFirstDesync(&a[0], ticks, &b[0], ticks) != nudgeTick ||
+        !(DifferingStateFields(a[nudgeTick].state, b[nudgeTick].state) & (1 << 5))) {
+        passed = false;
+    }
 
-                // Draw ball (dimmed with glow)
-                SolidBrush ballGlowBrush(Color(50, 255, 255, 255));
-                graphics.FillEllipse(&ballGlowBrush, (int)(ballX - BALL_RADIUS - 2), (int)(ballY - BALL_RADIUS - 2), (BALL_RADIUS + 2) * 2, (BALL_RADIUS + 2) * 2);
-                
-                SolidBrush ballBrush(Color(100, 255, 255, 255));
-                graphics.FillEllipse(&ballBrush, (int)(ballX - BALL_RADIUS), (int)(ballY - BALL_RADIUS), BALL_RADIUS * 2, BALL_RADIUS * 2);
-
-                // Draw scores (dimmed)
-                Font scoreFont(&fontFamily, 48, FontStyleBold, UnitPixel);
-                SolidBrush scoreBrush(Color(100, 255, 255, 255));
-
-                std::wstring leftScoreStr = IntToWString(leftScore);
-                RectF leftScoreRect(0, 30, clientWidth / 2 - 50, 80);
-                graphics.DrawString(leftScoreStr.c_str(), -1, &scoreFont, leftScoreRect, &stringFormat, &scoreBrush);
-
-                std::wstring rightScoreStr = IntToWString(rightScore);
-                RectF rightScoreRect(clientWidth / 2 + 50, 30, clientWidth / 2 - 50, 80);
-                graphics.DrawString(rightScoreStr.c_str(), -1, &scoreFont, rightScoreRect, &stringFormat, &scoreBrush);
-
-                // Draw enhanced semi-transparent overlay with gradient
-                LinearGradientBrush overlayGradient(
-                    Point(0, 0),
-                    Point(0, clientHeight),
-                    Color(220, 0, 0, 20),
-                    Color(220, 20, 0, 40)
-                );
-                graphics.FillRectangle(&overlayGradient, 0, 0, clientWidth, clientHeight);
-
-                // Draw animated particles in pause screen
-                SolidBrush particleBrush(Color(80, 100, 200, 255));
-                for (int i = 0; i < 20; i++) {
-                    float angle = pauseAnimTime * 0.5f + (i * 3.14159f * 2.0f / 20.0f);
-                    float radius = 150 + sin(pauseAnimTime + i) * 30;
-                    float x = clientWidth / 2 + cos(angle) * radius;
-                    float y = clientHeight / 2 + sin(angle) * radius;
-                    int size = 2 + (int)(sin(pauseAnimTime * 2 + i) * 1.5f);
-                    graphics.FillEllipse(&particleBrush, (int)x - size, (int)y - size, size * 2, size * 2);
-                }
+    MatchState positiveZero = a[0].state;
+    MatchState negativeZero = a[0].state;
+    positiveZero.ballVelocityY = 0.0f;
+    negativeZero.ballVelocityY = -0.0f;
+    if (HashMatchState(positiveZero) != HashMatchState(negativeZero)) {
+        printf("-0.0 and 0.0 hash differently\n");
+        passed = false;
+    }
 
-                // Draw decorative frame around pause menu
-                int frameMargin = 80;
-                int frameWidth = 600;
-                int frameHeight = 500;
-                int frameX = (clientWidth - frameWidth) / 2;
-                int frameY = (clientHeight - frameHeight) / 2;
-
-                // Outer glow layers
-                for (int i = 4; i > 0; i--) {
-                    int alpha = 40 - i * 8;
-                    int offset = i * 4;
-                    Pen glowPen(Color(alpha, 100, 200, 255), 3);
-                    graphics.DrawRectangle(&glowPen, frameX - offset, frameY - offset, frameWidth + offset * 2, frameHeight + offset * 2);
-                }
+    printf(passed ? "desync detection ok\n" : "desync detection FAILED\n");
+    return passed;
+}
 
-                // Main frame
-                SolidBrush frameBrush(Color(180, 10, 10, 30));
-                graphics.FillRectangle(&frameBrush, frameX, frameY, frameWidth, frameHeight);
-                
-                Pen framePen(Color(255, 100, 200, 255), 4);
-                graphics.DrawRectangle(&framePen, frameX, frameY, frameWidth, frameHeight);
+// Mix AUDIO_MAX_VOICES voices reading different parts of `source` for
+// `blocks` blocks with `kernels`, `passes` times. The first pass's output is
+// appended to `output`. Returns the seconds per block of the fastest pass.
+double TimeAudioMix(const AudioKernels* kernels, const std::vector<float>& source, int blocks, int passes,
+                    std::vector<int16_t>& output) {
+    audioKernels = kernels;
+    double best = 1e9;
+    for (int pass = 0; pass < passes; pass++) {
+        audioMixer.voiceCount = AUDIO_MAX_VOICES;
+        for (int v = 0; v < AUDIO_MAX_VOICES; v++) {
+            AudioVoice& voice = audioMixer.voices[v];
+            voice.samples = &source[v * 4];
+            voice.length = blocks * AUDIO_BLOCK_FRAMES;
+            voice.position = 0;
+            voice.gainLeft = 0.1f + 0.01f * v;
+            voice.gainRight = 0.7f - 0.01f * v;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int block = 0; block < blocks; block++) {
+            MixAudioBlock(audioMixer);
+            if (pass == 0) {
+                output.insert(output.end(), audioMixer.output, audioMixer.output + AUDIO_BLOCK_FRAMES * 2);
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (pass > 0) {
+            best = std::min(best, seconds / blocks);
+        }
+    }
+    return best;
+}
 
-                // Draw corner accents
-                int accentSize = 30;
-                Pen accentPen(Color(255, 255, 255, 100), 6);
-                
-                // Top-left corner
-                graphics.DrawLine(&accentPen, frameX, frameY, frameX + accentSize, frameY);
-                graphics.DrawLine(&accentPen, frameX, frameY, frameX, frameY + accentSize);
-                
-                // Top-right corner
-                graphics.DrawLine(&accentPen, frameX + frameWidth, frameY, frameX + frameWidth - accentSize, frameY);
-                graphics.DrawLine(&accentPen, frameX + frameWidth, frameY, frameX + frameWidth, frameY + accentSize);
-                
-                // Bottom-left corner
-                graphics.DrawLine(&accentPen, frameX, frameY + frameHeight, frameX + accentSize, frameY + frameHeight);
-                graphics.DrawLine(&accentPen, frameX, frameY + frameHeight, frameX, frameY + frameHeight - accentSize);
-                
-                // Bottom-right corner
-                graphics.DrawLine(&accentPen, frameX + frameWidth, frameY + frameHeight, frameX + frameWidth - accentSize, frameY + frameHeight);
-                graphics.DrawLine(&accentPen, frameX + frameWidth, frameY + frameHeight, frameX + frameWidth, frameY + frameHeight - accentSize);
+// Start the mixer on `sink`, post `sounds` sounds at random intervals and
+// print how long each took to reach the output. Returns false if the mixer
+// thread allocated or lost a sound.
+bool RunAudioLatency(const AudioSink* sink, int sounds) {
+    if (!StartAudio(sink, nullptr)) {
+        printf("%s sink: no output device\n", sink->name);
+        return true;
+    }
+    unsigned rng = 7u;
+    for (int i = 0; i < sounds; i++) {
+        std::this_thread::sleep_for(std::chrono::microseconds(3000 + (int)(NextRandom(rng) * 20000.0f)));
+        PostSound((SoundId)(i % SOUND_COUNT), 1.0f, NextRandom(rng) * 2.0f - 1.0f);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    StopAudio();
 
-                // Draw pause title with glow and pulsing effect
-                Font pauseTitleFont(&fontFamily, 80, FontStyleBold, UnitPixel);
-                float titlePulse = 0.9f + sin(pauseAnimTime * 3.0f) * 0.1f;
-                
-                // Multiple glow layers for title
-                for (int i = 5; i > 0; i--) {
-                    int alpha = (int)((60 - i * 10) * titlePulse);
-                    SolidBrush glowBrush(Color(alpha, 255, 100, 100));
-                    RectF glowRect(frameX - i * 3, frameY + 40 - i * 2, frameWidth + i * 6, 100);
-                    graphics.DrawString(L"⏸ PAUSED", -1, &pauseTitleFont, glowRect, &stringFormat, &glowBrush);
-                }
-                
-                // Main title with gradient
-                RectF pauseTitleRect(frameX, frameY + 40, frameWidth, 100);
-                LinearGradientBrush titleGradient(
-                    Point(frameX + frameWidth / 2, frameY + 40),
-                    Point(frameX + frameWidth / 2, frameY + 140),
-                    Color((int)(255 * titlePulse), 255, 150, 150),
-                    Color((int)(255 * titlePulse), 255, 100, 100)
-                );
-                graphics.DrawString(L"⏸ PAUSED", -1, &pauseTitleFont, pauseTitleRect, &stringFormat, &titleGradient);
+    uint32_t count = std::min(audioStats.latencyCount, AUDIO_LATENCY_SAMPLES);
+    std::vector<float> latencies(audioStats.latencyMs, audioStats.latencyMs + count);
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0.0;
+    for (uint32_t i = 0; i < count; i++) {
+        sum += latencies[i];
+    }
+    if (count > 0) {
+        printf("%s sink: trigger to output avg %.2f ms, p99 %.2f ms, max %.2f ms over %u sounds\n", sink->name,
+               sum / count, latencies[count * 99 / 100], latencies[count - 1], count);
+    }
+    printf("%s sink: %u blocks, %u underruns, %.2f us mixing per block, %lld operator new calls on the mixer thread\n",
+           sink->name, audioStats.blocks, audioStats.underruns,
+           CounterToMs(audioStats.mixCounter) * 1000.0 / std::max(1u, audioStats.blocks),
+           audioStats.mixerAllocations);
+    return audioStats.mixerAllocations == 0 && audioStats.latencyCount == (uint32_t)sounds &&
+           audioQueue.droppedCommands == 0;
+}
 
-                // Draw decorative line under title
-                Pen dividerPen(Color(200, 100, 200, 255), 2);
-                int dividerY = frameY + 160;
-                graphics.DrawLine(&dividerPen, frameX + 50, dividerY, frameX + frameWidth - 50, dividerY);
+// A bot match's sounds mixed on this thread and written to a WAV file,
+// one block whenever the match gets ahead of the audio
+bool RenderMatchAudio(const char* path, int seconds) {
+    if (!WAV_AUDIO_SINK.open(path)) {
+        printf("cannot write %s\n", path);
+        return false;
+    }
+    ResetAudio();
+    audioEnabled = true;
+    HostedMatch hm = {};
+    ResetMatch(hm.state, WINDOW_WIDTH, WINDOW_HEIGHT);
+    hm.left.skill = 0.85f;
+    hm.right.skill = 0.9f;
+    hm.rng = 99u;
+    long long mixedFrames = 0;
+    for (int tick = 0; tick < seconds * SIMULATION_TICK_RATE; tick++) {
+        PlayMatchSounds(StepHostedMatch(hm), hm.state, WINDOW_WIDTH);
+        while (mixedFrames < (long long)(tick + 1) * AUDIO_SAMPLE_RATE / SIMULATION_TICK_RATE) {
+            WAV_AUDIO_SINK.wait();
+            DrainAudioCommands(audioMixer);
+            MixAudioBlock(audioMixer);
+            WAV_AUDIO_SINK.write(audioMixer.output, AUDIO_BLOCK_FRAMES);
+            mixedFrames += AUDIO_BLOCK_FRAMES;
+        }
+    }
+    audioEnabled = false;
+    WAV_AUDIO_SINK.close();
+    printf("wrote %d s of a bot match (%u sounds) to %s\n", seconds, audioStats.voicesStarted, path);
+    return true;
+}
 
-                if (isCountingDown) {
-                    // Update countdown timer
-                    countdownTimer -= 0.016f; // Decrease by ~60FPS
-                    if (countdownTimer <= 0.0f) {
-                        countdownTimer = 0.0f;
-                        gameState = PLAYING;
-                        isCountingDown = false;
-                    }
+// Check the SIMD mix loops against the scalar ones, time them with every
+// voice busy, then measure trigger-to-output latency through the null sink
+// and the sound device. Optionally renders a bot match to `wavPath`.
+bool RunAudioBenchmark(const char* wavPath) {
+    const int blocks = 400;
+    const int passes = 20;
+    ResetAudio();
+    std::vector<float> source(blocks * AUDIO_BLOCK_FRAMES + AUDIO_MAX_VOICES * 4);
+    unsigned rng = 5u;
+    for (size_t i = 0; i < source.size(); i++) {
+        source[i] = NextRandom(rng) * 2.0f - 1.0f;
+    }
 
-                    // Draw countdown with elaborate effects
-                    int countdown = (int)countdownTimer + 1;
-                    if (countdown > 3) countdown = 3;
-                    
-                    Font countdownFont(&fontFamily, 180, FontStyleBold, UnitPixel);
-                    std::wstring countdownStr = IntToWString(countdown);
-                    
-                    // Countdown animation effects
-                    float countdownScale = 1.0f + (1.0f - (countdownTimer - (int)countdownTimer)) * 0.3f;
-                    int countdownAlpha = (int)(255 * (0.3f + (countdownTimer - (int)countdownTimer) * 0.7f));
-                    
-                    // Outer glow rings
-                    for (int ring = 5; ring > 0; ring--) {
-                        int ringAlpha = (int)((100 - ring * 15) * (countdownTimer - (int)countdownTimer));
-                        SolidBrush ringBrush(Color(ringAlpha, 100, 255, 100));
-                        RectF ringRect(frameX - ring * 5, frameY + 200 - ring * 5, frameWidth + ring * 10, 200);
-                        graphics.DrawString(countdownStr.c_str(), -1, &countdownFont, ringRect, &stringFormat, &ringBrush);
-                    }
-                    
-                    // Main countdown number with gradient
-                    RectF countdownRect(frameX, frameY + 200, frameWidth, 200);
-                    LinearGradientBrush countdownGradient(
-                        Point(frameX + frameWidth / 2, frameY + 200),
-                        Point(frameX + frameWidth / 2, frameY + 400),
-                        Color(countdownAlpha, 100, 255, 255),
-                        Color(countdownAlpha, 100, 255, 100)
-                    );
-                    graphics.DrawString(countdownStr.c_str(), -1, &countdownFont, countdownRect, &stringFormat, &countdownGradient);
+    bool passed = true;
+    const AudioKernels* sets[2];
+    int count = SupportedAudioKernels(sets);
+    std::vector<int16_t> reference;
+    double blockUs = 1e6 * AUDIO_BLOCK_FRAMES / AUDIO_SAMPLE_RATE;
+    for (int k = 0; k < count; k++) {
+        std::vector<int16_t> output;
+        output.reserve((size_t)blocks * AUDIO_BLOCK_FRAMES * 2);
+        double us = TimeAudioMix(sets[k], source, blocks, passes, output) * 1e6;
+        bool same = k == 0 || output == reference;
+        printf("%-6s mix: %.2f us per block of %d voices (%.2f%% of a %.0f us block)%s\n", sets[k]->name, us,
+               AUDIO_MAX_VOICES, 100.0 * us / blockUs, blockUs, same ? "" : ", output DIFFERS from scalar");
+        if (k == 0) {
+            reference.swap(output);
+        }
+        passed = passed && same;
+    }
 
-                    // Draw "Resuming..." text
-                    Font resumingFont(&fontFamily, 28, FontStyleItalic, UnitPixel);
-                    SolidBrush resumingBrush(Color(200, 200, 200, 200));
-                    RectF resumingRect(frameX, frameY + 420, frameWidth, 40);
-                    graphics.DrawString(L"Resuming game...", -1, &resumingFont, resumingRect, &stringFormat, &resumingBrush);
+    timeBeginPeriod(1);
+    passed = RunAudioLatency(&NULL_AUDIO_SINK, 300) && passed;
+    passed = RunAudioLatency(&WAVE_OUT_AUDIO_SINK, 300) && passed;
+    timeEndPeriod(1);
 
-                } else {
-                    // Draw menu options with cards
-                    int optionY = frameY + 220;
-                    int optionWidth = 400;
-                    int optionHeight = 90;
-                    int optionX = frameX + (frameWidth - optionWidth) / 2;
-                    int optionSpacing = 120;
+    if (wavPath && !RenderMatchAudio(wavPath, 60)) {
+        passed = false;
+    }
+    printf(passed ? "audio ok\n" : "audio FAILED\n");
+    return passed;
+}
 
-                    const wchar_t* optionTexts[] = {L"▶ RESUME", L"🏠 MAIN MENU"};
-                    Color optionColors[] = {
-                        Color(255, 100, 255, 100),  // Green for Resume
-                        Color(255, 255, 100, 100)   // Red for Menu
-                    };
+// A machine for the effects test: paint time at each tier, optionally
+// with a stretch where every frame takes `stallMs`
+struct EffectsScenario {
+    const char* name;
+    float paintMs[EFFECTS_TIER_COUNT];
+    float stallStart;
+    float stallEnd;
+    float stallMs;
+    int expectedTier;   // where it should settle
+    int maxChanges;
+};
 
-                    for (int i = 0; i < 2; i++) {
-                        int currentY = optionY + i * optionSpacing;
-                        bool isSelected = (pauseMenuSelection == i);
-                        
-                        // Calculate pulse effect
-                        float pulse = isSelected ? (0.85f + sin(pauseAnimTime * 5.0f) * 0.15f) : 0.4f;
-                        
-                        // Draw option glow
-                        if (isSelected) {
-                            for (int glow = 3; glow > 0; glow--) {
-                                int glowAlpha = (int)((60 - glow * 15) * pulse);
-                                SolidBrush glowBrush(Color(glowAlpha, optionColors[i].GetR(), optionColors[i].GetG(), optionColors[i].GetB()));
-                                graphics.FillRectangle(&glowBrush, 
-                                    optionX - glow * 4, 
-                                    currentY - glow * 4, 
-                                    optionWidth + glow * 8, 
-                                    optionHeight + glow * 8);
-                            }
-                        }
-                        
-                        // Draw option background
-                        SolidBrush optionBrush(Color((int)(150 * pulse), 20, 20, 50));
-                        graphics.FillRectangle(&optionBrush, optionX, currentY, optionWidth, optionHeight);
-                        
-                        // Draw option border
-                        Pen optionPen(Color((int)(255 * pulse), optionColors[i].GetR(), optionColors[i].GetG(), optionColors[i].GetB()), 
-                                     isSelected ? 5 : 2);
-                        graphics.DrawRectangle(&optionPen, optionX, currentY, optionWidth, optionHeight);
-                        
-                        // Draw selection indicator (animated arrow)
-                        if (isSelected) {
-                            SolidBrush arrowBrush(Color(255, 255, 255, 200));
-                            float arrowOffset = sin(pauseAnimTime * 6.0f) * 8;
-                            
-                            Point arrowPoints[3];
-                            arrowPoints[0] = Point((int)(optionX - 25 + arrowOffset), currentY + optionHeight / 2);
-                            arrowPoints[1] = Point((int)(optionX - 40 + arrowOffset), currentY + optionHeight / 2 - 12);
-                            arrowPoints[2] = Point((int)(optionX - 40 + arrowOffset), currentY + optionHeight / 2 + 12);
-                            graphics.FillPolygon(&arrowBrush, arrowPoints, 3);
-                        }
-                        
-                        // Draw option text
-                        Font optionFont(&fontFamily, 40, FontStyleBold, UnitPixel);
-                        SolidBrush textBrush(Color((int)(255 * pulse), 255, 255, 255));
-                        RectF textRect(optionX, currentY, optionWidth, optionHeight);
-                        graphics.DrawString(optionTexts[i], -1, &optionFont, textRect, &stringFormat, &textBrush);
-                    }
+// Run the governor against simulated slow rendering: every frame takes the
+// scenario's paint time for the current tier, plus or minus 10%, and frames
+// never come faster than 60 FPS. Checks each machine settles on the right
+// tier without flipping back and forth.
+bool RunEffectsTest() {
+    const float seconds = 600.0f;
+    const EffectsScenario scenarios[] = {
+        {"fast machine", {4.0f, 5.0f, 6.0f}, 0.0f, 0.0f, 0.0f, EFFECTS_HIGH, 0},
+        {"slow machine", {8.0f, 12.0f, 24.0f}, 0.0f, 0.0f, 0.0f, EFFECTS_MEDIUM, 1},
+        {"very slow machine", {14.0f, 28.0f, 40.0f}, 0.0f, 0.0f, 0.0f, EFFECTS_LOW, 2},
+        {"fast machine, 2 s stall", {4.0f, 5.0f, 6.0f}, 10.0f, 12.0f, 40.0f, EFFECTS_HIGH, 4},
+        {"high tier just over budget", {6.0f, 9.0f, 17.5f}, 0.0f, 0.0f, 0.0f, EFFECTS_MEDIUM, 3},
+    };
+    bool passed = true;
+    for (const EffectsScenario& scenario : scenarios) {
+        EffectsGovernor g;
+        ResetEffectsGovernor(g, EFFECTS_HIGH);
+        unsigned rng = 17u;
+        float time = 0.0f;
+        float overBudgetSeconds = 0.0f;
+        float tierSeconds[EFFECTS_TIER_COUNT] = {};
+        float settledAt = 0.0f;
+        while (time < seconds) {
+            float paintMs = scenario.paintMs[g.tier] * (0.9f + NextRandom(rng) * 0.2f);
+            if (time >= scenario.stallStart && time < scenario.stallEnd) {
+                paintMs = scenario.stallMs;
+            }
+            float frameSeconds = std::max(paintMs, EFFECTS_FRAME_BUDGET_MS) / 1000.0f;
+            tierSeconds[g.tier] += frameSeconds;
+            if (paintMs > EFFECTS_FRAME_BUDGET_MS) {
+                overBudgetSeconds += frameSeconds;
+            }
+            if (UpdateEffectsGovernor(g, paintMs, frameSeconds)) {
+                settledAt = time;
+            }
+            time += frameSeconds;
+        }
+        bool ok = g.tier == scenario.expectedTier && g.tierChanges <= scenario.maxChanges;
+        printf("%-28s ends %-6s after %2d changes (last at %5.1f s); high/medium/low %5.1f/%5.1f/%5.1f s, "
+               "%4.1f s over budget%s\n", scenario.name, EFFECTS_TIERS[g.tier].name, g.tierChanges, settledAt,
+               tierSeconds[EFFECTS_HIGH], tierSeconds[EFFECTS_MEDIUM], tierSeconds[EFFECTS_LOW], overBudgetSeconds,
+               ok ? "" : "  <- FAILED");
+        if (!ok) {
+            printf("    expected %s with at most %d changes\n", EFFECTS_TIERS[scenario.expectedTier].name,
+                   scenario.maxChanges);
+            passed = false;
+        }
+    }
+    printf(passed ? "effects governor ok\n" : "effects governor FAILED\n");
+    return passed;
+}
 
-                    // Draw instructions at bottom with enhanced styling
-                    Font instructionFont(&fontFamily, 20, FontStyleRegular, UnitPixel);
-                    SolidBrush instructionBrush(Color(180, 200, 200, 200));
-                    RectF instructionRect(frameX, frameY + frameHeight - 60, frameWidth, 40);
-                    graphics.DrawString(L"Use ← → to navigate  •  Press ENTER to select  •  P to resume", 
-                                      -1, &instructionFont, instructionRect, &stringFormat, &instructionBrush);
+// The game is linked as a GUI app, so hook stdout up to the console we were
+// started from (if any) before printing headless results
+void AttachParentConsole() {
+    if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+        freopen("CONOUT$", "w", stdout);
+        freopen("CONOUT$", "w", stderr);
+    }
+}
 
-                    // Draw tip text
-                    Font tipFont(&fontFamily, 16, FontStyleItalic, UnitPixel);
-                    SolidBrush tipBrush(Color(150, 150, 150, 150));
-                    RectF tipRect(frameX, frameY + frameHeight - 30, frameWidth, 25);
-                    graphics.DrawString(L"💡 Take a break, champion!", -1, &tipFont, tipRect, &stringFormat, &tipBrush);
-                }
+// Handle headless command line modes. Returns true if one ran.
+bool RunHeadlessMode(int argc, char** argv) {
+    int players = 0;
+    int threads = (int)std::thread::hardware_concurrency();
+    bool fast = false;
+    bool scaling = false;
+    int partyBenchBalls = 0;
+    const char* telemetryReportPath = nullptr;
+    bool telemetryBench = false;
+    int terminalColumns = 0;
+    bool terminalBench = false;
+    int rasterBenchFrames = 0;
+    int dirtyRectTestFrames = 0;
+    bool allocationTest = false;
+    bool rasterCompare = false;
+    bool pixelKernelTest = false;
+    bool pixelKernelBench = false;
+    bool interpolationTest = false;
+    bool idleTest = false;
+    int menuAtlasBenchFrames = 0;
+    bool desyncTest = false;
+    const char* desyncLogs[2] = {nullptr, nullptr};
+    bool audioBench = false;
+    const char* audioBenchWav = nullptr;
+    bool effectsTest = false;
 
-            } else {
-                // Game is playing - black background only
-                SolidBrush blackBrush(Color(255, 0, 0, 0));
-                graphics.FillRectangle(&blackBrush, 0, 0, clientWidth, clientHeight);
-
-                // Update paddle positions
-                if (wKeyPressed && leftPaddleY > 0) {
-                    leftPaddleY -= currentPaddleSpeed;
-                    if (leftPaddleY < 0) leftPaddleY = 0;
-                }
-                if (sKeyPressed && leftPaddleY < clientHeight - PADDLE_HEIGHT) {
-                    leftPaddleY += currentPaddleSpeed;
-                    if (leftPaddleY > clientHeight - PADDLE_HEIGHT) leftPaddleY = clientHeight - PADDLE_HEIGHT;
-                }
-                if (upKeyPressed && rightPaddleY > 0) {
-                    rightPaddleY -= currentPaddleSpeed;
-                    if (rightPaddleY < 0) rightPaddleY = 0;
-                }
-                if (downKeyPressed && rightPaddleY < clientHeight - PADDLE_HEIGHT) {
-                    rightPaddleY += currentPaddleSpeed;
-                    if (rightPaddleY > clientHeight - PADDLE_HEIGHT) rightPaddleY = clientHeight - PADDLE_HEIGHT;
-                }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--tournament") == 0 && i + 1 < argc) {
+            players = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--host-scaling") == 0 && i + 1 < argc) {
+            players = atoi(argv[++i]);
+            scaling = true;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fast") == 0) {
+            fast = true;
+        } else if (strcmp(argv[i], "--party-bench") == 0 && i + 1 < argc) {
+            partyBenchBalls = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--telemetry-report") == 0 && i + 1 < argc) {
+            telemetryReportPath = argv[++i];
+        } else if (strcmp(argv[i], "--telemetry-bench") == 0) {
+            telemetryBench = true;
+        } else if (strcmp(argv[i], "--terminal") == 0) {
+            terminalColumns = TERMINAL_DEFAULT_COLUMNS;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                terminalColumns = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--terminal-bench") == 0) {
+            terminalBench = true;
+        } else if (strcmp(argv[i], "--pixel-kernel-test") == 0) {
+            pixelKernelTest = true;
+        } else if (strcmp(argv[i], "--pixel-kernel-bench") == 0) {
+            pixelKernelBench = true;
+        } else if (strcmp(argv[i], "--interpolation-test") == 0) {
+            interpolationTest = true;
+        } else if (strcmp(argv[i], "--idle-test") == 0) {
+            idleTest = true;
+        } else if (strcmp(argv[i], "--desync-test") == 0) {
+            desyncTest = true;
+        } else if (strcmp(argv[i], "--desync-compare") == 0 && i + 2 < argc) {
+            desyncLogs[0] = argv[++i];
+            desyncLogs[1] = argv[++i];
+        } else if (strcmp(argv[i], "--effects-test") == 0) {
+            effectsTest = true;
+        } else if (strcmp(argv[i], "--audio-bench") == 0) {
+            audioBench = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                audioBenchWav = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--menu-atlas-bench") == 0) {
+            menuAtlasBenchFrames = 600;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                menuAtlasBenchFrames = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--raster-compare") == 0) {
+            rasterCompare = true;
+        } else if (strcmp(argv[i], "--alloc-test") == 0) {
+            allocationTest = true;
+        } else if (strcmp(argv[i], "--dirty-rect-test") == 0) {
+            dirtyRectTestFrames = 3600;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                dirtyRectTestFrames = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--raster-bench") == 0) {
+            rasterBenchFrames = 300;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                rasterBenchFrames = atoi(argv[++i]);
+            }
+        }
+    }
 
-                // Store previous position for continuous collision detection
-                float prevBallX = ballX;
-                float prevBallY = ballY;
-                
-                // Update ball position
-                ballX += ballVelocityX;
-                ballY += ballVelocityY;
-
-                // Ball collision with top and bottom (screen boundaries)
-                if (ballY - BALL_RADIUS <= 0) {
-                    ballVelocityY = abs(ballVelocityY);
-                    ballY = BALL_RADIUS;
-                } else if (ballY + BALL_RADIUS >= clientHeight) {
-                    ballVelocityY = -abs(ballVelocityY);
-                    ballY = clientHeight - BALL_RADIUS;
-                }
+    if (telemetryReportPath || telemetryBench) {
+        AttachParentConsole();
+        if (telemetryReportPath) {
+            PrintTelemetryReport(telemetryReportPath);
+        } else {
+            RunTelemetryBenchmark();
+        }
+        fflush(stdout);
+        return true;
+    }
 
-                // Continuous collision detection for left paddle
-                if (ballVelocityX < 0) { // Ball moving left
-                    float paddleX = 20;
-                    float paddleTop = leftPaddleY;
-                    float paddleBottom = leftPaddleY + PADDLE_HEIGHT;
-                    
-                    // Check if ball crosses paddle X position
-                    if (prevBallX - BALL_RADIUS > paddleX && ballX - BALL_RADIUS <= paddleX) {
-                        // Calculate Y position when ball reaches paddle X
-                        float t = (paddleX - (prevBallX - BALL_RADIUS)) / (ballVelocityX);
-                        float intersectY = prevBallY + ballVelocityY * t;
-                        
-                        // Check if intersection Y is within paddle bounds (with some tolerance)
-                        if (intersectY >= paddleTop - BALL_RADIUS && intersectY <= paddleBottom + BALL_RADIUS) {
-                            // Collision detected!
-                            hitCount++;
-                            
-                            // Apply speed increase
-                            if (hitCount <= MAX_HITS_FOR_SPEED_INCREASE) {
-                                ballVelocityX = abs(ballVelocityX) * currentSpeedFactor;
-                                ballVelocityY *= currentSpeedFactor;
-                            } else {
-                                ballVelocityX = abs(ballVelocityX);
-                            }
-                            
-                            // Position ball at paddle surface
-                            ballX = paddleX + BALL_RADIUS;
-                            ballY = intersectY;
-                            
-                            // Add trajectory variation based on hit position
-                            float hitPos = (intersectY - paddleTop) / PADDLE_HEIGHT;
-                            hitPos = (hitPos < 0) ? 0 : (hitPos > 1) ? 1 : hitPos;
-                            ballVelocityY += (hitPos - 0.5f) * 6.0f;
-                        }
-                    }
-                }
+    if (pixelKernelTest || pixelKernelBench) {
+        AttachParentConsole();
+        printf("selected pixel kernels: %s\n", pixelKernels->name);
+        bool passed = true;
+        if (pixelKernelTest) {
+            passed = RunPixelKernelTest();
+        }
+        if (pixelKernelBench) {
+            RunPixelKernelBenchmark();
+        }
+        fflush(stdout);
+        if (!passed) {
+            exit(1);
+        }
+        return true;
+    }
 
-                // Continuous collision detection for right paddle
-                if (ballVelocityX > 0) { // Ball moving right
-                    float paddleX = clientWidth - 20;
-                    float paddleTop = rightPaddleY;
-                    float paddleBottom = rightPaddleY + PADDLE_HEIGHT;
-                    
-                    // Check if ball crosses paddle X position
-                    if (prevBallX + BALL_RADIUS < paddleX && ballX + BALL_RADIUS >= paddleX) {
-                        // Calculate Y position when ball reaches paddle X
-                        float t = (paddleX - (prevBallX + BALL_RADIUS)) / (ballVelocityX);
-                        float intersectY = prevBallY + ballVelocityY * t;
-                        
-                        // Check if intersection Y is within paddle bounds (with some tolerance)
-                        if (intersectY >= paddleTop - BALL_RADIUS && intersectY <= paddleBottom + BALL_RADIUS) {
-                            // Collision detected!
-                            hitCount++;
-                            
-                            // Apply speed increase
-                            if (hitCount <= MAX_HITS_FOR_SPEED_INCREASE) {
-                                ballVelocityX = -abs(ballVelocityX) * currentSpeedFactor;
-                                ballVelocityY *= currentSpeedFactor;
-                            } else {
-                                ballVelocityX = -abs(ballVelocityX);
-                            }
-                            
-                            // Position ball at paddle surface
-                            ballX = paddleX - BALL_RADIUS;
-                            ballY = intersectY;
-                            
-                            // Add trajectory variation based on hit position
-                            float hitPos = (intersectY - paddleTop) / PADDLE_HEIGHT;
-                            hitPos = (hitPos < 0) ? 0 : (hitPos > 1) ? 1 : hitPos;
-                            ballVelocityY += (hitPos - 0.5f) * 6.0f;
-                        }
-                    }
-                }
+    if (desyncLogs[0]) {
+        AttachParentConsole();
+        std::vector<StateHashRecord> logs[2];
+        bool agree = false;
+        for (int i = 0; i < 2; i++) {
+            if (!LoadStateHashLog(desyncLogs[i], logs[i])) {
+                printf("cannot read state hash log %s\n", desyncLogs[i]);
+            }
+        }
+        if (!logs[0].empty() && !logs[1].empty()) {
+            agree = ReportDesync(&logs[0][0], (int)logs[0].size(), &logs[1][0], (int)logs[1].size());
+        }
+        fflush(stdout);
+        if (!agree) {
+            exit(1);
+        }
+        return true;
+    }
 
-                // Ball goes off the left side - right player scores
-                if (ballX + BALL_RADIUS < 0) {
-                    rightScore++;
-                    // Reset ball to center
-                    ballX = clientWidth / 2.0f;
-                    ballY = clientHeight / 2.0f;
-                    ballVelocityX = 5.0f; // Start towards right player
-                    ballVelocityY = 3.0f;
-                    hitCount = 0;
-                }
+    if (desyncTest) {
+        AttachParentConsole();
+        bool passed = RunDesyncTest();
+        fflush(stdout);
+        if (!passed) {
+            exit(1);
+        }
+        return true;
+    }
 
-                // Ball goes off the right side - left player scores
-                if (ballX - BALL_RADIUS > clientWidth) {
-                    leftScore++;
-                    // Reset ball to center
-                    ballX = clientWidth / 2.0f;
-                    ballY = clientHeight / 2.0f;
-                    ballVelocityX = -5.0f; // Start towards left player
-                    ballVelocityY = 3.0f;
-                    hitCount = 0;
-                }
+    if (effectsTest) {
+        AttachParentConsole();
+        bool passed = RunEffectsTest();
+        fflush(stdout);
+        if (!passed) {
+            exit(1);
+        }
+        return true;
+    }
 
-                // Draw center line
-                Pen centerLinePen(Color(100, 255, 255, 255), 2);
-                for (int y = 0; y < clientHeight; y += 20) {
-                    graphics.DrawLine(&centerLinePen, clientWidth / 2, y, clientWidth / 2, y + 10);
-                }
+    if (audioBench) {
+        AttachParentConsole();
+        bool passed = RunAudioBenchmark(audioBenchWav);
+        fflush(stdout);
+        if (!passed) {
+            exit(1);
+        }
+        return true;
+    }
 
-                // Draw paddles (vertical rectangles for better visual)
-                SolidBrush paddleBrush(Color(255, 255, 255, 255));
-                graphics.FillRectangle(&paddleBrush, 15, (int)leftPaddleY, PADDLE_WIDTH, PADDLE_HEIGHT);
-                graphics.FillRectangle(&paddleBrush, clientWidth - 15 - PADDLE_WIDTH, (int)rightPaddleY, PADDLE_WIDTH, PADDLE_HEIGHT);
+    if (interpolationTest) {
+        AttachParentConsole();
+        bool passed = RunInterpolationTest();
+        fflush(stdout);
+        if (!passed) {
+            exit(1);
+        }
+        return true;
+    }
 
-                // Draw ball with slight glow
-                SolidBrush ballGlowBrush(Color(100, 255, 255, 255));
-                graphics.FillEllipse(&ballGlowBrush, (int)(ballX - BALL_RADIUS - 2), (int)(ballY - BALL_RADIUS - 2), (BALL_RADIUS + 2) * 2, (BALL_RADIUS + 2) * 2);
-                
-                SolidBrush ballBrush(Color(255, 255, 255, 255));
-                graphics.FillEllipse(&ballBrush, (int)(ballX - BALL_RADIUS), (int)(ballY - BALL_RADIUS), BALL_RADIUS * 2, BALL_RADIUS * 2);
+    if (idleTest) {
+        AttachParentConsole();
+        bool passed = RunIdleTest();
+        fflush(stdout);
+        if (!passed) {
+            exit(1);
+        }
+        return true;
+    }
 
-                // Draw scores
-                Font scoreFont(&fontFamily, 48, FontStyleBold, UnitPixel);
-                SolidBrush scoreBrush(Color(255, 255, 255, 255));
+    if (menuAtlasBenchFrames > 0) {
+        AttachParentConsole();
+        RunMenuAtlasBenchmark(menuAtlasBenchFrames);
+        fflush(stdout);
+        return true;
+    }
 
-                // Left player score
-                std::wstring leftScoreStr = IntToWString(leftScore);
-                RectF leftScoreRect(0, 30, clientWidth / 2 - 50, 80);
-                graphics.DrawString(leftScoreStr.c_str(), -1, &scoreFont, leftScoreRect, &stringFormat, &scoreBrush);
+    if (rasterCompare) {
+        AttachParentConsole();
+        bool passed = RunRasterCompare();
+        fflush(stdout);
+        if (!passed) {
+            exit(1);
+        }
+        return true;
+    }
 
-                // Right player score
-                std::wstring rightScoreStr = IntToWString(rightScore);
-                RectF rightScoreRect(clientWidth / 2 + 50, 30, clientWidth / 2 - 50, 80);
-                graphics.DrawString(rightScoreStr.c_str(), -1, &scoreFont, rightScoreRect, &stringFormat, &scoreBrush);
-            }
+    if (allocationTest) {
+        AttachParentConsole();
+        bool passed = RunAllocationTest();
+        fflush(stdout);
+        if (!passed) {
+            exit(1);
+        }
+        return true;
+    }
 
-            // Copy from memory DC to screen (eliminates flickering)
-            BitBlt(hdc, 0, 0, clientWidth, clientHeight, memDC, 0, 0, SRCCOPY);
-            
-            // Cleanup
-            SelectObject(memDC, oldBitmap);
-            DeleteObject(memBitmap);
-            DeleteDC(memDC);
-            
-            EndPaint(hwnd, &ps);
-            return 0;
+    if (dirtyRectTestFrames > 0) {
+        AttachParentConsole();
+        bool passed = RunDirtyRectTest(dirtyRectTestFrames);
+        fflush(stdout);
+        if (!passed) {
+            exit(1);
         }
-        case WM_ERASEBKGND:
-            // Prevent background erasing to reduce flicker
-            return 1;
-        default:
-            return DefWindowProc(hwnd, msg, wparam, lparam);
+        return true;
+    }
+
+    if (rasterBenchFrames > 0) {
+        AttachParentConsole();
+        RunRasterBenchmark(rasterBenchFrames);
+        fflush(stdout);
+        return true;
+    }
+
+    if (terminalBench) {
+        AttachParentConsole();
+        RunTerminalBenchmark(terminalColumns > 0 ? terminalColumns : TERMINAL_DEFAULT_COLUMNS);
+        fflush(stdout);
+        return true;
+    }
+
+    if (terminalColumns > 0) {
+        RunTerminalGame(terminalColumns);
+        return true;
+    }
+
+    if (partyBenchBalls > 0) {
+        AttachParentConsole();
+        RunPartyBenchmark(partyBenchBalls);
+        fflush(stdout);
+        return true;
+    }
+
+    if (players < 2) {
+        return false;
+    }
+
+    AttachParentConsole();
+    if (threads < 1) threads = 1;
+    if (scaling) {
+        RunHostScaling(players);
+    } else {
+        PrintTournamentStats(RunTournament(players, threads, !fast), threads);
     }
+    fflush(stdout);
+    return true;
 }
 
 int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE hprev, PSTR cmdline, int cmdshow) {
+    // Widest pixel kernels this CPU supports, unless --pixel-kernels names
+    // one, the menu atlas settings, sound and the effects tier
+    const char* forcedKernels = nullptr;
+    bool latencyTest = false;
+    for (int i = 1; i < __argc; i++) {
+        if (strcmp(__argv[i], "--pixel-kernels") == 0 && i + 1 < __argc) {
+            forcedKernels = __argv[i + 1];
+        } else if (strcmp(__argv[i], "--menu-atlas-budget") == 0 && i + 1 < __argc) {
+            menuAtlasBudgetBytes = (size_t)atoi(__argv[i + 1]) * 1024;
+        } else if (strcmp(__argv[i], "--no-menu-atlas") == 0) {
+            menuAtlasEnabled = false;
+        } else if (strcmp(__argv[i], "--no-audio") == 0) {
+            audioRequested = false;
+        } else if (strcmp(__argv[i], "--effects") == 0 && i + 1 < __argc) {
+            for (int tier = 0; tier < EFFECTS_TIER_COUNT; tier++) {
+                if (strcmp(__argv[i + 1], EFFECTS_TIERS[tier].name) == 0) {
+                    ResetEffectsGovernor(effects, tier);
+                    effectsAdaptive = false;
+                }
+            }
+        } else if (strcmp(__argv[i], "--slow-render") == 0 && i + 1 < __argc) {
+            slowRenderMs = (float)atof(__argv[i + 1]);
+        } else if (strcmp(__argv[i], "--latency-test") == 0) {
+            latencyTest = true;
+        } else if (strcmp(__argv[i], "--hash-log") == 0 && i + 1 < __argc) {
+            // Before the headless modes, so --terminal games are logged too
+            StartStateHashLog(__argv[i + 1]);
+        }
+    }
+    SelectPixelKernels(forcedKernels);
+
+    // Headless modes never open a window
+    if (RunHeadlessMode(__argc, __argv)) {
+        StopStateHashLog();
+        return 0;
+    }
+
     // Initialize GDI+
     GdiplusStartupInput gdiplusStartupInput;
     GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
+    CreateGameFonts();
+    CreateGameBrushes();
 
     // Load background image
     backgroundImage = new Image(BACKGROUND_IMAGE);
@@ -999,32 +6890,102 @@ int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE hprev, PSTR cmdline, int cmdsh
         MessageBoxA(NULL, "Failed to create window", "Error", MB_OK);
         return 1;
     }
+    UpdateDisplayRefresh(hwnd);
+
+    // Optional telemetry recording and rasterizer thread count
+    int rasterThreads = (int)std::thread::hardware_concurrency() - 1;
+    for (int i = 1; i + 1 < __argc; i++) {
+        if (strcmp(__argv[i], "--telemetry") == 0) {
+            if (!StartTelemetry(__argv[i + 1])) {
+                const char* error = telemetryEnabled ? "--telemetry can only be given once"
+                                                     : "Failed to open the telemetry file";
+                StopTelemetry();
+                MessageBoxA(NULL, error, "Error", MB_OK);
+                return 1;
+            }
+        } else if (strcmp(__argv[i], "--raster-threads") == 0) {
+            rasterThreads = atoi(__argv[i + 1]);
+        }
+    }
+    StartRasterWorkers(rasterThreads);
+    if (audioRequested) {
+        StartAudio(&WAVE_OUT_AUDIO_SINK, nullptr);
+    }
 
     // Show window
     ShowWindow(hwnd, cmdshow);
     UpdateWindow(hwnd);
 
+    // --latency-test: start an easy game the way the keys do and measure
+    if (latencyTest) {
+        AttachParentConsole();
+        SendMessageA(hwnd, WM_KEYDOWN, VK_RETURN, 0);  // menu -> difficulty select
+        SendMessageA(hwnd, WM_KEYDOWN, VK_RETURN, 0);  // easy game
+        StartLatencyHarness(hwnd, true);
+    }
+
     // Message loop with game update
+    // 1 ms timer resolution, so waits between frames are short enough for
+    // high refresh rates
+    timeBeginPeriod(1);
     MSG msg = {};
-    while (true) {
-        if (PeekMessageA(&msg, NULL, 0, 0, PM_REMOVE)) {
+    LONGLONG lastFrameStart = 0;
+    bool running = true;
+    while (running) {
+        while (PeekMessageA(&msg, NULL, 0, 0, PM_REMOVE)) {
             if (msg.message == WM_QUIT) {
+                running = false;
                 break;
             }
             TranslateMessage(&msg);
             DispatchMessage(&msg);
-        } else {
-            // Update game when idle
+        }
+        if (!running) {
+            break;
+        }
+
+        // Work out how long we may sleep
+        LONGLONG now = QueryCounter();
+        bool hidden = !windowMinimized && IsWindowHidden(hwnd);
+        bool inputFrame = redrawRequested && framePacing == PACING_ON_INPUT;
+        DWORD waitMs = NextFrameWaitMs(windowMinimized, hidden, CounterToMs(now - lastFrameStart), inputFrame);
+        if (waitMs == 0) {
+            // Update game and draw the frame. Damage the system already
+            // queued needs a full present.
+            if (GetUpdateRect(hwnd, NULL, FALSE)) {
+                fullPresentRequired = true;
+            }
+            redrawRequested = false;
+            lastFrameStart = now;
+            paintScheduled = true;
             InvalidateRect(hwnd, NULL, FALSE);
-            Sleep(16); // ~60 FPS
+            UpdateWindow(hwnd);
+            continue;
+        }
+
+        // The latency harness may need to post its next key sooner
+        DWORD harnessWaitMs = PumpLatencyHarness(hwnd);
+        if (harnessWaitMs < waitMs) {
+            waitMs = harnessWaitMs;
         }
+
+        // Block until input or the next deadline
+        MsgWaitForMultipleObjectsEx(0, NULL, waitMs, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
     }
 
     // Cleanup
+    timeEndPeriod(1);
+    StopTelemetry();
+    StopStateHashLog();
+    StopRasterWorkers();
+    StopAudio();
+    ReleaseBackBuffer();
     if (backgroundImage) {
         delete backgroundImage;
     }
+    DeleteGameBrushes();
+    DeleteGameFonts();
     GdiplusShutdown(gdiplusToken);
 
-    return 0;
+    return (int)msg.wParam;
 }
\ No newline at end of file